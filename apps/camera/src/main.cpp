@@ -1,6 +1,11 @@
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
 
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
@@ -9,50 +14,734 @@ namespace po = boost::program_options;
 #include <opencv/cxcore.h>
 #include <opencv/highgui.h>
 #include <opencv2/highgui/highgui.hpp>
- 
+
+#include <libabr.h>
+#include <spsc_queue.h>
+#include <stream_server.h>
+
 using namespace cv;
- 
-bool capture(void)
+
+#define MAX_DET (2000)
+
+// Pipeline stages, each runs in its own thread (render in the main thread)
+enum Stage
 {
-    CvCapture* capture = cvCaptureFromCAM(0);
-    if (capture == NULL) {
-        fprintf( stderr, "ERROR: capture is NULL \n" );
-        getchar();
+    CAPTURE, GRAY, PREPROCESS, DETECT, GROUP, RENDER, STAGES
+};
+
+static const char* StageNames[STAGES] = {
+    "capture", "gray", "preprocess", "detect", "group", "render"
+};
+
+// Frame travelling through the pipeline, frames are recycled
+struct Frame
+{
+    IplImage* Color;                    // Copy of the captured frame
+    IplImage* Gray;
+    PreprocessedPyramid* Pyramid;
+    std::vector<Detection> Detections;
+    int Count;                          // Valid detections
+    int64 Captured;                     // Tick count of capture
+};
+
+// Counters of a stage, written by the stage thread only
+struct StageStats
+{
+    volatile unsigned long Frames;
+    volatile int64 Busy;                // Ticks spent processing
+    volatile int64 Latency;             // Ticks since capture when the stage finished
+};
+
+// Engine selection for the classifier (the fastest supported one)
+static bool SelectEngine(TClassifier* c, ScanImageFunc* scan, int* ppOpts, int* pcOpts)
+{
+    switch (c->tp)
+    {
+    case HAAR:
+        *scan = scan_image_haar;
+        *ppOpts = PP_HAAR_IMAGE;
+        *pcOpts = RECALC_OFFSET | OFFSET_INTEGRAL;
+        return true;
+    case MBLBP:
+        *scan = scan_image_mblbp;
+        *ppOpts = PP_INTEGRAL_IMAGE;
+        *pcOpts = RECALC_OFFSET | OFFSET_INTEGRAL;
+        return true;
+    case LRD:
+    case LRP:
+    case LBP:
+        if (c->fsz != FSZ_UNRESTRICTED)
+        {
+            *scan = scan_image_conv_bunch16;
+            *ppOpts = (c->fsz == FSZ_4x4) ? PP_CONV_4x4_IMAGE : PP_CONV_IMAGE;
+            *pcOpts = RECALC_RANKS;
+        }
+        else
+        {
+            *scan = scan_image_integral;
+            *ppOpts = PP_INTEGRAL_IMAGE;
+            *pcOpts = RECALC_OFFSET | OFFSET_INTEGRAL;
+        }
+        return true;
+    default:
         return false;
     }
+}
 
-    // Create a window in which the captured images will be presented
-    cvNamedWindow( "mywindow", WINDOW_AUTOSIZE );
+static int align2(int x)
+{
+    return (x + 1) & ~1;
+}
 
-    // Show the image captured from the camera in the window and repeat
-    while ( 1 )
+// Capture, preprocessing, detection and rendering in a pipeline of threads
+// connected by bounded lock-free queues. Frames circulate from the capture
+// through all the stages and back to the capture by the free queue. When
+// the pipeline is full, camera frames are dropped at capture so the latency
+// stays bounded; video files are processed completely.
+// With tracking (trackInterval > 0) the detect stage uses detect_objects_video
+// which preprocesses only the scanned regions and groups the detections, so
+// the preprocess and group stages pass the frames through. With motion
+// masks the detect stage uses detect_objects_motion which preprocesses and
+// scans only the windows around changed blocks. With incremental
+// preprocessing the detect stage keeps one pyramid of the previous frame
+// and updates it only in the tiles changed by the new frame (frames are
+// recycled out of order, so their own pyramids would hold older frames).
+// With a time budget the detect
+// stage uses detect_objects_budget which scans bands of the frame until the
+// budget runs out and carries the rest over to the next frames.
+class Pipeline
+{
+public:
+    Pipeline(CvCapture* capture, bool live, TClassifier* c, unsigned queueSize, bool display, int trackInterval, bool motion, bool incremental, double budget)
+        : Capture(capture), Live(live), Classifier(c), Video(NULL), Motion(NULL), Budget(NULL), Coverage(0), Incremental(incremental), Pyramid(NULL), Display(display), Stop(false), Dropped(0)
     {
-        // Get one frame
-        IplImage* frame = cvQueryFrame( capture );
-        if ( !frame )
+        if (Classifier && !SelectEngine(Classifier, &Scan, &PPOpts, &PCOpts))
         {
-            fprintf( stderr, "ERROR: frame is null...\n" );
-            getchar();
-            break;
+            Classifier = NULL;
+        }
+
+        if (Classifier && trackInterval > 0)
+        {
+            VideoParams vp = { trackInterval, 20.0f, 0.25f, 1, 16, 3, 0.2f };
+            TileParams tp = { 0, 8, 4, PPOpts, PCOpts };
+            Video = create_video_state(&vp, &tp);
+        }
+        else if (Classifier && motion)
+        {
+            MotionParams mp = { 32, 12, 8, 1 };
+            Motion = create_motion_mask(&mp);
+        }
+        else if (Classifier && budget > 0)
+        {
+            BudgetParams bp = { budget, 16, 1, 4, 0.5f };
+            TileParams tp = { 0, 8, 4, PPOpts, PCOpts };
+            Budget = create_budget_state(&bp, &tp);
+        }
+
+        // Enough frames to fill all queues and the stages, the free queue holds all of them
+        const unsigned count = RENDER * queueSize + STAGES;
+        for (int s = 0; s < STAGES; ++s)
+        {
+            Queues[s] = new fr::SpscQueue<Frame*>((s == RENDER) ? count : queueSize);
+            pthread_mutex_init(&Locks[s], NULL);
+            pthread_cond_init(&Changed[s], NULL);
+            Stats[s].Frames = 0;
+            Stats[s].Busy = 0;
+            Stats[s].Latency = 0;
+        }
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            Frame* f = new Frame();
+            f->Color = NULL;
+            f->Gray = NULL;
+            f->Pyramid = NULL;
+            f->Detections.resize(MAX_DET);
+            f->Count = 0;
+            Frames.push_back(f);
+            Queues[RENDER]->Push(f);
+        }
+    }
+
+    ~Pipeline()
+    {
+        for (unsigned i = 0; i < Frames.size(); ++i)
+        {
+            cvReleaseImage(&Frames[i]->Color);
+            cvReleaseImage(&Frames[i]->Gray);
+            if (Frames[i]->Pyramid)
+            {
+                release_pyramid(&Frames[i]->Pyramid);
+            }
+            delete Frames[i];
         }
+        for (int s = 0; s < STAGES; ++s)
+        {
+            delete Queues[s];
+            pthread_cond_destroy(&Changed[s]);
+            pthread_mutex_destroy(&Locks[s]);
+        }
+        if (Video)
+        {
+            release_video_state(&Video);
+        }
+        if (Motion)
+        {
+            release_motion_mask(&Motion);
+        }
+        if (Budget)
+        {
+            release_budget_state(&Budget);
+        }
+        if (Pyramid)
+        {
+            release_pyramid(&Pyramid);
+        }
+    }
 
-        cvShowImage( "mywindow", frame );
-        // Do not release the frame!
-        //If ESC key pressed, Key=0x10001B under OpenCV 0.9.7(linux version),
-        //remove higher bits using AND operator
-        if ( (cvWaitKey(10) & 255) == 27 )
+    // Start the stage threads and render in the calling thread
+    void Run()
+    {
+        pthread_t threads[RENDER];
+        Worker workers[RENDER];
+        for (int s = 0; s < RENDER; ++s)
         {
+            workers[s].P = this;
+            workers[s].S = Stage(s);
+            pthread_create(&threads[s], NULL, StageThread, &workers[s]);
+        }
+
+        if (Display)
+        {
+            cvNamedWindow("mywindow", WINDOW_AUTOSIZE);
+        }
+
+        int64 lastReport = cvGetTickCount();
+        StageStats last[STAGES] = {};
+        unsigned long lastDropped = 0;
+
+        for (;;)
+        {
+            Frame* f = Take(GROUP);
+            if (!f)
+            {
+                break;
+            }
+
+            const int64 t0 = cvGetTickCount();
+            Render(f);
+            Account(RENDER, f, t0);
+            Give(RENDER, f);
+
+            if (Display && (cvWaitKey(1) & 255) == 27)
+            {
+                Stop = true;
+            }
+
+            // Live report once per second
+            const int64 now = cvGetTickCount();
+            const double seconds = (now - lastReport) / (cvGetTickFrequency() * 1e6);
+            if (seconds >= 1.0)
+            {
+                Report(last, seconds, Dropped - lastDropped);
+                for (int s = 0; s < STAGES; ++s)
+                {
+                    last[s].Frames = Stats[s].Frames;
+                    last[s].Busy = Stats[s].Busy;
+                    last[s].Latency = Stats[s].Latency;
+                }
+                lastDropped = Dropped;
+                lastReport = now;
+            }
+        }
+
+        for (int s = 0; s < RENDER; ++s)
+        {
+            pthread_join(threads[s], NULL);
+        }
+
+        if (Display)
+        {
+            cvDestroyWindow("mywindow");
+        }
+    }
+
+protected:
+    struct Worker
+    {
+        Pipeline* P;
+        Stage S;
+    };
+
+    static void* StageThread(void* arg)
+    {
+        Worker* w = static_cast<Worker*>(arg);
+        if (w->S == CAPTURE)
+        {
+            w->P->RunCapture();
+        }
+        else
+        {
+            w->P->RunStage(w->S);
+        }
+        return NULL;
+    }
+
+    // Wait for an item of the queue, NULL marks the end of the stream.
+    // The queues themselves do not block; a stage finding its queue empty
+    // (or full in Give) sleeps on the condition of the queue, which the other
+    // side signals after each Push or Pop.
+    Frame* Take(int q)
+    {
+        Frame* f;
+        if (!Queues[q]->Pop(f))
+        {
+            pthread_mutex_lock(&Locks[q]);
+            while (!Queues[q]->Pop(f))
+            {
+                pthread_cond_wait(&Changed[q], &Locks[q]);
+            }
+            pthread_mutex_unlock(&Locks[q]);
+        }
+        Notify(q);
+        return f;
+    }
+
+    void Give(int q, Frame* f)
+    {
+        if (!Queues[q]->Push(f))
+        {
+            pthread_mutex_lock(&Locks[q]);
+            while (!Queues[q]->Push(f))
+            {
+                pthread_cond_wait(&Changed[q], &Locks[q]);
+            }
+            pthread_mutex_unlock(&Locks[q]);
+        }
+        Notify(q);
+    }
+
+    // Wake the other side of the queue if it waits
+    void Notify(int q)
+    {
+        pthread_mutex_lock(&Locks[q]);
+        pthread_cond_signal(&Changed[q]);
+        pthread_mutex_unlock(&Locks[q]);
+    }
+
+    void RunCapture()
+    {
+        Frame* spare = NULL;
+        while (!Stop)
+        {
+            if (!Live && !spare)
+            {
+                spare = Take(RENDER);
+            }
+
+            const int64 t0 = cvGetTickCount();
+            IplImage* img = cvQueryFrame(Capture);
+            if (!img)
+            {
+                break;
+            }
+
+            // All frames are in the pipeline or the next stage is busy
+            if (!spare && !Queues[RENDER]->Pop(spare))
+            {
+                ++Dropped;
+                continue;
+            }
+
+            if (!spare->Color || spare->Color->width != img->width || spare->Color->height != img->height)
+            {
+                cvReleaseImage(&spare->Color);
+                spare->Color = cvCreateImage(cvGetSize(img), IPL_DEPTH_8U, img->nChannels);
+            }
+            cvCopy(img, spare->Color);
+            spare->Captured = t0;
+
+            if (Live && Queues[CAPTURE]->Size() >= Queues[CAPTURE]->Capacity())
+            {
+                ++Dropped;
+                continue;
+            }
+            Account(CAPTURE, spare, t0);
+            Give(CAPTURE, spare);
+            spare = NULL;
+        }
+
+        Give(CAPTURE, NULL);
+    }
+
+    void RunStage(Stage s)
+    {
+        for (;;)
+        {
+            Frame* f = Take(s - 1);
+            if (f)
+            {
+                const int64 t0 = cvGetTickCount();
+                Process(s, f);
+                Account(s, f, t0);
+            }
+            Give(s, f);
+            if (!f)
+            {
+                break;
+            }
+        }
+    }
+
+    void Process(Stage s, Frame* f)
+    {
+        switch (s)
+        {
+        case GRAY:
+            if (!f->Gray || f->Gray->width != f->Color->width || f->Gray->height != f->Color->height)
+            {
+                cvReleaseImage(&f->Gray);
+                f->Gray = cvCreateImage(cvGetSize(f->Color), IPL_DEPTH_8U, 1);
+            }
+            if (f->Color->nChannels == 1)
+                cvCopy(f->Color, f->Gray);
+            else
+                cvCvtColor(f->Color, f->Gray, CV_BGR2GRAY);
+            break;
+        case PREPROCESS:
+            if (Classifier && !Video && !Motion && !Budget && !Incremental)
+            {
+                const CvSize sz = cvSize(align2(f->Gray->width), align2(f->Gray->height));
+                if (!f->Pyramid || f->Pyramid->PI[0]->sz.width != sz.width || f->Pyramid->PI[0]->sz.height != sz.height)
+                {
+                    if (f->Pyramid)
+                    {
+                        release_pyramid(&f->Pyramid);
+                    }
+                    f->Pyramid = create_pyramid(sz, cvSize(Classifier->width+2, Classifier->height+2), 8, 4);
+                }
+                insert_image(f->Gray, f->Pyramid, PPOpts);
+            }
+            break;
+        case DETECT:
+            // The only thread preparing the classifier
+            f->Count = 0;
+            if (Video)
+            {
+                f->Count = detect_objects_video(f->Gray, Classifier, &SP, Scan, Video,
+                        &f->Detections[0], &f->Detections[0] + MAX_DET);
+            }
+            else if (Motion)
+            {
+                TileParams tp = { 0, 8, 4, PPOpts, PCOpts };
+                f->Count = detect_objects_motion(f->Gray, Classifier, &SP, Scan, &tp, Motion,
+                        &f->Detections[0], &f->Detections[0] + MAX_DET);
+            }
+            else if (Budget)
+            {
+                CoverageReport report;
+                f->Count = detect_objects_budget(f->Gray, Classifier, &SP, Scan, Budget,
+                        &f->Detections[0], &f->Detections[0] + MAX_DET, &report);
+                Coverage = report.coverage;
+            }
+            else if (Classifier && Incremental)
+            {
+                // The pyramid holds the previous frame of the stream
+                const CvSize sz = cvSize(align2(f->Gray->width), align2(f->Gray->height));
+                if (!Pyramid || Pyramid->PI[0]->sz.width != sz.width || Pyramid->PI[0]->sz.height != sz.height)
+                {
+                    if (Pyramid)
+                    {
+                        release_pyramid(&Pyramid);
+                    }
+                    Pyramid = create_pyramid(sz, cvSize(Classifier->width+2, Classifier->height+2), 8, 4);
+                }
+                insert_image_incremental(f->Gray, Pyramid, PPOpts, NULL, 0);
+                const float scale = float(f->Gray->width) / Pyramid->PI[0]->sz.width;
+                f->Count = detect_objects(Pyramid, Classifier, &SP, Scan,
+                        &f->Detections[0], &f->Detections[0] + MAX_DET, PCOpts, scale, 0);
+            }
+            else if (Classifier)
+            {
+                const float scale = float(f->Gray->width) / f->Pyramid->PI[0]->sz.width;
+                f->Count = detect_objects(f->Pyramid, Classifier, &SP, Scan,
+                        &f->Detections[0], &f->Detections[0] + MAX_DET, PCOpts, scale, 0);
+            }
+            break;
+        case GROUP:
+            if (!Video)
+                f->Count = group_detections(&f->Detections[0], &f->Detections[0] + f->Count, 3, 0.2f);
             break;
+        default:
+            break;
+        }
+    }
+
+    void Render(Frame* f)
+    {
+        if (!Display)
+        {
+            return;
+        }
+        for (int k = 0; k < f->Count; ++k)
+        {
+            const Detection& r = f->Detections[k];
+            cvRectangle(f->Color, cvPoint(r.x,r.y), cvPoint(r.x+r.width,r.y+r.height), CV_RGB(0,255,0), 2);
+        }
+        cvShowImage("mywindow", f->Color);
+    }
+
+    void Account(Stage s, Frame* f, int64 t0)
+    {
+        const int64 t1 = cvGetTickCount();
+        Stats[s].Busy += t1 - t0;
+        Stats[s].Latency += t1 - f->Captured;
+        ++Stats[s].Frames;
+    }
+
+    // Throughput, mean processing time and mean latency since capture of each stage
+    void Report(const StageStats* last, double seconds, unsigned long dropped)
+    {
+        const double ms = cvGetTickFrequency() * 1e3;
+        for (int s = 0; s < STAGES; ++s)
+        {
+            const unsigned long n = Stats[s].Frames - last[s].Frames;
+            const double busy = n ? (Stats[s].Busy - last[s].Busy) / (ms * n) : 0.0;
+            const double latency = n ? (Stats[s].Latency - last[s].Latency) / (ms * n) : 0.0;
+            fprintf(stderr, "%s %.1f fps %.2f ms %.1f ms | ", StageNames[s], n / seconds, busy, latency);
+        }
+        if (Budget)
+        {
+            fprintf(stderr, "coverage %.0f%% | ", 100.0f * Coverage);
         }
+        fprintf(stderr, "dropped %lu\n", dropped);
+    }
+
+    CvCapture* Capture;
+    bool Live;
+
+    TClassifier* Classifier;
+    VideoState* Video;
+    MotionMask* Motion;
+    BudgetState* Budget;
+    volatile float Coverage;            // Coverage of the last frame with a budget
+    bool Incremental;
+    PreprocessedPyramid* Pyramid;       // Previous frame for incremental preprocessing (detect stage)
+    ScanImageFunc Scan;
+    int PPOpts;
+    int PCOpts;
+    ScanParams SP;
+
+    bool Display;
+    volatile bool Stop;
+    volatile unsigned long Dropped;
+
+    // Queues[s] connects stage s with the next one, Queues[RENDER] returns free frames
+    fr::SpscQueue<Frame*>* Queues[STAGES];
+    pthread_mutex_t Locks[STAGES];      // Guard the waits for Queues[s]
+    pthread_cond_t Changed[STAGES];     // An item was pushed to or popped from Queues[s]
+    std::vector<Frame*> Frames;
+    StageStats Stats[STAGES];
+};
+
+bool capture(const po::variables_map& vm)
+{
+    const bool live = !vm.count("video");
+    CvCapture* capture = live ? cvCaptureFromCAM(vm["camera"].as<int>()) : cvCaptureFromFile(vm["video"].as<std::string>().c_str());
+    if (capture == NULL) {
+        fprintf( stderr, "ERROR: capture is NULL \n" );
+        return false;
+    }
+
+    TClassifier* c = NULL;
+    if (vm.count("classifier"))
+    {
+        c = load_classifier_XML(vm["classifier"].as<std::string>().c_str());
+        if (!c)
+        {
+            fprintf( stderr, "ERROR: cannot load classifier \n" );
+            cvReleaseCapture( &capture );
+            return false;
+        }
+        init_classifier(c);
+        if (vm.count("threshold"))
+        {
+            c->threshold = vm["threshold"].as<float>();
+        }
+        init_preprocess();
+    }
+
+    {
+        Pipeline pipeline(capture, live, c, vm["queue"].as<unsigned>(), !vm.count("no-display"), vm["track"].as<int>(), vm.count("motion") > 0, vm.count("incremental") > 0, vm["budget"].as<double>());
+        pipeline.Run();
     }
 
     // Release the capture device housekeeping
+    if (c)
+    {
+        release_classifier(&c);
+    }
     cvReleaseCapture( &capture );
-    cvDestroyWindow( "mywindow" );
 
     return true;
 }
 
+// Source of one stream of the server, frames of video files are submitted at their frame rate
+struct Feed
+{
+    fr::StreamServer* Server;
+    int Stream;
+    CvCapture* Capture;
+    bool Live;
+    volatile bool Done;
+};
+
+static void* FeedThread(void* arg)
+{
+    Feed* feed = static_cast<Feed*>(arg);
+    const double fps = feed->Live ? 0 : cvGetCaptureProperty(feed->Capture, CV_CAP_PROP_FPS);
+    IplImage* gray = NULL;
+    int64 next = cvGetTickCount();
+
+    while (IplImage* img = cvQueryFrame(feed->Capture))
+    {
+        if (!gray || gray->width != img->width || gray->height != img->height)
+        {
+            cvReleaseImage(&gray);
+            gray = cvCreateImage(cvGetSize(img), IPL_DEPTH_8U, 1);
+        }
+        if (img->nChannels == 1)
+            cvCopy(img, gray);
+        else
+            cvCvtColor(img, gray, CV_BGR2GRAY);
+
+        feed->Server->Submit(feed->Stream, gray);
+
+        if (fps > 0)
+        {
+            next += int64(cvGetTickFrequency() * 1e6 / fps);
+            const int64 wait = next - cvGetTickCount();
+            if (wait > 0)
+            {
+                usleep(wait / cvGetTickFrequency());
+            }
+        }
+    }
+
+    cvReleaseImage(&gray);
+    feed->Done = true;
+    return NULL;
+}
+
+static void ReportStreams(fr::StreamServer& server, const std::vector<Feed>& feeds)
+{
+    for (unsigned i = 0; i < feeds.size(); ++i)
+    {
+        const fr::StreamStats st = server.GetStats(feeds[i].Stream);
+        fprintf(stderr, "stream %u: %lu frames, %lu dropped, %lu late, latency %.1f ms (max %.1f)\n",
+                i, st.Processed, st.Dropped, st.Late, st.Latency, st.MaxLatency);
+    }
+}
+
+// Detection on many streams by one server sharing the classifier
+bool serve(const po::variables_map& vm)
+{
+    if (!vm.count("classifier"))
+    {
+        fprintf( stderr, "ERROR: streams need a classifier \n" );
+        return false;
+    }
+
+    TClassifier* c = load_classifier_XML(vm["classifier"].as<std::string>().c_str());
+    if (!c)
+    {
+        fprintf( stderr, "ERROR: cannot load classifier \n" );
+        return false;
+    }
+    init_classifier(c);
+    if (vm.count("threshold"))
+    {
+        c->threshold = vm["threshold"].as<float>();
+    }
+    init_preprocess();
+
+    ScanImageFunc scan;
+    int ppOpts, pcOpts;
+    if (!SelectEngine(c, &scan, &ppOpts, &pcOpts))
+    {
+        fprintf( stderr, "ERROR: unsupported classifier \n" );
+        release_classifier(&c);
+        return false;
+    }
+
+    unsigned workers = vm["workers"].as<unsigned>();
+    if (workers == 0)
+    {
+        workers = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    }
+
+    bool ok = true;
+    {
+        fr::StreamServer server(c, scan, ppOpts, pcOpts, ScanParams(), workers, NULL, NULL);
+
+        fr::StreamParams params = { vm["latency"].as<double>(), vm["track"].as<int>() };
+        const std::vector<std::string>& sources = vm["stream"].as<std::vector<std::string> >();
+        std::vector<Feed> feeds;
+        for (unsigned i = 0; i < sources.size(); ++i)
+        {
+            // Numbers are camera indices
+            char* end;
+            const long index = strtol(sources[i].c_str(), &end, 10);
+            const bool live = (*end == 0);
+            Feed feed = { &server, server.AddStream(params), NULL, live, false };
+            feed.Capture = live ? cvCaptureFromCAM(index) : cvCaptureFromFile(sources[i].c_str());
+            if (!feed.Capture)
+            {
+                fprintf( stderr, "ERROR: cannot open %s \n", sources[i].c_str() );
+                ok = false;
+                break;
+            }
+            feeds.push_back(feed);
+        }
+
+        std::vector<pthread_t> threads(feeds.size());
+        for (unsigned i = 0; ok && i < feeds.size(); ++i)
+        {
+            pthread_create(&threads[i], NULL, FeedThread, &feeds[i]);
+        }
+
+        for (bool running = ok; running; )
+        {
+            sleep(1);
+            running = false;
+            for (unsigned i = 0; i < feeds.size(); ++i)
+            {
+                running = running || !feeds[i].Done;
+            }
+            ReportStreams(server, feeds);
+        }
+
+        for (unsigned i = 0; ok && i < feeds.size(); ++i)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        server.Flush();
+        server.Stop();
+        if (ok)
+        {
+            ReportStreams(server, feeds);
+        }
+
+        for (unsigned i = 0; i < feeds.size(); ++i)
+        {
+            cvReleaseCapture(&feeds[i].Capture);
+        }
+    }
+
+    release_classifier(&c);
+    return ok;
+}
+
 int main(int argc, char** argv)
 {
     // Specify program options
@@ -61,6 +750,19 @@ int main(int argc, char** argv)
             ("help,h", "produce help message")
             ("capture,c", "capture from camera")
             ("action,a", po::value<std::string>(), "action")
+            ("camera", po::value<int>()->default_value(0), "camera index")
+            ("video,v", po::value<std::string>(), "capture from video file")
+            ("classifier,x", po::value<std::string>(), "classifier XML file (detection is off without it)")
+            ("threshold,t", po::value<float>(), "classifier threshold")
+            ("queue,q", po::value<unsigned>()->default_value(2), "capacity of queues between stages")
+            ("track", po::value<int>()->default_value(0), "full scan every N frames, track objects in between (0 - off)")
+            ("motion", "rescan only windows around changed blocks (fixed cameras)")
+            ("budget", po::value<double>()->default_value(0.0), "time budget of detection in a frame in ms, the rest is carried over (0 - off)")
+            ("incremental", "preprocess only tiles changed since the previous frame (in the detect stage)")
+            ("stream,s", po::value<std::vector<std::string> >()->composing(), "video file or camera index of a stream served by shared workers (repeat for more streams)")
+            ("workers,j", po::value<unsigned>()->default_value(0), "worker threads of the stream server (0 - one per core)")
+            ("latency", po::value<double>()->default_value(100.0), "target latency of each stream in ms")
+            ("no-display", "do not show the frames")
             ;
 
     po::variables_map vm;
@@ -78,20 +780,27 @@ int main(int argc, char** argv)
         return EXIT_FAILURE;
     }
 
+    const std::string action = vm.count("action") ? vm["action"].as<std::string>() : "";
+
     // Print help and exit if needed
-    if (vm.count("help") || vm["action"].as<std::string>() == "help")
+    if (vm.count("help") || action == "help")
     {
         std::cout << desc << std::endl;
         return EXIT_SUCCESS;
     }
 
-    // Capture from camera if requested
-    if(vm.count("capture") || vm["action"].as<std::string>() == "capture")
+    // Serve many streams if requested
+    if (vm.count("stream"))
     {
-        capture();
-        return EXIT_SUCCESS;
+        return serve(vm) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Capture from camera or video if requested
+    if(vm.count("capture") || vm.count("video") || action == "capture")
+    {
+        return capture(vm) ? EXIT_SUCCESS : EXIT_FAILURE;
     }
-  
+
     // Exit successfuly ...
     return EXIT_SUCCESS;
 }
@@ -11,6 +11,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <math.h>
+#include <stdlib.h>
 
 
 TRect rect(int _x, int _y, int _w, int _h)
@@ -85,6 +86,20 @@ void setClassifierImageSize(TClassifier * classifier, unsigned widthStep)
 }
 
 
+/// State of a scan passed to the evaluation functions.
+/// Everything that changes from window to window lives here (not in globals
+/// or in the classifier) so more threads can scan with the same classifier.
+typedef struct
+{
+    TImage * image;     ///< Scanned image
+    unsigned * sum;     ///< Integral image, (width+1) x (height+1) with zero first row and column (HAAR only)
+    unsigned * sqsum;   ///< Integral image of squared intensities (HAAR only)
+    unsigned sumStep;   ///< Row of the integral images in items
+    unsigned sumOffset; ///< Top-left corner of the evaluated window in the integral images
+    float normFactor;   ///< Standard deviation of intensity in the evaluated window (HAAR only)
+} TEvalContext;
+
+
 /// Sum of regions in 3x3 grid.
 /// Sums values in regions and stores the results in a vector.
 /// @param data Ptr to top-left corner 
@@ -125,8 +140,9 @@ static void sumRegions3x3(unsigned char * data, int w, int h, unsigned widthStep
 
 /// Simple version of LRD evaluation.
 /// Sums the pixels in the feature grid and calculates ranks of selected pixels.
-static float evalLRDStageSimple(TImage * image, unsigned smpOffset, void * s)
+static float evalLRDStageSimple(TEvalContext * ctx, unsigned smpOffset, void * s)
 {
+    TImage * image = ctx->image;
     TStage * stg = (TStage*)s;
     int values[9] = {0,0,0,0,0,0,0,0,0};
     // Get absolute address of feature in image
@@ -157,8 +173,9 @@ static float evalLRDStageSimple(TImage * image, unsigned smpOffset, void * s)
 }
 
 
-static float evalLRPStageSimple(TImage * image, unsigned smpOffset, void * s)
+static float evalLRPStageSimple(TEvalContext * ctx, unsigned smpOffset, void * s)
 {
+    TImage * image = ctx->image;
     TStage * stg = (TStage*)s;
     int values[9] = {0,0,0,0,0,0,0,0,0};
     // Get absolute address of feature in image
@@ -189,8 +206,9 @@ static float evalLRPStageSimple(TImage * image, unsigned smpOffset, void * s)
 }
 
 
-static float evalLBPStageSimple(TImage * image, unsigned smpOffset, void * s)
+static float evalLBPStageSimple(TEvalContext * ctx, unsigned smpOffset, void * s)
 {
+    TImage * image = ctx->image;
     TStage * stg = (TStage*)s;
     static const int LBPOrder[8] = {0, 1, 2, 5, 8, 7, 6, 3};
 
@@ -224,7 +242,7 @@ static inline int max(int a, int b)
 }
 
 ///////////
-// Haar evaluation on the intensity image
+// Haar evaluation on integral images
 
 /// Number of samples for different types of Haar features
 static const int haarSampling[12]= {
@@ -261,106 +279,93 @@ static const float haarWeights[6][16] = {
     {1, 1, 1, 1, -8, 1, 1, 1, 1},
 };
 
-// Normalization factor for Haar features
-static float normFactor;
-
-/// Sum values in an area.
-/// @param base Top-left corner of the area (image is assumed to be 8bit, single channel)
+/// Sum of an area from integral image.
+/// @param I Integral image at the top-left corner of the area
+/// @param step Row of the integral image in items
 /// @param w Width of the area
 /// @param h Height of the area
-/// @param widthStep Distance between two rows in bytes
-/// @returns sum of the area
-static inline int sumArea(unsigned char * base, int w, int h, int widthStep)
+/// @returns sum of the area (exact even if the integral image wraps around)
+static inline unsigned sumArea(const unsigned * I, unsigned step, unsigned w, unsigned h)
 {
-    int sum = 0;
-    int y;
-    for (y = 0; y < h; ++y, base += widthStep)
-    {
-        unsigned char * px = base;
-        while (px < base + w)
-        {
-            sum += *px;
-            ++px; 
-        }
-    }
-    return sum;
+    return I[h * step + w] - I[h * step] - I[w] + I[0];
 }
 
-/// Calculate sum and sum of squares of an area.
-/// @param base Top-left corner of the area (image is assumed to be 8bit, single channel)
-/// @param w Width of the area
-/// @param h Height of the area
-/// @param widthStep Distance between two rows in bytes
-/// @param sum Sum of the area
-/// @param sum2 Sum of squares of the area
-static inline void sumArea2(unsigned char * base, int w, int h, int widthStep, unsigned * sum, unsigned * sum2)
+/// Integral images of intensities and squared intensities.
+/// Both have zero first row and column so the areas touching the image
+/// border need no special care.
+static void integrateImage(const TImage * image, unsigned * sum, unsigned * sqsum)
 {
-    *sum = 0;
-    *sum2 = 0;
-    int y;
-    for (y = 0; y < h; ++y, base += widthStep)
+    const unsigned step = image->width + 1;
+    int x, y;
+    for (x = 0; x <= image->width; ++x)
     {
-        unsigned char * px = base;
-        while (px < base + w)
+        sum[x] = sqsum[x] = 0;
+    }
+    for (y = 0; y < image->height; ++y)
+    {
+        const unsigned char * px = (const unsigned char*)image->imageData + y * image->widthStep;
+        unsigned * s = sum + (y + 1) * step;
+        unsigned * s2 = sqsum + (y + 1) * step;
+        unsigned rowSum = 0, rowSum2 = 0;
+        s[0] = s2[0] = 0;
+        for (x = 0; x < image->width; ++x)
         {
-            *sum += *px;
-            *sum2 += *px * *px;
-            ++px;
+            rowSum += px[x];
+            rowSum2 += px[x] * px[x];
+            s[x+1] = s[x+1-step] + rowSum;
+            s2[x+1] = s2[x+1-step] + rowSum2;
         }
     }
 }
 
 
-static float evalHaarStageSimple1(TImage * image, unsigned smpOffset, void * s)
+static float evalHaarStageSimple1(TEvalContext * ctx, unsigned smpOffset, void * s)
 {
     THaarStage * stg = (THaarStage*)s;
     int xs = haarSampling[2*stg->tp];
     int ys = haarSampling[2*stg->tp+1];
     int norm = haarNormScale[stg->tp];
     const float * weights = haarWeights[stg->tp];
-    unsigned char * base = (unsigned char*)(image->imageData + smpOffset + stg->offset);
+    const unsigned step = ctx->sumStep;
+    const unsigned * base = ctx->sum + ctx->sumOffset + stg->y * step + stg->x;
 
     int x,y;
     float f = 0.0f;
-    for (y = 0; y < ys; ++y, base+=stg->h*image->widthStep)
+    for (y = 0; y < ys; ++y, base += stg->h*step)
     {
         for (x = 0; x < xs; ++x)
         {
             float w = *weights++;
-            unsigned sum = sumArea(base + x * stg->w, stg->w, stg->h, image->widthStep);
+            unsigned sum = sumArea(base + x * stg->w, step, stg->w, stg->h);
             f += ((float)sum) * w;
         }
     }
 
     // Normalize
-    f = f / (norm * stg->size) / normFactor;
+    f = f / (norm * stg->size) / ctx->normFactor;
 
     // Discretize
     int bin = (int)((f - stg->min) / stg->range * (stg->bins-1) + 0.5);
     bin = min(stg->bins, max(0, bin));
     
-    //fprintf(stderr, "x=%d,y=%d,w=%d,h=%d\n", stg->x, stg->y, stg->w, stg->h);
-    //fprintf(stderr, "min=%f,max=%f,bins=%d\n", stg->min, stg->max,stg->bins);
-    //fprintf(stderr, "f=%f,bin=%d\n", f, bin);
-
     // return hypothesis respone
     return stg->alpha[bin];
 
 }
 
 /////////////
-typedef float (*StageEvalFunc)(TImage*, unsigned, void*);
-typedef int (*ClassifierEvalFunc)(TImage*, unsigned, TClassifier*, float*, StageEvalFunc);
+typedef float (*StageEvalFunc)(TEvalContext*, unsigned, void*);
+typedef int (*ClassifierEvalFunc)(TEvalContext*, unsigned, TClassifier*, float*, StageEvalFunc);
 
 
-static int evalLRDClassifier(TImage * image, unsigned smpOffset, TClassifier * classifier, float * response, StageEvalFunc eval)
+static int evalLRDClassifier(TEvalContext * ctx, unsigned smpOffset, TClassifier * classifier, float * response, StageEvalFunc eval)
 {
     *response = 0.0;
     // go through all stages and accumulate response
     TStage * stage;
     for (stage = (TStage*)classifier->stage; stage < (TStage*)classifier->stage + classifier->stageCount; ++stage)
     {
-        *response += eval(image, smpOffset, stage);
+        *response += eval(ctx, smpOffset, stage);
         //fprintf(stderr, "%f\n", *response);
         // Test the waldboost threshold
         if (*response < stage->theta_b)
@@ -374,21 +379,22 @@ static int evalLRDClassifier(TImage * image, unsigned smpOffset, TClassifier * c
 }
 
 
-static int evalHaarClassifier(TImage * image, unsigned smpOffset, TClassifier * classifier, float * response, StageEvalFunc eval)
+static int evalHaarClassifier(TEvalContext * ctx, unsigned smpOffset, TClassifier * classifier, float * response, StageEvalFunc eval)
 {
-    // get norm factor - standard deviation
-    unsigned sum = 0;
-    unsigned sum2 = 0;
-    unsigned size = classifier->width*classifier->height;
-    sumArea2((unsigned char*)image->imageData + smpOffset, classifier->width, classifier->height, image->widthStep, &sum, &sum2);
-    normFactor = sqrt((float)(sum2) / size - pow(((float)sum) / size, 2));
+    // get norm factor - standard deviation (flat windows are not normalized)
+    const unsigned * sum = ctx->sum + ctx->sumOffset;
+    const unsigned * sqsum = ctx->sqsum + ctx->sumOffset;
+    const float size = classifier->width*classifier->height;
+    const float mean = sumArea(sum, ctx->sumStep, classifier->width, classifier->height) / size;
+    const float var = sumArea(sqsum, ctx->sumStep, classifier->width, classifier->height) / size - mean * mean;
+    ctx->normFactor = (var > 0.0f) ? sqrtf(var) : 1.0f;
 
     *response = 0.0;
     // go through all stages and accumulate response
     THaarStage * stage;
     for (stage = (THaarStage*)classifier->stage; stage < (THaarStage*)classifier->stage + classifier->stageCount; ++stage)
     {
-        *response += eval(image, smpOffset, stage);
+        *response += eval(ctx, smpOffset, stage);
         // Test the waldboost threshold
         if (*response < stage->theta_b)
         {
@@ -431,6 +437,15 @@ unsigned scanImage(TImage * image, TClassifier * classifier, TRect * results, TR
     assert(eval != 0 && "Unsupported classifier type");
     assert(ceval != 0 && "Unsupported classifier type");
 
+    TEvalContext ctx = {image, 0, 0, image->width + 1, 0, 1.0f};
+    if (classifier->tp == HAAR)
+    {
+        const unsigned items = (image->width + 1) * (image->height + 1);
+        ctx.sum = (unsigned*)malloc(items * sizeof(unsigned));
+        ctx.sqsum = (unsigned*)malloc(items * sizeof(unsigned));
+        integrateImage(image, ctx.sum, ctx.sqsum);
+    }
+
     //fprintf(stderr, "%d,%d\n", classifier->width, classifier->height);
 
     // Set pointer to position for first detection
@@ -445,18 +460,26 @@ unsigned scanImage(TImage * image, TClassifier * classifier, TRect * results, TR
         {
             // Evaluate classifier
             float response;
-            int positive = ceval(image, rowOffset+x, classifier, &response, eval);
+            ctx.sumOffset = y * ctx.sumStep + x;
+            int positive = ceval(&ctx, rowOffset+x, classifier, &response, eval);
             if (positive) // write position of the detection
             {
                 *iter = rect(x, y, classifier->width, classifier->height);
                 iter->response = response;
                 ++iter;
                 if (iter == end)
+                {
+                    free(ctx.sum);
+                    free(ctx.sqsum);
                     return iter - results;
+                }
             }
         }
     }
 
+    free(ctx.sum);
+    free(ctx.sqsum);
+
     return iter - results;
 }
 
@@ -1,21 +1,25 @@
 /*
+ *  wbdetect -c classifier.xml [-t threshold] [-s scale] [-e engine] [-j threads] [-d decoders] [--stdin] [--nonms] [--draw] files...
+ *  Multi-scale detection with libabr engines. Each output line holds the
+ *  file name followed by the detections (x y w h ...). Images are decoded
+ *  ahead of the detection by a pool of threads.
  */
 
 // OpenCV
 #include <cv.h>
 #include <cxcore.h>
 #include <highgui.h>
-#include <opencv2/objdetect/objdetect.hpp>
-#include <opencv2/highgui/highgui.hpp>
-#include <opencv2/imgproc/imgproc.hpp>
 // STL
 #include <stdio.h>
 #include <assert.h>
-#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
 // Detection engine
-#include "lrd_engine.h" // Detection library
-#include "classifier.h" // Classifier loader
-#include "faces.h"      // Face detection classifier
+#include <libabr.h>
+#include <image_loader.h>
 // argtable
 #include <argtable2.h>
 
@@ -24,17 +28,79 @@
 
 
 using namespace std;
-using namespace cv;
 
 
-TImage image(IplImage * img)
+/// Detection engine with its preprocessing.
+struct Engine
 {
-    TImage tmp;
-    tmp.width = img->width;
-    tmp.height = img->height;
-    tmp.widthStep = img->widthStep;
-    tmp.imageData = img->imageData;
-    return tmp;
+    const char * name;
+    ScanImageFunc scan;
+    int pp_options;
+    int pc_options;
+    unsigned types; ///< Supported classifier types (bits 1 << ClassifierType)
+    unsigned sizes; ///< Supported feature sizes (bits 1 << FeatureSize)
+};
+
+#define TYPES(a) (1 << (a))
+#define ANY_SIZE ((1 << FSZ_UNRESTRICTED) | (1 << FSZ_2x2) | (1 << FSZ_4x4))
+#define SIZE_4x4 ((1 << FSZ_2x2) | (1 << FSZ_4x4))
+#define SIZE_2x2 (1 << FSZ_2x2)
+
+/// Engines from the fastest, 'auto' selects the first one supporting the classifier
+static const Engine engines[] = {
+    { "haar", scan_image_haar, PP_HAAR_IMAGE, RECALC_OFFSET | OFFSET_INTEGRAL, TYPES(HAAR), ANY_SIZE },
+    { "mblbp", scan_image_mblbp, PP_INTEGRAL_IMAGE, RECALC_OFFSET | OFFSET_INTEGRAL, TYPES(MBLBP), ANY_SIZE },
+    { "rank", scan_image_rank_bunch16, PP_RANK_IMAGE, NONE, TYPES(LRD) | TYPES(LRP), SIZE_4x4 },
+    { "conv", scan_image_conv_bunch16, PP_CONV_IMAGE, RECALC_RANKS, TYPES(LRD) | TYPES(LRP) | TYPES(LBP), SIZE_4x4 },
+    { "iconv", scan_image_iconv, PP_ICONV_IMAGE, RECALC_RANKS, TYPES(LRD) | TYPES(LRP) | TYPES(LBP), SIZE_2x2 },
+    { "lbp", scan_image_lbp, PP_LBP_IMAGE, NONE, TYPES(LBP), SIZE_2x2 },
+    { "integral", scan_image_integral, PP_INTEGRAL_IMAGE, RECALC_OFFSET | OFFSET_INTEGRAL, TYPES(LRD) | TYPES(LRP) | TYPES(LBP) | TYPES(MBLBP), ANY_SIZE },
+    { "intensity", scan_image_intensity, PP_COPY_IMAGE, RECALC_OFFSET, TYPES(LRD) | TYPES(LRP) | TYPES(LBP) | TYPES(MBLBP), ANY_SIZE },
+};
+
+static const int engine_count = sizeof(engines) / sizeof(engines[0]);
+
+static bool supports(const Engine & e, const TClassifier * c)
+{
+    return (e.types & TYPES(c->tp)) && (e.sizes & (1 << c->fsz));
+}
+
+/// Find the engine by name ('auto' for the fastest one supporting the classifier)
+static const Engine * select_engine(const char * name, const TClassifier * c)
+{
+    for (int i = 0; i < engine_count; ++i)
+    {
+        if ((string(name) == "auto" || string(name) == engines[i].name) && supports(engines[i], c))
+        {
+            return engines + i;
+        }
+    }
+    return 0;
+}
+
+/// Load and initialize the classifier, optionally override its threshold
+static TClassifier * load(const char * filename, float threshold, bool set_threshold)
+{
+    TClassifier * c = load_classifier_XML(filename);
+    if (c)
+    {
+        init_classifier(c);
+        if (set_threshold)
+        {
+            c->threshold = threshold;
+        }
+    }
+    return c;
+}
+
+int align2(int x)
+{
+    return (x + 1) & ~1;
+}
+
+CvSize align_size_2(CvSize sz)
+{
+    return cvSize(align2(sz.width), align2(sz.height));
 }
 
 
@@ -46,13 +112,17 @@ int main(int argc, char ** argv)
     arg_file * classifier = arg_filen("c", NULL, "<FILE>", 0, argc-1, "Classifier XML file");
     arg_dbl * threshold = arg_dbln("t", NULL, "<threshold>", 0, argc-1, "Threshods for classifiers");
     arg_dbl * scale = arg_dbln("s", NULL, "<scale>", 0, argc-1, "Base scale");
+    arg_str * engine = arg_str0("e", "engine", "<ENGINE>", "Detection engine (auto, haar, mblbp, rank, conv, iconv, lbp, integral, intensity; default auto)");
+    arg_int * threads = arg_int0("j", "threads", "<INT>", "Number of images processed in parallel (default 1)");
+    arg_int * decoders = arg_int0("d", "decoders", "<INT>", "Number of threads decoding images ahead (default 2)");
+    arg_lit * list = arg_lit0(NULL, "stdin", "Read file names from standard input (one per line)");
     arg_lit * help = arg_lit0("h", "help", "Display this help and exit");
-    arg_lit * draw = arg_lit0(NULL, "draw", "Output image with the detections");
+    arg_lit * draw = arg_lit0(NULL, "draw", "Output image with the detections (det-FILE)");
     arg_lit * nonms = arg_lit0(NULL, "nonms", "Do not perform non-maxima supression");
 
     struct arg_end * end = arg_end(20);
 
-    void *argtable[] = { files, classifier, threshold, scale, nonms, draw, help, end };
+    void *argtable[] = { files, classifier, threshold, scale, engine, threads, decoders, list, nonms, draw, help, end };
 
     int nerrors = arg_parse(argc, argv, argtable);
     
@@ -72,7 +142,7 @@ int main(int argc, char ** argv)
         return 1;
     }
 
-    if (files->count == 0)
+    if (files->count == 0 && list->count == 0)
     {
         fprintf(stderr, "%s: No input files\n", progname);
 		arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
@@ -80,125 +150,170 @@ int main(int argc, char ** argv)
     }
 
     //////////////////////
-    
-    TClassifier * c = 0;
 
-    if (classifier->count > 0)
+    const char * classifier_file = (classifier->count > 0) ? classifier->filename[0] : 0;
+    const float thr = (threshold->count > 0) ? threshold->dval[0] : 0.0f;
+    TClassifier * c = classifier_file ? load(classifier_file, thr, threshold->count > 0) : 0;
+
+    if (!c)
     {
-        c = loadClassifierXML(classifier->filename[0]);
+        fprintf(stderr, "%s: Invalid XML %s\n", progname, classifier_file ? classifier_file : "");
+		arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
+        return 1;
     }
 
-    if (!c) // if no classifier specified or incorrect xml is supplied, use default classifier
+    const Engine * e = select_engine((engine->count > 0) ? engine->sval[0] : "auto", c);
+    if (!e)
     {
-        fprintf(stderr, "%s: Invalid XML %s\n", progname, classifier->filename[0]);
+        fprintf(stderr, "%s: Selected engine does not support the classifier\n", progname);
+        release_classifier(&c);
+		arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
         return 1;
     }
 
-    initClassifier(c);   // Initialization of a classifier (which is defined in faces.h)
-    TRect results[MAX_DET]; // Vector for results
-    if (threshold->count > 0)
+    int pp_options = e->pp_options;
+    if (c->fsz == FSZ_4x4 && (pp_options & PP_CONV))
     {
-        c->threshold = threshold->dval[0];
+        pp_options |= PP_CONV_4x4;
     }
-    assert(c != 0);
+
     //////////////////////
 
-    float scale_factor = 1.2;
-    float base_scale = 1;
-    if (scale->count > 0)
+    const float base_scale = (scale->count > 0) ? scale->dval[0] : 1.0f;
+    const int thread_count = (threads->count > 0) ? max(threads->ival[0], 1) : 1;
+
+    init_preprocess();
+
+    // Images are decoded ahead, the window keeps a few images for each detection thread
+    const int decoder_count = (decoders->count > 0) ? max(decoders->ival[0], 1) : 2;
+    fr::ImageLoader loader(decoder_count, 4 * max(thread_count, decoder_count));
+    // Full resolution is never scanned below the base scale, JPEG files are decoded reduced
+    loader.SetMaxScale(base_scale);
+    // Each decoding thread reads a few files at once (io_uring when available)
+    loader.SetBatch(4);
+    for (int i = 0; i < files->count; i++)
     {
-        base_scale = scale->dval[0];
+        loader.Add(files->filename[i]);
     }
-    
-    // Go through files
-    for (int i = 0; i < files->count; i++)
+    if (list->count > 0)
+    {
+        loader.ReadList(cin);
+    }
+    else
     {
-        printf("%s ", files->basename[i]);
-        IplImage * gray_image = cvLoadImage(files->filename[i], 0);
+        loader.Finish();
+    }
+
+    // Lines are written in large blocks by a background thread, detection threads do not wait for stdout
+    fr::ResultWriter writer(fileno(stdout));
 
-        if (gray_image != 0)
+    // Lines finished out of order wait here, the output keeps the order of the files
+    map<unsigned long, string> pending;
+    unsigned long next_line = 0;
+    bool load_failed = false;
+
+    #pragma omp parallel num_threads(thread_count)
+    {
+        // prepare_classifier modifies the classifier so each thread has its own copy
+        TClassifier * tc = load(classifier_file, thr, threshold->count > 0);
+        if (!tc)
         {
-            CvSize baseSz = cvSize(gray_image->width / base_scale, gray_image->height / base_scale); 
-            
-            vector<IplImage*> grayFrame(0);
-            int i = 0;
-            while ((baseSz.width / pow(scale_factor, float(i)) > c->width) && (baseSz.height / pow(scale_factor, float(i)) > c->height))
+            // The other threads take the remaining images
+            #pragma omp critical
             {
-                float f = pow(scale_factor, float(i));
-                int w = int(baseSz.width/f);
-                int h = int(baseSz.height/f);
-                grayFrame.push_back(cvCreateImage(cvSize(w,h), IPL_DEPTH_8U, 1));
-                cvResize(gray_image, grayFrame[i], CV_INTER_CUBIC);
-                i++;
+                fprintf(stderr, "%s: Cannot load %s\n", progname, classifier_file);
+                load_failed = true;
             }
-            
-            ///////////////////////////////////
-            // Actual detection happens here. Source image is 'img' which points to
-            // image captured from camera. Detections are stored in 'results'.
-            
-            int total = 0;
-            for (unsigned i = 0; i < grayFrame.size(); ++i)
+        }
+
+        vector<Detection> results(MAX_DET);
+        ScanParams sp = ScanParams();
+
+        fr::LoadedImage loaded;
+        while (tc && loader.Next(loaded))
+        {
+            const string::size_type slash = loaded.File.find_last_of('/');
+            const string basename = (slash == string::npos) ? loaded.File : loaded.File.substr(slash + 1);
+
+            ostringstream out;
+            out << basename << " ";
+
+            IplImage * gray_image = loaded.Image;
+
+            if (gray_image != 0)
             {
-                TImage gray = image(grayFrame[i]);
-                
-                setClassifierImageSize(c, gray.widthStep);
-
-                int n = scanImage(&gray, c, results+total, results+MAX_DET);
-            
-                // Process the detections
-                float fx = float(gray_image->width) /  gray.width;
-                float fy = float(gray_image->height) / gray.height;
-                for (int res = total; res < total + n; ++res)
+                // The image may be decoded reduced, detections are in the coordinates of the file
+                const CvSize file_sz = loaded.Size;
+                const CvSize base_sz = align_size_2(cvSize(file_sz.width / base_scale, file_sz.height / base_scale));
+                PreprocessedPyramid * PP = create_pyramid(base_sz, cvSize(tc->width + 2, tc->height + 2), 8, 4);
+                // The loaded image is the first level when its size matches
+                insert_plane((unsigned char*)gray_image->imageData, gray_image->widthStep, cvGetSize(gray_image), PP, pp_options);
+
+                ///////////////////////////////////
+                // Actual detection happens here. Detections are stored in 'results'
+                // in coordinates of the source image.
+
+                const float f = float(file_sz.width) / PP->PI[0]->sz.width;
+                int n = detect_objects(PP, tc, &sp, e->scan, &results[0], &results[0] + MAX_DET, e->pc_options, f, 0);
+
+                if (nonms->count == 0) // perform nonmax suppression
                 {
-                    TRect * r = results + res;
-                    r->x *= fx;
-                    r->y *= fy;
-                    r->width *= fx;
-                    r->height *= fy;
-                    //printf("%d %d %d %d ", r->x, r->y, r->width, r->height);
+                    n = group_detections(&results[0], &results[0] + n, 3, 0.2f);
                 }
 
-                total += n;
-            
-            }
+                for (int j = 0; j < n; ++j)
+                {
+                    const Detection & r = results[j];
+                    out << r.x << " " << r.y << " " << r.width << " " << r.height << " ";
+                }
 
-            vector<Rect> dets(total);
-            for (int j = 0; j < dets.size(); ++j)
-            {
-                TRect & r = results[j];
-                dets[j] = Rect(r.x, r.y, r.width, r.height);
-            }
+                if (draw->count > 0) // draw detected objects and save the image
+                {
+                    const float d = float(gray_image->width) / file_sz.width;
+                    for (int j = 0; j < n; ++j)
+                    {
+                        Detection r = results[j];
+                        r.x *= d; r.y *= d; r.width *= d; r.height *= d;
+                        cvRectangle(gray_image, cvPoint(r.x,r.y), cvPoint(r.x+r.width,r.y+r.height), CV_RGB(0,0,0), 3);
+                        cvRectangle(gray_image, cvPoint(r.x,r.y), cvPoint(r.x+r.width,r.y+r.height), CV_RGB(255,255,255), 1);
+                    }
+                    cvSaveImage((string("det-") + basename).c_str(), gray_image);
+                }
 
-            if (nonms->count == 0) // perform nonmax suppression
-            {
-                groupRectangles(dets, 3);
-            }
-            
-            for (unsigned j = 0; j < dets.size(); ++j)
-            {
-                Rect r = dets[j];
-                printf("%d %d %d %d ", r.x, r.y, r.width, r.height);
-            }
+                ///////////////////////////////////
+                // destroy
+
+                release_pyramid(&PP);
+                cvReleaseImage(&gray_image);
+
+            } // in image ok
 
-            ///////////////////////////////////
-            // destroy
-            
-            cvReleaseImage(&gray_image);
-            for (unsigned i = 0; i < grayFrame.size(); ++i)
+            #pragma omp critical
             {
-                cvReleaseImage(&grayFrame[i]);
+                pending[loaded.Index] = out.str();
+                for (map<unsigned long, string>::iterator it = pending.begin();
+                     it != pending.end() && it->first == next_line; it = pending.begin())
+                {
+                    writer.Append(it->second + "\n");
+                    pending.erase(it);
+                    ++next_line;
+                }
             }
-        
-        } // in image ok
-        
-        printf("\n");
+        }
 
+        release_classifier(&tc);
     }
-    
+
+    const bool written = writer.Flush();
+    if (!written)
+    {
+        fprintf(stderr, "%s: Cannot write the results\n", progname);
+    }
+
     ///////////////////////////////////
-    releaseClassifier(&c);
+    release_classifier(&c);
+    arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
     ///////////////////////////////////
 
-    return 0;
+    return (written && !load_failed) ? 0 : 1;
 }
-
@@ -0,0 +1,337 @@
+/*
+ *  lrpcheck [-c classifier.xml files...]
+ *  Compares LRP evaluation of the libabr engines with the legacy engine
+ *  (evalLRPStageSimple of apps/detector, alpha index rankA + 10 * rankB).
+ *  Without a classifier it checks single asymmetric stages (A != B) with
+ *  alphas equal to their source index on a random image, so any difference
+ *  of the alpha layout shows as a different response.
+ *  With a classifier the engines selected by wbdetect are also compared by
+ *  their detections (scan of the image at the original scale).
+ */
+
+#include <argtable2.h>
+// OpenCV
+#include <cv.h>
+#include <cxcore.h>
+#include <highgui.h>
+// STL
+#include <stdio.h>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+// Detection engine
+#include <libabr.h>
+
+using namespace std;
+
+
+/// Engine evaluating windows one by one with its preprocessing.
+struct Engine
+{
+    const char * name;
+    ClassifierEvalFunc (*get_eval)(TClassifier * c);
+    ScanImageFunc scan;
+    int pp_options;
+    int pc_options;
+    unsigned border;
+};
+
+static const Engine engines[] = {
+    { "rank", get_eval_func_rank_bunch16, scan_image_rank_bunch16, PP_RANK_IMAGE, NONE, 0 },
+    { "conv", get_eval_func_conv_bunch16, scan_image_conv_bunch16, PP_CONV_IMAGE, RECALC_RANKS, 0 },
+    { "iconv", get_eval_func_iconv, scan_image_iconv, PP_ICONV_IMAGE, RECALC_RANKS, 1 },
+    { "integral", get_eval_func_integral, scan_image_integral, PP_INTEGRAL_IMAGE, RECALC_OFFSET | OFFSET_INTEGRAL, 1 },
+    { "intensity", get_eval_func_intensity, scan_image_intensity, PP_COPY_IMAGE, RECALC_OFFSET, 1 },
+};
+
+static const int engine_count = sizeof(engines) / sizeof(engines[0]);
+
+
+/// Response of an LRP stage as in the legacy engine (evalLRPStageSimple).
+static float legacy_lrp_stage(const IplImage * img, int x, int y, const TStage & stg, const float * alpha)
+{
+    int values[9] = {0,0,0,0,0,0,0,0,0};
+    for (int v = 0; v < stg.h * 3; ++v)
+    {
+        const unsigned char * row = (unsigned char*)img->imageData + (y + stg.y + v) * img->widthStep + x + stg.x;
+        for (int u = 0; u < stg.w * 3; ++u)
+        {
+            values[3 * (v / stg.h) + u / stg.w] += row[u];
+        }
+    }
+
+    int countA = 0;
+    int countB = 0;
+    for (int i = 0; i < 9; ++i)
+    {
+        if (values[int(stg.A)] > values[i]) ++countA;
+        if (values[int(stg.B)] > values[i]) ++countB;
+    }
+
+    return alpha[countA + 10 * countB];
+}
+
+/// Classifier response as in the legacy engine (evalLRDClassifier), returns the number of evaluated stages.
+static int legacy_lrp(const IplImage * img, const TClassifier * c, int x, int y, float * response)
+{
+    *response = 0.0f;
+    for (unsigned s = 0; s < c->stage_count; ++s)
+    {
+        *response += legacy_lrp_stage(img, x, y, c->stage[s], c->alpha + s * c->alpha_count);
+        if (*response < c->stage[s].theta_b)
+        {
+            return s + 1;
+        }
+    }
+    return c->stage_count;
+}
+
+/// Single stage LRP classifier, alpha of each source index is the index itself.
+static TClassifier * create_stage_classifier(int x, int y, int w, int h, int A, int B)
+{
+    TClassifier * c = new TClassifier();
+    c->tp = LRP;
+    c->model = C_DYNAMIC;
+    c->fsz = FSZ_2x2;
+    c->stage_count = 1;
+    c->alpha_count = 100;
+    c->threshold = -FLT_MAX;
+    c->width = c->height = 24;
+
+    const TStage stage = {x, y, w, h, char(A), char(B), -FLT_MAX, 0, 0, 0, 0, 0.0f, 0.0f};
+    c->stage = new TStage[1];
+    c->stage[0] = stage;
+    c->alpha = new float[c->alpha_count];
+    for (unsigned i = 0; i < c->alpha_count; ++i)
+    {
+        c->alpha[i] = float(i);
+    }
+    c->ranks = new int[8];
+    fill(c->ranks, c->ranks + 8, 0);
+
+    init_classifier(c);
+    return c;
+}
+
+/// Windows where the engine and the legacy engine differ (in stages or in response).
+/// \param windows Receives the number of compared windows
+/// \param detections Receives the number of windows detected by only one of the engines
+static int compare(const Engine & e, IplImage * img, TClassifier * c, int * windows, int * detections)
+{
+    *windows = 0;
+    *detections = 0;
+
+    ClassifierEvalFunc eval = e.get_eval(c);
+    if (!eval)
+    {
+        return -1;
+    }
+
+    PreprocessedImage * PI = create_preprocessed_image(cvGetSize(img));
+    preprocess_image(img, PI, e.pp_options);
+    prepare_classifier(c, PI, e.pc_options);
+    response_map(PI, c, eval, e.border);
+
+    int differ = 0;
+    for (int y = 0; y < PI->sz.height; ++y)
+    {
+        const float * response = (float*)(PI->response.imageData + y * PI->response.widthStep);
+        const unsigned short * stages = (unsigned short*)(PI->stage_map.imageData + y * PI->stage_map.widthStep);
+        for (int x = 0; x < PI->sz.width; ++x)
+        {
+            if (response[x] == -FLT_MAX)
+            {
+                continue; // Not evaluated by the engine
+            }
+            ++*windows;
+
+            float r;
+            const int n = legacy_lrp(img, c, x, y, &r);
+            const bool detected = n == int(c->stage_count) && r > c->threshold;
+            const bool engine_detected = stages[x] == int(c->stage_count) && response[x] > c->threshold;
+            if (n != stages[x] || fabsf(r - response[x]) > 1e-3f * max(1.0f, fabsf(r)))
+            {
+                ++differ;
+            }
+            if (detected != engine_detected)
+            {
+                ++*detections;
+            }
+        }
+    }
+
+    release_preprocessed_image(&PI);
+    return differ;
+}
+
+/// Detections of the engine scan which differ from the legacy engine.
+/// \param extra Receives the number of detections not found by the legacy engine
+/// \returns Number of legacy detections missing in the scan
+static int compare_scan(const Engine & e, IplImage * img, TClassifier * c, int * extra)
+{
+    *extra = 0;
+
+    const int x_end = img->width - int(c->width) - int(e.border);
+    const int y_end = img->height - int(c->height) - int(e.border);
+    if (x_end <= int(e.border) || y_end <= int(e.border))
+    {
+        return 0;
+    }
+
+    PreprocessedImage * PI = create_preprocessed_image(cvGetSize(img));
+    preprocess_image(img, PI, e.pp_options);
+    prepare_classifier(c, PI, e.pc_options);
+
+    ScanParams sp = ScanParams();
+    sp.step_x = sp.step_y = 1;
+    vector<Detection> detections(img->width * img->height);
+    const int n = e.scan(PI, c, &sp, &detections[0], &detections[0] + detections.size(), 0);
+    release_preprocessed_image(&PI);
+
+    vector<bool> found(img->width * img->height, false);
+    for (int i = 0; i < n; ++i)
+    {
+        const Detection & d = detections[i];
+        float r;
+        if (legacy_lrp(img, c, d.x, d.y, &r) != int(c->stage_count) || !(r > c->threshold))
+        {
+            ++*extra;
+        }
+        found[d.y * img->width + d.x] = true;
+    }
+
+    int missing = 0;
+    for (int y = e.border; y < y_end; ++y)
+    {
+        for (int x = e.border; x < x_end; ++x)
+        {
+            float r;
+            if (legacy_lrp(img, c, x, y, &r) == int(c->stage_count) && r > c->threshold && !found[y * img->width + x])
+            {
+                ++missing;
+            }
+        }
+    }
+    return missing;
+}
+
+int main(int argc, char ** argv)
+{
+    // Process arguments
+    const char * progname = "lrpcheck";
+    arg_file * classifier = arg_file0("c", NULL, "FILE", "LRP classifier compared on the input files (random stages without it)");
+    arg_file * files = arg_filen(NULL, NULL, NULL, 0, argc+2, "Input files");
+    arg_lit * help = arg_lit0("h", "help", "Display this help and exit");
+    struct arg_end * end = arg_end(20);
+
+    void *argtable[] = { help, classifier, files, end };
+
+    int nerrors = arg_parse(argc, argv, argtable);
+
+    if(help->count > 0)
+    {
+        fprintf(stderr, "Usage: %s", progname);
+        arg_print_syntax(stderr, argtable, "\n\n");
+        arg_print_glossary(stderr, argtable, "  %-30s %s\n");
+		arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
+        return 1;
+    }
+    if (nerrors > 0)
+    {
+        arg_print_errors(stderr, end, progname);
+        fprintf(stderr, "Try '%s --help' for more information.\n", progname);
+		arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
+        return 1;
+    }
+
+    init_preprocess();
+
+    int failed = 0;
+
+    if (classifier->count == 0)
+    {
+        // 1x1 blocks are the same in all planes, so the responses must match exactly
+        IplImage * img = cvCreateImage(cvSize(64, 48), IPL_DEPTH_8U, 1);
+        unsigned seed = 0x1234;
+        for (int y = 0; y < img->height; ++y)
+        {
+            unsigned char * row = (unsigned char*)img->imageData + y * img->widthStep;
+            for (int x = 0; x < img->width; ++x)
+            {
+                seed = seed * 1103515245 + 12345;
+                row[x] = (seed >> 16) & 0xFF;
+            }
+        }
+
+        for (int A = 0; A < 9; ++A)
+        {
+            for (int B = 0; B < 9; ++B)
+            {
+                if (A == B)
+                {
+                    continue;
+                }
+                TClassifier * c = create_stage_classifier(A + 1, 2 * B + 1, 1, 1, A, B);
+                for (int i = 0; i < engine_count; ++i)
+                {
+                    int windows, detections;
+                    const int differ = compare(engines[i], img, c, &windows, &detections);
+                    if (differ != 0)
+                    {
+                        printf("%s: stage A=%d B=%d differs in %d of %d windows\n", engines[i].name, A, B, differ, windows);
+                        ++failed;
+                    }
+                }
+                release_classifier(&c);
+            }
+        }
+
+        cvReleaseImage(&img);
+        printf("%s\n", failed ? "FAILED" : "OK");
+    }
+    else
+    {
+        TClassifier * c = load_classifier_XML(classifier->filename[0]);
+        if (!c || c->tp != LRP)
+        {
+            fprintf(stderr, "%s: %s is not an LRP classifier\n", progname, classifier->filename[0]);
+            release_classifier(&c);
+            arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
+            return 1;
+        }
+        init_classifier(c);
+
+        // Block means of the convolution planes are rounded, so a few windows may differ on ties
+        printf("file engine windows differ detections missing extra\n");
+        for (int f = 0; f < files->count; ++f)
+        {
+            IplImage * img = cvLoadImage(files->filename[f], CV_LOAD_IMAGE_GRAYSCALE);
+            if (!img)
+            {
+                fprintf(stderr, "%s: Cannot load %s\n", progname, files->filename[f]);
+                continue;
+            }
+            for (int i = 0; i < engine_count; ++i)
+            {
+                int windows, detections;
+                const int differ = compare(engines[i], img, c, &windows, &detections);
+                if (differ < 0)
+                {
+                    continue; // Classifier not supported by the engine
+                }
+                int extra;
+                const int missing = compare_scan(engines[i], img, c, &extra);
+                printf("%s %s %d %d %d %d %d\n", files->filename[f], engines[i].name, windows, differ, detections, missing, extra);
+                failed += detections + missing + extra;
+            }
+            cvReleaseImage(&img);
+        }
+
+        release_classifier(&c);
+    }
+
+    arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,361 @@
+/*
+ *  oppoints -c classifier.xml -a annotations.txt
+ *  Speed/accuracy operating points of a WaldBoost classifier.
+ *
+ *  The classifier is evaluated once on all windows of the annotated images.
+ *  For each window the prefix minima of margins (response - theta_b) are
+ *  recorded, windows matching an annotated object keep the full response
+ *  trajectory. Threshold offsets and truncation points are then evaluated
+ *  analytically from these records. Time is estimated from a plain scan
+ *  with the reference engine scaled by the number of evaluated stages.
+ *
+ *  Annotation file has one image per line (the format of wbdetect output):
+ *  file x y w h x y w h ...
+ */
+
+#include <argtable2.h>
+// OpenCV
+#include <cv.h>
+#include <cxcore.h>
+#include <highgui.h>
+// STL
+#include <stdio.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+// Detection engine
+#include <libabr.h>
+
+using namespace std;
+
+
+#define N (10000)
+
+int align2(int x)
+{
+    return (x + 1) & ~1;
+}
+
+CvSize align_size_2(CvSize sz)
+{
+    return cvSize(align2(sz.width), align2(sz.height));
+}
+
+/// New prefix minimum of margin found at a stage
+struct MarginRecord
+{
+    unsigned short stage;
+    float margin;
+};
+
+/// Compact trace of a single window
+struct WindowTrace
+{
+    unsigned first;        ///< Index of the first margin record
+    unsigned short count;  ///< Number of margin records
+    unsigned short stages; ///< Number of evaluated stages
+    int object;            ///< Index of matching annotated object or -1
+    unsigned trajectory;   ///< Index of full trajectory (only for matching windows)
+    bool accepted;         ///< Final decision of the original classifier
+};
+
+struct Annotation
+{
+    string file;
+    vector<CvRect> objects;
+};
+
+static vector<Annotation> load_annotations(const char * filename)
+{
+    vector<Annotation> res;
+    ifstream in(filename);
+    string line;
+    while (getline(in, line))
+    {
+        istringstream str(line);
+        Annotation a;
+        if (!(str >> a.file))
+            continue;
+        CvRect r;
+        while (str >> r.x >> r.y >> r.width >> r.height)
+        {
+            a.objects.push_back(r);
+        }
+        res.push_back(a);
+    }
+    return res;
+}
+
+static float overlap(const CvRect & a, const CvRect & b)
+{
+    int x0 = max(a.x, b.x), y0 = max(a.y, b.y);
+    int x1 = min(a.x + a.width, b.x + b.width), y1 = min(a.y + a.height, b.y + b.height);
+    if (x1 <= x0 || y1 <= y0)
+        return 0.0f;
+    float i = float(x1 - x0) * (y1 - y0);
+    return i / (float(a.width) * a.height + float(b.width) * b.height - i);
+}
+
+static bool is_negative(float x)
+{
+    return x < 0.0f;
+}
+
+/// Parse comma separated list of numbers
+static vector<float> parse_list(const char * s)
+{
+    vector<float> res;
+    istringstream str(s);
+    float v;
+    char sep;
+    while (str >> v)
+    {
+        res.push_back(v);
+        str >> sep;
+    }
+    return res;
+}
+
+int main(int argc, char ** argv)
+{
+    // Process arguments
+    const char * progname = "oppoints";
+    arg_file * classifier = arg_file1("c", NULL, "FILE", "The XML file with classifier");
+    arg_file * annotations = arg_file1("a", NULL, "FILE", "Annotated images (file x y w h ...)");
+    arg_str * offsets = arg_str0(NULL, "offsets", "LIST", "Non-negative threshold offsets to evaluate (default 0,0.1,0.2,0.5,1)");
+    arg_str * truncate = arg_str0(NULL, "truncate", "LIST", "Stage counts to evaluate (default all multiples of 16)");
+    arg_dbl * min_overlap = arg_dbl0(NULL, "overlap", "F", "Minimal overlap of a detection with an object (default 0.5)");
+    arg_lit * help = arg_lit0("h", "help", "Display this help and exit");
+    struct arg_end * end = arg_end(20);
+
+    void *argtable[] = { help, classifier, annotations, offsets, truncate, min_overlap, end };
+
+    int nerrors = arg_parse(argc, argv, argtable);
+
+    if(help->count > 0)
+    {
+        fprintf(stderr, "Usage: %s", progname);
+        arg_print_syntax(stderr, argtable, "\n\n");
+        arg_print_glossary(stderr, argtable, "  %-30s %s\n");
+		arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
+        return 1;
+    }
+    if (nerrors > 0)
+    {
+        arg_print_errors(stderr, end, progname);
+        fprintf(stderr, "Try '%s --help' for more information.\n", progname);
+		arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
+        return 1;
+    }
+
+    TClassifier * c = load_classifier_XML(classifier->filename[0]);
+
+    if (c == 0)
+    {
+        cerr << progname << ": Cannot load classifier" << endl;
+        return -1;
+    }
+
+    init_classifier(c); // The reference engine does not need 2x2 features
+
+    ClassifierEvalFunc eval = get_eval_func_intensity(c);
+    if (!eval)
+    {
+        cerr << progname << ": Unsupported classifier" << endl;
+        return -1;
+    }
+
+    vector<Annotation> images = load_annotations(annotations->filename[0]);
+    vector<float> offset_list = parse_list((offsets->count > 0) ? offsets->sval[0] : "0,0.1,0.2,0.5,1");
+    // Only tightening can be evaluated from the records
+    offset_list.erase(remove_if(offset_list.begin(), offset_list.end(), is_negative), offset_list.end());
+    vector<float> truncate_list;
+    if (truncate->count > 0)
+    {
+        truncate_list = parse_list(truncate->sval[0]);
+    }
+    else
+    {
+        for (unsigned t = 16; t < c->stage_count; t += 16)
+            truncate_list.push_back(t);
+    }
+    truncate_list.push_back(c->stage_count);
+    const float overlap_thr = (min_overlap->count > 0) ? min_overlap->dval[0] : 0.5f;
+
+    init_preprocess();
+
+    vector<WindowTrace> windows;
+    vector<MarginRecord> records;
+    vector<float> trajectories;
+    unsigned total_objects = 0;
+    int64 scan_ticks = 0;
+    unsigned scanned_images = 0;
+
+    vector<int> features(c->stage_count);
+    vector<float> hypotheses(c->stage_count);
+
+    // Evaluate the classifier once and record the traces
+    for (unsigned i = 0; i < images.size(); ++i)
+    {
+        IplImage * src = cvLoadImage(images[i].file.c_str(), CV_LOAD_IMAGE_GRAYSCALE);
+        if (!src)
+        {
+            cerr << progname << ": Cannot read " << images[i].file << endl;
+            continue;
+        }
+
+        PreprocessedPyramid * PP = create_pyramid(align_size_2(cvGetSize(src)), cvSize(c->width+2, c->height+2), 8, 4);
+        insert_image(src, PP, PP_COPY_IMAGE);
+
+        const CvSize base_sz = PP->PI[0]->sz;
+        const int object_base = total_objects;
+        total_objects += images[i].objects.size();
+
+        // Calibrate wall-clock time on a plain scan with the same engine
+        {
+            static Detection results[N];
+            ScanParams sp = ScanParams();
+            int64 t0 = cvGetTickCount();
+            detect_objects(PP, c, &sp, scan_image_intensity, results, results+N, RECALC_OFFSET, 1, 0);
+            scan_ticks += cvGetTickCount() - t0;
+            ++scanned_images;
+        }
+
+        for (unsigned l = 0; l < PP->PI.size(); ++l)
+        {
+            PreprocessedImage * PI = PP->PI[l];
+            prepare_classifier(c, PI, RECALC_OFFSET);
+            const float sx = float(base_sz.width) / PI->sz.width;
+            const float sy = float(base_sz.height) / PI->sz.height;
+
+            for (int y = 1; y < PI->sz.height - int(c->height) - 1; ++y)
+            {
+                for (int x = 1; x < PI->sz.width - int(c->width) - 1; ++x)
+                {
+                    float response = 0.0f;
+                    int stages = 0;
+                    int d = eval(PI, c, x, y, 0, c->stage_count, &features[0], &hypotheses[0], &response, &stages);
+
+                    WindowTrace w;
+                    w.first = records.size();
+                    w.stages = stages;
+                    w.accepted = d && (response > c->threshold);
+                    w.object = -1;
+                    w.trajectory = 0;
+
+                    float r = 0.0f;
+                    float min_margin = 1e30f;
+                    for (int s = 0; s < stages; ++s)
+                    {
+                        r += hypotheses[s];
+                        float m = r - c->stage[s].theta_b;
+                        if (m < min_margin)
+                        {
+                            MarginRecord rec = { (unsigned short)s, m };
+                            records.push_back(rec);
+                            min_margin = m;
+                        }
+                    }
+                    w.count = records.size() - w.first;
+
+                    CvRect win = cvRect(x * sx, y * sy, c->width * sx, c->height * sy);
+                    for (unsigned o = 0; o < images[i].objects.size(); ++o)
+                    {
+                        if (overlap(win, images[i].objects[o]) >= overlap_thr)
+                        {
+                            w.object = object_base + o;
+                            w.trajectory = trajectories.size();
+                            r = 0.0f;
+                            for (int s = 0; s < stages; ++s)
+                            {
+                                r += hypotheses[s];
+                                trajectories.push_back(r);
+                            }
+                            break;
+                        }
+                    }
+
+                    windows.push_back(w);
+                }
+            }
+        }
+
+        release_pyramid(&PP);
+        cvReleaseImage(&src);
+    }
+
+    if (windows.empty())
+    {
+        cerr << progname << ": No windows evaluated" << endl;
+        return -1;
+    }
+
+    unsigned long base_stages = 0;
+    for (unsigned w = 0; w < windows.size(); ++w)
+    {
+        base_stages += windows[w].stages;
+    }
+    // Images which cannot be read are not scanned
+    const double ms_per_image = scan_ticks / (cvGetTickFrequency() * 1000.0) / scanned_images;
+
+    // Sweep offsets and truncation points
+    cout << "# offset, stages, stages_per_window, est_ms_per_image, recall, detections" << endl;
+
+    for (unsigned oi = 0; oi < offset_list.size(); ++oi)
+    {
+        const float delta = offset_list[oi];
+        for (unsigned ti = 0; ti < truncate_list.size(); ++ti)
+        {
+            const unsigned T = min<unsigned>(truncate_list[ti], c->stage_count);
+            unsigned long stages = 0;
+            unsigned long detections = 0;
+            vector<bool> found(total_objects, false);
+
+            for (unsigned wi = 0; wi < windows.size(); ++wi)
+            {
+                const WindowTrace & w = windows[wi];
+
+                // First stage failing the tightened threshold - it is always a new prefix minimum
+                unsigned fail = c->stage_count;
+                for (const MarginRecord * r = &records[w.first]; r != &records[w.first] + w.count; ++r)
+                {
+                    if (r->margin < delta)
+                    {
+                        fail = r->stage;
+                        break;
+                    }
+                }
+                stages += min(min(fail + 1, unsigned(w.stages)), T);
+
+                // Window passes all T stages only if it does not fail any of them
+                if (fail >= T)
+                {
+                    if (T == c->stage_count && w.accepted)
+                    {
+                        ++detections;
+                    }
+                    if (w.object >= 0 && (T < c->stage_count || w.accepted) && trajectories[w.trajectory + T - 1] > c->threshold)
+                    {
+                        found[w.object] = true;
+                    }
+                }
+            }
+
+            const unsigned recalled = count(found.begin(), found.end(), true);
+            cout << delta << "," << T << ",";
+            cout << double(stages) / windows.size() << ",";
+            cout << ms_per_image * double(stages) / base_stages << ",";
+            cout << (total_objects ? double(recalled) / total_objects : 0.0) << ",";
+            if (T == c->stage_count)
+                cout << detections;
+            cout << endl;
+        }
+    }
+
+    release_classifier(&c);
+
+    return 0;
+}
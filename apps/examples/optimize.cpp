@@ -0,0 +1,198 @@
+/*
+ *  optimize -c classifier.xml -o optimized.xml files...
+ *  Reorders stages of a classifier for the bunch16 engines and reports
+ *  predicted and measured speed-up on the sample images.
+ */
+
+#include <argtable2.h>
+// OpenCV
+#include <cv.h>
+#include <cxcore.h>
+#include <highgui.h>
+// STL
+#include <stdio.h>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+// Detection engine
+#include <libabr.h>
+
+using namespace std;
+
+
+#define N (10000)
+
+int align2(int x)
+{
+    return (x + 1) & ~1;
+}
+
+CvSize align_size_2(CvSize sz)
+{
+    return cvSize(align2(sz.width), align2(sz.height));
+}
+
+bool operator<(const Detection & a, const Detection & b)
+{
+    if (a.y != b.y) return a.y < b.y;
+    if (a.x != b.x) return a.x < b.x;
+    if (a.height != b.height) return a.height < b.height;
+    return a.width < b.width;
+}
+
+/// Run bunch16 detection on the pyramid, return time in ticks and store detections.
+int64 measure(PreprocessedPyramid * PP, TClassifier * c, vector<Detection> & dets)
+{
+    static Detection results[N];
+    ScanParams sp = ScanParams();
+    int64 t0 = cvGetTickCount();
+    int n = detect_objects(PP, c, &sp, scan_image_conv_bunch16, results, results+N, RECALC_RANKS, 1, 0);
+    int64 t1 = cvGetTickCount();
+    dets.assign(results, results+n);
+    sort(dets.begin(), dets.end());
+    return t1 - t0;
+}
+
+int main(int argc, char ** argv)
+{
+    // Process arguments
+    const char * progname = "optimize";
+    arg_file * classifier = arg_file1("c", NULL, "FILE", "The XML file with classifier");
+    arg_file * output = arg_file1("o", NULL, "FILE", "Output XML file with optimized classifier");
+    arg_int * group = arg_int0("g", "group", "N", "Size of groups within which stages can move (multiple of 16, default 32)");
+    arg_dbl * plane_cost = arg_dbl0(NULL, "plane-cost", "F", "Cost of a plane touched by a bunch relative to the bunch (default 0.25)");
+    arg_file * files = arg_filen(NULL, NULL, NULL, 0, argc+2, "Sample images");
+    arg_lit * help = arg_lit0("h", "help", "Display this help and exit");
+    struct arg_end * end = arg_end(20);
+
+    void *argtable[] = { help, classifier, output, group, plane_cost, files, end };
+
+    int nerrors = arg_parse(argc, argv, argtable);
+
+    if(help->count > 0)
+    {
+        fprintf(stderr, "Usage: %s", progname);
+        arg_print_syntax(stderr, argtable, "\n\n");
+        arg_print_glossary(stderr, argtable, "  %-30s %s\n");
+		arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
+        return 1;
+    }
+    if (nerrors > 0)
+    {
+        arg_print_errors(stderr, end, progname);
+        fprintf(stderr, "Try '%s --help' for more information.\n", progname);
+		arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
+        return 1;
+    }
+
+    if (files->count == 0)
+    {
+        cerr << progname << ": No input files" << endl;
+        return -1;
+    }
+
+    ReorderParams params;
+    params.group_size = (group->count > 0) ? group->ival[0] : 32;
+    params.bunch_cost = 1.0f;
+    params.plane_cost = (plane_cost->count > 0) ? plane_cost->dval[0] : 0.25f;
+
+    if (params.group_size == 0 || params.group_size % BUNCH_SIZE != 0)
+    {
+        cerr << progname << ": Group size must be a multiple of " << BUNCH_SIZE << endl;
+        return -1;
+    }
+
+    TClassifier * c = load_classifier_XML(classifier->filename[0]);
+
+    if (c == 0 || !init_classifier(c) || !is_classifier_supported_conv_bunch16(c))
+    {
+        cerr << progname << ": Classifier is not supported by bunch16 engine" << endl;
+        return -1;
+    }
+
+    init_preprocess();
+
+    // Replay the classifier on samples and collect stage statistics
+    StageStatistics * st = create_stage_statistics(c);
+
+    for (int i = 0; i < files->count; ++i)
+    {
+        IplImage * src = cvLoadImage(files->filename[i], CV_LOAD_IMAGE_GRAYSCALE);
+        if (!src)
+        {
+            cerr << progname << ": Cannot read " << files->filename[i] << endl;
+            continue;
+        }
+
+        PreprocessedPyramid * PP = create_pyramid(align_size_2(cvGetSize(src)), cvSize(c->width+2, c->height+2), 8, 4);
+        insert_image(src, PP, PP_COPY_IMAGE);
+        for (unsigned l = 0; l < PP->PI.size(); ++l)
+        {
+            collect_stage_statistics(PP->PI[l], c, st);
+        }
+
+        release_pyramid(&PP);
+        cvReleaseImage(&src);
+    }
+
+    vector<unsigned> order(c->stage_count);
+    int groups = reorder_stages(c, st, &params, &order[0]);
+
+    TClassifier * nc = apply_stage_order(c, &order[0], params.group_size);
+    init_classifier(nc);
+
+    float cost_orig = predict_bunch16_cost(c, st, &params, 0);
+    float cost_new = predict_bunch16_cost(c, st, &params, &order[0]);
+
+    // Measure both classifiers on the samples
+    int64 ticks_orig = 0, ticks_new = 0;
+    unsigned long dets_orig = 0, dets_new = 0, dets_lost = 0, dets_added = 0;
+
+    for (int i = 0; i < files->count; ++i)
+    {
+        IplImage * src = cvLoadImage(files->filename[i], CV_LOAD_IMAGE_GRAYSCALE);
+        if (!src)
+        {
+            continue;
+        }
+
+        PreprocessedPyramid * PP = create_pyramid(align_size_2(cvGetSize(src)), cvSize(c->width+2, c->height+2), 8, 4);
+        insert_image(src, PP, (c->fsz == FSZ_4x4) ? PP_CONV_4x4_IMAGE : PP_CONV_IMAGE);
+
+        vector<Detection> a, b, diff;
+        ticks_orig += measure(PP, c, a);
+        ticks_new += measure(PP, nc, b);
+
+        dets_orig += a.size();
+        dets_new += b.size();
+        set_difference(a.begin(), a.end(), b.begin(), b.end(), back_inserter(diff));
+        dets_lost += diff.size();
+        diff.clear();
+        set_difference(b.begin(), b.end(), a.begin(), a.end(), back_inserter(diff));
+        dets_added += diff.size();
+
+        release_pyramid(&PP);
+        cvReleaseImage(&src);
+    }
+
+    // Report
+    double f = cvGetTickFrequency() * 1000.0;
+    cout << "# windows, stages, group_size, reordered_groups" << endl;
+    cout << st->windows << "," << c->stage_count << "," << params.group_size << "," << groups << endl;
+    cout << "# predicted_cost_orig, predicted_cost_new, predicted_speedup" << endl;
+    cout << cost_orig << "," << cost_new << "," << cost_orig / cost_new << endl;
+    cout << "# measured_ms_orig, measured_ms_new, measured_speedup" << endl;
+    cout << ticks_orig / f << "," << ticks_new / f << "," << double(ticks_orig) / ticks_new << endl;
+    cout << "# detections_orig, detections_new, lost, added" << endl;
+    cout << dets_orig << "," << dets_new << "," << dets_lost << "," << dets_added << endl;
+
+    ofstream out(output->filename[0]);
+    export_classifier_XML(nc, out, output->basename[0]);
+
+    release_stage_statistics(&st);
+    release_classifier(&nc);
+    release_classifier(&c);
+
+    return 0;
+}
@@ -71,15 +71,16 @@ int main(int argc, char ** argv)
     const char * progname = "process_image";
     arg_file * files = arg_filen(NULL, NULL, "FILE", 0, argc-1, "Input files");
     arg_str * output = arg_str0("o", NULL, "<PREFIX>", "Save output (prefix will be added to the filename)");
-    arg_str * engine = arg_str0("e", "engine", "<ENGINE>", "Detection engine to use (itensity, integral, conv, iconv, lbp)");
+    arg_str * engine = arg_str0("e", "engine", "<ENGINE>", "Detection engine to use (itensity, integral, conv, rank, iconv, lbp, mblbp, haar, conv-q, iconv-q)");
     arg_file * classifier = arg_file1("c", NULL, "<FILE>", "Classifier to use");
     arg_int * repeat = arg_int0("t", NULL, "<INT>", "Repeat preprocessing and detection specified number of times");
     arg_int * div_point = arg_int0("u", NULL, "<INT>", "Division point for iconv-conv engine");
     arg_lit * det = arg_lit0("d", NULL, "Output detections");
+    arg_lit * validate = arg_lit0(NULL, "validate", "Compare detections of quantised engine with the float engine");
     arg_lit * help = arg_lit0("h", "help", "Display this help and exit");
     struct arg_end * end = arg_end(20);
 
-    void *argtable[] = { help, repeat, classifier, engine, det, div_point, output, files, end };
+    void *argtable[] = { help, repeat, classifier, engine, det, validate, div_point, output, files, end };
 
     int nerrors = arg_parse(argc, argv, argtable);
     
@@ -120,6 +121,7 @@ int main(int argc, char ** argv)
     
     // Select engine and preprocessing options
     ScanImageFunc scan = 0;
+    ScanImageFunc float_scan = 0; // float counterpart of quantised engine
     int pp_opts = 0;
     int pc_opts = 0;
 
@@ -140,9 +142,15 @@ int main(int argc, char ** argv)
         if (string(engine->sval[0]) == "conv")
         {
             scan = scan_image_conv_bunch16;
-            pp_opts = PP_CONV_IMAGE;
+            pp_opts = (c->fsz == FSZ_4x4) ? PP_CONV_4x4_IMAGE : PP_CONV_IMAGE;
             pc_opts = RECALC_RANKS;
         }
+        if (string(engine->sval[0]) == "rank")
+        {
+            scan = scan_image_rank_bunch16;
+            pp_opts = (c->fsz == FSZ_4x4) ? (PP_RANK_IMAGE | PP_CONV_4x4) : PP_RANK_IMAGE;
+            pc_opts = NONE;
+        }
         if (string(engine->sval[0]) == "iconv")
         {
             scan = scan_image_iconv;
@@ -155,12 +163,52 @@ int main(int argc, char ** argv)
             pp_opts = PP_LBP_IMAGE;
             pc_opts = NONE;
         }
+        if (string(engine->sval[0]) == "mblbp")
+        {
+            scan = scan_image_mblbp;
+            pp_opts = PP_INTEGRAL_IMAGE;
+            pc_opts = RECALC_OFFSET | OFFSET_INTEGRAL;
+        }
+        if (string(engine->sval[0]) == "haar")
+        {
+            scan = scan_image_haar;
+            pp_opts = PP_HAAR_IMAGE;
+            pc_opts = RECALC_OFFSET | OFFSET_INTEGRAL;
+        }
         if (string(engine->sval[0]) == "iconv-conv")
         {
             scan = scan_image_iconv_conv;
             pp_opts = PP_ICONV_IMAGE; // implies PP_CONV and PP_ICONV
             pc_opts = RECALC_RANKS;
         }
+        if (string(engine->sval[0]) == "conv-q" && quantise_classifier(c))
+        {
+            scan = scan_image_conv_bunch16_q;
+            float_scan = scan_image_conv_bunch16;
+            pp_opts = PP_CONV_IMAGE;
+            pc_opts = RECALC_RANKS; // only for validation
+        }
+        if (string(engine->sval[0]) == "iconv-q" && quantise_classifier(c))
+        {
+            scan = scan_image_iconv_q;
+            float_scan = scan_image_iconv;
+            pp_opts = PP_ICONV_IMAGE;
+            pc_opts = RECALC_RANKS; // only for validation
+        }
+    }
+
+    if (engine->count > 0 && (string(engine->sval[0]) == "conv-q" || string(engine->sval[0]) == "iconv-q") && !c->quant)
+    {
+        fprintf(stderr, "%s: Classifier cannot be quantised (FSZ_2x2 LRD, LRP or LBP needed)\n", progname);
+		arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
+        return 1;
+    }
+
+    if (validate->count > 0 && float_scan == 0)
+    {
+        fprintf(stderr, "%s: Validation needs quantised engine\n", progname);
+		arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
+        return 1;
     }
 
     if (scan == 0)
@@ -178,6 +226,7 @@ int main(int argc, char ** argv)
     Detection results[10000];
     ScanParams sp;
     sp.division_a = (div_point->count > 0) ? div_point->ival[0] : 16;
+    QuantValidation qv = {0, 0, 0, 0};
 
     for (int i = 0; i < files->count; ++i)
     {
@@ -235,10 +284,21 @@ int main(int argc, char ** argv)
             cvSaveImage(out_file, src);
         }
 
+        if (validate->count > 0)
+        {
+            validate_quant_scan(pp, c, &sp, float_scan, scan, &qv);
+        }
+
         release_preprocessed_image(&pp);
         cvReleaseImage(&src);
     }
 
+    if (validate->count > 0)
+    {
+        fprintf(stderr, "%s: float detections %lu, quantised detections %lu, lost %lu, added %lu\n",
+                progname, qv.float_detections, qv.quant_detections, qv.lost, qv.added);
+    }
+
     release_classifier(&c);
 }
 
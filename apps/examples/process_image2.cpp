@@ -29,6 +29,7 @@
 #include <iostream>
 #include <list>
 #include <string>
+#include <vector>
 
 #include <libgen.h>
 
@@ -65,14 +66,17 @@ int main(int argc, char ** argv)
     const char * progname = "process_image2";
     arg_file * files = arg_filen(NULL, NULL, "FILE", 0, argc-1, "Input files");
     arg_str * output = arg_str0("o", NULL, "<PREFIX>", "Save output (prefix will be added to the filename)");
-    arg_str * engine = arg_str0("e", "engine", "<ENGINE>", "Detection engine to use (itensity, integral, conv, iconv, lbp)");
-    arg_file * classifier = arg_file1("c", NULL, "<FILE>", "Classifier to use");
+    arg_str * engine = arg_str0("e", "engine", "<ENGINE>", "Detection engine to use (itensity, integral, conv, iconv, lbp, haar)");
+    arg_file * classifier = arg_filen("c", NULL, "<FILE>", 1, 16, "Classifier to use (more classifiers of different window sizes are used as a family)");
+    arg_int * levels = arg_int0("l", "levels", "<INT>", "Pyramid levels per octave (default 4, 1 for a family)");
+    arg_int * tile = arg_int0(NULL, "tile", "<INT>", "Scan large images in tiles of the given size (single classifier only)");
+    arg_str * roi = arg_strn(NULL, "roi", "<X,Y,W,H>", 0, 64, "Scan only the region of interest (single classifier only, can be repeated)");
     arg_lit * det = arg_lit0("d", NULL, "Output detections");
     arg_lit * help = arg_lit0("h", "help", "Display this help and exit");
     arg_dbl * thr = arg_dbl0("t", "threshold", "<FLOAT>", "Detection threshold");
     struct arg_end * end = arg_end(20);
 
-    void *argtable[] = { help, classifier, engine, det, thr, output, files, end };
+    void *argtable[] = { help, classifier, levels, tile, roi, engine, det, thr, output, files, end };
 
     int nerrors = arg_parse(argc, argv, argtable);
     
@@ -99,19 +103,26 @@ int main(int argc, char ** argv)
         return 1;
     }
 
-    // Load classifier
-    TClassifier * c = load_classifier_XML(classifier->filename[0]);
+    // Load classifier or family of classifiers
+    ClassifierFamily * family = load_classifier_family(classifier->filename, classifier->count);
 
-    if (!c)
+    if (!family)
     {
         fprintf(stderr, "%s: Cannot load classifier '%s'\n", progname, classifier->filename[0]);
 		arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
         return 1;
     }
 
-    init_classifier(c);
+    TClassifier * c = family->members[0]; // the smallest one
 
-    c->threshold = (thr->count > 0) ? thr->dval[0] : c->threshold; 
+    for (unsigned m = 0; m < family->count; ++m)
+    {
+        family->members[m]->threshold = (thr->count > 0) ? thr->dval[0] : family->members[m]->threshold; 
+    }
+
+    // Family covers intermediate scales by its members
+    const int levels_per_octave = 4;
+    const int pyramid_levels = (levels->count > 0) ? levels->ival[0] : ((family->count > 1) ? 1 : levels_per_octave);
     
     // Select engine and preprocessing options
     ScanImageFunc scan = 0;
@@ -137,6 +148,11 @@ int main(int argc, char ** argv)
             scan = scan_image_conv_bunch16;
             pp_opts = PP_CONV_IMAGE;
             pc_opts = RECALC_RANKS;
+            for (unsigned m = 0; m < family->count; ++m)
+            {
+                if (family->members[m]->fsz == FSZ_4x4)
+                    pp_opts = PP_CONV_4x4_IMAGE;
+            }
         }
         if (string(engine->sval[0]) == "iconv")
         {
@@ -150,6 +166,12 @@ int main(int argc, char ** argv)
             pp_opts = PP_LBP_IMAGE;
             pc_opts = NONE;
         }
+        if (string(engine->sval[0]) == "haar")
+        {
+            scan = scan_image_haar;
+            pp_opts = PP_HAAR_IMAGE;
+            pc_opts = RECALC_OFFSET | OFFSET_INTEGRAL;
+        }
     }
 
     if (scan == 0)
@@ -159,6 +181,33 @@ int main(int argc, char ** argv)
         return 1;
     }
 
+    if ((tile->count > 0 || roi->count > 0) && family->count > 1)
+    {
+        fprintf(stderr, "%s: Tiled and ROI scan support only a single classifier\n", progname);
+		arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
+        return 1;
+    }
+
+    vector<CvRect> rois(roi->count);
+    for (int i = 0; i < roi->count; ++i)
+    {
+        CvRect & r = rois[i];
+        if (sscanf(roi->sval[i], "%d,%d,%d,%d", &r.x, &r.y, &r.width, &r.height) != 4)
+        {
+            fprintf(stderr, "%s: Invalid ROI '%s'\n", progname, roi->sval[i]);
+            arg_freetable(argtable, sizeof(argtable)/sizeof(argtable[0]));
+            return 1;
+        }
+    }
+    vector<int> roi_detections(roi->count);
+
+    TileParams tp;
+    tp.tile_size = (tile->count > 0) ? tile->ival[0] : 0;
+    tp.octaves = 8;
+    tp.levels_per_octave = pyramid_levels;
+    tp.pp_options = pp_opts;
+    tp.pc_options = pc_opts;
+
     init_preprocess();
 
     Detection results[10000];
@@ -174,16 +223,28 @@ int main(int argc, char ** argv)
             continue;
         }
 
-        PreprocessedPyramid * pp = create_pyramid(align_size_2(cvGetSize(src)), cvSize(c->width, c->height), 8, 4);
-        
-        insert_image(src, pp, pp_opts);
-        
-        int n = detect_objects(pp, c, &sp, scan, results, results+10000, pc_opts, 1, 0);
+        int n = 0;
+
+        if (roi->count > 0)
+        {
+            n = detect_objects_roi(src, c, &sp, scan, &tp, &rois[0], rois.size(), results, results+10000, &roi_detections[0]);
+        }
+        else if (tile->count > 0)
+        {
+            n = detect_objects_tiled(src, c, &sp, scan, &tp, results, results+10000);
+        }
+        else
+        {
+            PreprocessedPyramid * pp = create_pyramid(align_size_2(cvGetSize(src)), cvSize(c->width, c->height), 8, pyramid_levels);
+            insert_image(src, pp, pp_opts);
+            n = detect_objects_family(pp, family, &sp, scan, results, results+10000, pc_opts, levels_per_octave, 0);
+            release_pyramid(&pp);
+        }
 
         char fn[1024];
         strncpy(fn, files->filename[i], 1024);
         char * name = basename(fn); // basename of image file (to get rid of ../)
-        print_results(name, pp->PI[0]->sz, results, results+n, det->count > 0, cout);
+        print_results(name, cvGetSize(src), results, results+n, det->count > 0, cout);
 
         if (output->count > 0) // output will be saved
         {
@@ -200,10 +261,9 @@ int main(int argc, char ** argv)
             cvSaveImage(out_file, src);
         }
 
-        release_pyramid(&pp);
         cvReleaseImage(&src);
     }
 
-    release_classifier(&c);
+    release_classifier_family(&family);
 }
 
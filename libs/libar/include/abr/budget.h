@@ -0,0 +1,103 @@
+/*
+ *  budget.h
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Detection with a time budget for each frame. Window positions of all
+ *  pyramid levels are split to bands of similar area (split_bands) which
+ *  are scanned in the order of priority until the budget runs out; the
+ *  clock is checked between bands. Bands not scanned in a frame keep their
+ *  detections from the last scan and go first in the next frames, so the
+ *  whole frame is covered within a few frames under any load.
+ *
+ *  Bands at levels around the scales of recent detections go ahead of the
+ *  others by a number of frames, so tracked objects are refreshed first.
+ *
+ */
+
+#ifndef _BUDGET_H_
+#define _BUDGET_H_
+
+#include "core.h"
+#include "structures.h"
+#include "tile.h"
+
+#include <vector>
+
+/// Parameters of detection with a time budget.
+typedef struct
+{
+    double budget;   ///< Time for a frame in ms (0 - scan the whole frame)
+    int bands;       ///< Number of bands the window positions are split to
+    int scale_range; ///< Levels around the levels of recent detections which are preferred
+    int priority;    ///< Frames the preferred bands go ahead of the others
+    float decay;     ///< Weight of detections of older frames (0..1, per frame)
+} BudgetParams;
+
+/// Coverage of a frame.
+typedef struct
+{
+    int bands;       ///< Number of bands
+    int scanned;     ///< Bands scanned in the frame
+    int carried;     ///< Bands left for the next frames
+    float coverage;  ///< Fraction of window positions scanned in the frame
+    int stale;       ///< Detections taken from the earlier frames
+    long oldest;     ///< Frames since the last scan of the oldest band
+    double elapsed;  ///< Time spent in ms
+} CoverageReport;
+
+/// Budget state of one stream.
+struct BudgetState
+{
+    BudgetParams bp;
+    TileParams tp;                  ///< Pyramid and engine (tile_size is not used)
+    long frame;                     ///< Number of processed frames
+    CvSize img_sz;                  ///< Frame size the bands were split for
+    std::vector<CvRect> bands;      ///< Bands as ROIs in the frame
+    std::vector<int> levels;        ///< Level range of each band (two items per band)
+    std::vector<double> weight;     ///< Window positions of each band relative to all positions
+    std::vector<long> scanned;      ///< Frame of the last scan of each band (-1 - never)
+    std::vector< std::vector<Detection> > cache; ///< Detections of each band from its last scan
+    std::vector<float> hits;        ///< Decayed number of recent detections at each level
+    double cost;                    ///< Estimated ms to scan all window positions (0 - unknown)
+};
+
+extern "C" {
+
+/// Create budget state of a stream.
+/// \param bp Budget parameters
+/// \param tp Pyramid and engine parameters (tile_size is not used)
+BudgetState * create_budget_state(const BudgetParams * bp, const TileParams * tp);
+
+/// Release the state. The pointer is set to NULL.
+void release_budget_state(BudgetState ** bs);
+
+/// Forget the cached detections and history, the next frame starts from scratch.
+void reset_budget_state(BudgetState * bs);
+
+/// Detect objects in the next frame of the stream within the time budget.
+/// Bands are ordered by the number of frames since their last scan (plus
+/// 'priority' for the preferred bands) and scanned by detect_objects_roi_levels
+/// while the elapsed time plus the estimated time of the next band fits the
+/// budget. At least one band is scanned in each frame. Detections of the
+/// bands not scanned are taken from their last scan.
+/// \param img Frame (one channel, 8 bit)
+/// \param c The classifier (initialized, it is prepared by the function)
+/// \param sp Scan parameters passed to the engine
+/// \param scan Scan function of the engine
+/// \param bs Budget state of the stream
+/// \param first Ptr to first free detection item
+/// \param last Ptr after last detection item
+/// \param report Receives coverage of the frame (may be NULL)
+/// \returns Number of detections (not grouped, in the coordinates of the frame)
+int detect_objects_budget(IplImage * img, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        BudgetState * bs, Detection * first, Detection * last, CoverageReport * report);
+
+}
+
+#endif
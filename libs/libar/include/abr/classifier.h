@@ -36,6 +36,19 @@ TClassifier * load_classifier_XML(const char * filename);
 /// \param classifier Pointer to classifier
 void release_classifier(TClassifier ** classifier);
 
+/// Create a view of an initialized classifier for a scanning thread.
+/// The view owns the data changed by prepare_classifier (stages, ranks and
+/// Haar bunches) and shares the read only data (alphas, alpha tables and
+/// the quantised model) with the classifier, so threads scanning images of
+/// different sizes can use one classifier. The classifier must outlive the view.
+/// \param c The classifier (initialized)
+/// \returns The view or NULL when failed.
+TClassifier * create_classifier_view(const TClassifier * c);
+
+/// Release a view created by create_classifier_view. The pointer is set to NULL.
+/// \param view Pointer to the view
+void release_classifier_view(TClassifier ** view);
+
 /// Export classifier as .h file.
 /// \param c The classifier to export
 /// \param str Output stream
@@ -49,6 +62,13 @@ void export_classifier_header(TClassifier * c, std::ostream & str, const char *
 /// \param headerName The file name of the header file.
 void export_classifier_source(TClassifier * c, std::ostream & str, const char * name, const char * headerName);
 
+/// Export classifier as XML.
+/// The output can be loaded back by load_classifier_XML.
+/// \param c The classifier to export
+/// \param str Output stream
+/// \param name Name of the classifier (classifierName attribute)
+void export_classifier_XML(TClassifier * c, std::ostream & str, const char * name);
+
 }
 
 #endif
@@ -27,6 +27,11 @@
 #define OFFSET_INTEGRAL     (0x02) ///< Offsets for integral image
 #define RECALC_RANKS        (0x04) ///< Recalculate rank indices
 
+// Layout of alpha tables created by init_classifier
+#define ALPHA_ALIGN         (64) ///< Alignment of the alpha table of each stage (bytes)
+#define LRP_ROW             (16) ///< Packed LRP alpha index is LRP_ROW * rankA + rankB (source rankA + 10 * rankB)
+#define HAAR_MAX_BINS       (256) ///< Bins of HAAR stages are indexed by a byte
+
 /// General classifier evaluation function.
 /// The function evaluates the classifier on the given image on the given position. It evaluates
 /// only weak hypotheses between begin and end (including begin and not including end). This
@@ -49,6 +54,13 @@ typedef int (*ClassifierEvalFunc)(
         unsigned begin, unsigned end,
         int * features, float * hypotheses, float * response, int * stages);
 
+/// Evaluation function of quantised models (see quantise_classifier).
+/// Evaluates all stages of the model 'q' on the window at x,y.
+/// \param response Integer response (multiply by q->scale to get the float response)
+/// \param stages Number of evaluated stages
+/// \returns 0 if the window was rejected, 1 otherwise
+typedef int (*QuantEvalFunc)(PreprocessedImage * PI, const TQuantModel * q, int x, int y, int * response, int * stages);
+
 /// General function for evaluation of a classifier on an image.
 /// It scans the given image on all positions in _single_ scale. The options
 /// specifying behaviour of the particular implementation can be passed in the
@@ -68,9 +80,15 @@ typedef int (*ScanImageFunc)(
 extern "C" {
 
 /// Initialize classifier structure.
-/// Necessary to call before the classifier is used.
+/// Necessary to call before the classifier is used. Alphas of all stages are
+/// re-packed to c->alpha_table where each stage has its own ALPHA_ALIGN aligned
+/// table of c->alpha_stride items. LRP alphas are re-packed from rankA + 10 * rankB
+/// to LRP_ROW * rankA + rankB. The table is padded with 15 zero stages so the
+/// bunch engines can look up 16 stages starting at any stage. HAAR classifiers
+/// also get weights of their features in c->haar (offsets are set by prepare_classifier
+/// with RECALC_OFFSET | OFFSET_INTEGRAL).
 /// \param classifier The classifier to initialize.
-/// \returns 1 if initialized.
+/// \returns 1 if initialized and all features fit the convolution planes (up to 4x4), 0 otherwise.
 int init_classifier(TClassifier * classifier);
 
 /// Prepare the classifier before scanning (or evaluating on) new image.
@@ -13,6 +13,14 @@ int scan_image_integral(PreprocessedImage * PI, TClassifier * c, ScanParams * sp
 int is_classifier_supported_intensity(TClassifier * c);
 int is_classifier_supported_integral(TClassifier * c);
 
+/// Evaluation function used by scan_image_intensity (NULL for unsupported classifiers).
+/// The classifier must be prepared with RECALC_OFFSET.
+ClassifierEvalFunc get_eval_func_intensity(TClassifier * c);
+
+/// Evaluation function used by scan_image_integral (NULL for unsupported classifiers).
+/// The classifier must be prepared with RECALC_OFFSET | OFFSET_INTEGRAL.
+ClassifierEvalFunc get_eval_func_integral(TClassifier * c);
+
 }
 
 #endif
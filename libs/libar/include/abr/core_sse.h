@@ -10,14 +10,46 @@ int scan_image_lbp(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
         Detection * first, Detection * last, int * hist);
 int scan_image_conv_bunch16(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
         Detection * first, Detection * last, int * hist);
+/// Bunch16 engine for LRD and LRP reading the ranks from PP_RANK planes.
+/// Classifiers with blocks above 2x2 need also PP_CONV_4x4.
+int scan_image_rank_bunch16(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
+        Detection * first, Detection * last, int * hist);
 int scan_image_iconv(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
         Detection * first, Detection * last, int * hist);
 int scan_image_iconv_conv(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
         Detection * first, Detection * last, int * hist);
 
+/// MB-LBP on integral image (PP_INTEGRAL_IMAGE).
+/// The classifier must be prepared with RECALC_OFFSET | OFFSET_INTEGRAL.
+int scan_image_mblbp(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
+        Detection * first, Detection * last, int * hist);
+
+/// Haar features on integral images (PP_HAAR_IMAGE).
+/// The classifier must be prepared with RECALC_OFFSET | OFFSET_INTEGRAL.
+int scan_image_haar(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
+        Detection * first, Detection * last, int * hist);
+
+// Engines for quantised models (see quantise_classifier)
+int scan_image_iconv_q(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
+        Detection * first, Detection * last, int * hist);
+int scan_image_conv_bunch16_q(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
+        Detection * first, Detection * last, int * hist);
+
+// Evaluation functions of the engines (NULL for unsupported classifiers)
+ClassifierEvalFunc get_eval_func_conv_bunch16(TClassifier * c);
+ClassifierEvalFunc get_eval_func_rank_bunch16(TClassifier * c);
+ClassifierEvalFunc get_eval_func_iconv(TClassifier * c);
+ClassifierEvalFunc get_eval_func_mblbp(TClassifier * c);
+ClassifierEvalFunc get_eval_func_haar(TClassifier * c);
+QuantEvalFunc get_eval_func_iconv_q(TClassifier * c);
+QuantEvalFunc get_eval_func_conv_bunch16_q(TClassifier * c);
+
 int is_classifier_supported_lbp(TClassifier * c);
 int is_classifier_supported_conv_bunch16(TClassifier * c);
+int is_classifier_supported_rank_bunch16(TClassifier * c);
 int is_classifier_supported_iconv(TClassifier * c);
+int is_classifier_supported_mblbp(TClassifier * c);
+int is_classifier_supported_haar(TClassifier * c);
 
 }
 
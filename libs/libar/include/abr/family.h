@@ -0,0 +1,81 @@
+/*
+ *  family.h
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Families of classifiers of the same detector trained for different window
+ *  sizes. A family scanned on a sparse pyramid (e.g. one level per octave)
+ *  covers the same scales as a single classifier on a dense pyramid; the
+ *  member whose window size fills the gap between pyramid levels is used for
+ *  each intermediate scale.
+ *
+ */
+
+#ifndef _FAMILY_H_
+#define _FAMILY_H_
+
+#include "core.h"
+#include "preprocess.h"
+#include "structures.h"
+
+/// Classifiers of the same detector with different window sizes.
+typedef struct
+{
+    unsigned count;         ///< Number of members
+    TClassifier ** members; ///< Members sorted by window width (smallest first)
+} ClassifierFamily;
+
+extern "C" {
+
+/// Load and initialize family members from XML files.
+/// \param files Classifier files
+/// \param count Number of files
+/// \returns The family or NULL when any of the classifiers cannot be loaded
+ClassifierFamily * load_classifier_family(const char * const * files, unsigned count);
+
+/// Release the family and all its members. The pointer is set to NULL.
+void release_classifier_family(ClassifierFamily ** f);
+
+/// Select members covering the scales between two pyramid levels.
+/// The scale step of the pyramid 2^(1/pyramid_levels) is divided into
+/// levels_per_octave / pyramid_levels sub-steps and for each of them the member
+/// with the closest window size is selected (relative to the smallest member).
+/// Each member is selected at most once.
+/// \param f The family
+/// \param pyramid_levels Levels per octave of the pyramid
+/// \param levels_per_octave Required scale density (levels per octave)
+/// \param members Output indices of selected members (at least f->count items)
+/// \returns Number of selected members
+int select_family_members(ClassifierFamily * f, int pyramid_levels, int levels_per_octave, unsigned * members);
+
+/// Detect objects in the pyramid using the family.
+/// Same as detect_objects but each pyramid level is scanned by all selected members.
+/// The pyramid should be created for the smallest member.
+/// \param PP Preprocessed pyramid
+/// \param f The family
+/// \param sp Scan parameters
+/// \param scan_image Engine
+/// \param first Ptr to first free detection item
+/// \param last Ptr after last detection item
+/// \param options Options for prepare_classifier
+/// \param levels_per_octave Required scale density (levels per octave)
+/// \param hist Histogram of stage execution (sized for the longest member) or NULL
+/// \returns Number of detections
+int detect_objects_family(
+        PreprocessedPyramid * PP,
+        ClassifierFamily * f,
+        ScanParams * sp,
+        ScanImageFunc scan_image,
+        Detection * first, Detection * last,
+        int options,
+        int levels_per_octave,
+        int * hist);
+
+}
+
+#endif
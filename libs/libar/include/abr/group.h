@@ -0,0 +1,48 @@
+/*
+ *  group.h
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Grouping of overlapping detections (non-maxima suppression). Detections
+ *  are partitioned to clusters of similar rectangles the same way as
+ *  cvGroupRectangles does it, so the results match the OpenCV grouping
+ *  used by the applications before.
+ *
+ */
+
+#ifndef _GROUP_H_
+#define _GROUP_H_
+
+#include "structures.h"
+
+extern "C" {
+
+/// Group similar detections in place.
+/// Two detections are similar when their corners differ by at most
+/// eps * (min(w1,w2) + min(h1,h2)) / 2. Each cluster of more than
+/// min_neighbors detections is replaced by the average rectangle and
+/// the maximal response of the cluster. Clusters lying inside a cluster
+/// with more detections are removed. With min_neighbors <= 0 the detections
+/// are left untouched.
+/// \param first Ptr to the first detection
+/// \param last Ptr after the last detection
+/// \param min_neighbors Clusters with at most this number of detections are removed
+/// \param eps Relative tolerance of similar rectangles (OpenCV uses 0.2)
+/// \returns Number 'n' of groups. Groups are stored in [first, first+n).
+int group_detections(Detection * first, Detection * last, int min_neighbors, float eps);
+
+/// Remove detections of the same window in place (e.g. found by overlapping
+/// ROIs). The detections are sorted by position.
+/// \param first Ptr to the first detection
+/// \param last Ptr after the last detection
+/// \returns Number 'n' of unique windows stored in [first, first+n).
+int unique_detections(Detection * first, Detection * last);
+
+}
+
+#endif
@@ -30,6 +30,14 @@ extern "C" {
 /// \param dst Result LBP image
 void calc_LBP11_sse(IplImage * src, IplImage * dst);
 
+/// Recalculate LBP of calc_LBP11_sse only inside the rectangle of 'dst'.
+/// Pixels outside the rectangle are left untouched and pixels inside get
+/// the same values as from calc_LBP11_sse.
+/// \param src Source image
+/// \param dst Result LBP image
+/// \param r The rectangle
+void calc_LBP11_sse_rect(IplImage * src, IplImage * dst, CvRect r);
+
 /// 'Stupid' calculation of LBP image of the 'src' and store it in 'dst'
 /// Both images should be one channel, IPL_DEPTH_8U and same size.
 /// The function calculates 8 bit LBP from 3x3 px local area. No post processing is done.
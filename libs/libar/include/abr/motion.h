@@ -0,0 +1,92 @@
+/*
+ *  motion.h
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Motion masks for fixed cameras. Each frame is compared with a background
+ *  block by block and the changed blocks (dilated) form the mask. Windows
+ *  not touching any changed block at any pyramid level give the same result
+ *  as on the earlier frame, so only windows around the changed blocks are
+ *  preprocessed and scanned and the detections of the rest are reused.
+ *
+ *  The background of a block is its content at the time it was last
+ *  marked as changed, so slow changes accumulated over many frames are
+ *  detected as well.
+ *
+ */
+
+#ifndef _MOTION_H_
+#define _MOTION_H_
+
+#include "core.h"
+#include "structures.h"
+#include "tile.h"
+
+#include <vector>
+
+/// Parameters of motion masks.
+typedef struct
+{
+    int block_size; ///< Size of blocks in pixels of the frame (multiple of 16)
+    int threshold;  ///< Minimal absolute difference of a changed pixel
+    int min_pixels; ///< Minimal number of changed pixels in a changed block
+    int dilate;     ///< Number of blocks added around changed blocks
+} MotionParams;
+
+/// Motion mask and cached detections of one stream.
+struct MotionMask
+{
+    MotionParams mp;
+    CvSize blocks;                   ///< Number of blocks in each direction
+    IplImage * background;           ///< Background of the blocks (frame size)
+    std::vector<unsigned> counts;    ///< Changed pixels of each block in the last frame
+    std::vector<unsigned char> mask; ///< Dilated mask of changed blocks in the last frame
+    std::vector<CvRect> rects;       ///< Changed areas of the last frame (frame coordinates)
+    std::vector<Detection> cache;    ///< Detections of the last frame (not grouped)
+};
+
+extern "C" {
+
+/// Create empty motion mask, the first frame is changed everywhere.
+MotionMask * create_motion_mask(const MotionParams * mp);
+
+/// Release the mask. The pointer is set to NULL.
+void release_motion_mask(MotionMask ** mm);
+
+/// Forget the background and cached detections (e.g. when the classifier or
+/// the scan parameters change). The next frame is changed everywhere.
+void reset_motion_mask(MotionMask * mm);
+
+/// Compare the frame with the background and update the mask, the changed
+/// areas and the background of the changed blocks.
+/// \param mm The mask
+/// \param img Frame (one channel, 8 bit)
+/// \returns Number of changed blocks (after dilation)
+int update_motion_mask(MotionMask * mm, IplImage * img);
+
+/// Detect objects in the frame rescanning only the windows around changed blocks.
+/// The mask is updated by the frame. At each pyramid level, windows
+/// intersecting a changed area are scanned by detect_objects_roi_levels
+/// (only their surroundings are resampled and preprocessed), detections
+/// of other windows are taken from the previous frame. When nothing has
+/// changed, no preprocessing nor scanning is done.
+/// \param img Frame (one channel, 8 bit)
+/// \param c The classifier (initialized, it is prepared by the function)
+/// \param sp Scan parameters passed to the engine
+/// \param scan Scan function of the engine
+/// \param tp Pyramid and engine parameters (tile_size is not used)
+/// \param mm Motion mask of the stream
+/// \param first Ptr to first free detection item
+/// \param last Ptr after last detection item
+/// \returns Number of detections (not grouped, in the coordinates of the frame)
+int detect_objects_motion(IplImage * img, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        const TileParams * tp, MotionMask * mm, Detection * first, Detection * last);
+
+}
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ *  optimize.h
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Offline optimization of loaded classifiers. Stage statistics collected on
+ *  a sample set are used to reorder stages so that each bunch of 16 stages
+ *  evaluated by the bunch16 engines touches as few convolution planes as
+ *  possible.
+ *
+ */
+
+#ifndef _OPTIMIZE_H_
+#define _OPTIMIZE_H_
+
+#include "core.h"
+#include "preprocess.h"
+#include "structures.h"
+
+#include <vector>
+
+/// Number of stages evaluated at once by the bunch16 engines.
+#define BUNCH_SIZE (16)
+
+/// Stage execution statistics of a classifier collected on a sample set.
+struct StageStatistics
+{
+    unsigned stage_count;               ///< Number of stages of the classifier
+    unsigned long windows;              ///< Number of evaluated windows
+    std::vector<unsigned long> reached; ///< Number of windows which evaluated the stage
+};
+
+/// Parameters of stage reordering.
+typedef struct
+{
+    unsigned group_size; ///< Stages are moved only within aligned groups of this size (multiple of BUNCH_SIZE)
+    float bunch_cost;    ///< Relative cost of one bunch evaluation
+    float plane_cost;    ///< Relative cost of each distinct plane touched by a bunch
+} ReorderParams;
+
+extern "C" {
+
+/// Create empty statistics for the classifier.
+StageStatistics * create_stage_statistics(TClassifier * c);
+
+/// Release the statistics. The pointer is set to NULL.
+void release_stage_statistics(StageStatistics ** st);
+
+/// Accumulate statistics from a stage histogram.
+/// \param st Statistics to update
+/// \param hist Histogram of stages evaluated per window (hist[i] windows evaluated i+1 stages)
+void add_stage_histogram(StageStatistics * st, const int * hist);
+
+/// Evaluate the classifier on all positions of the image and accumulate the statistics.
+/// The reference (intensity) engine is used. The classifier is prepared by the function.
+/// \param PI Image preprocessed with at least PP_COPY
+/// \param c The classifier
+/// \param st Statistics to update
+void collect_stage_statistics(PreprocessedImage * PI, TClassifier * c, StageStatistics * st);
+
+/// Find a new order of stages.
+/// Stages are grouped by plane (sz_type) within each group of params->group_size stages.
+/// A group is reordered only when it is predicted to be cheaper.
+/// \param c The classifier
+/// \param st Statistics collected for the classifier
+/// \param params Reordering parameters
+/// \param order Output permutation (c->stage_count items); order[i] is original index of the i-th stage
+/// \returns Number of reordered groups
+int reorder_stages(TClassifier * c, StageStatistics * st, ReorderParams * params, unsigned * order);
+
+/// Create a new classifier with stages permuted by the order.
+/// WaldBoost thresholds within each changed group are recomputed so that no
+/// window accepted by the original classifier is rejected by the new one.
+/// The new classifier must be initialized by init_classifier.
+/// \param c The original classifier
+/// \param order Permutation of stages (from reorder_stages)
+/// \param group_size Group size used to find the order
+/// \returns New classifier (C_DYNAMIC) or NULL when the order is not valid
+TClassifier * apply_stage_order(TClassifier * c, const unsigned * order, unsigned group_size);
+
+/// Predict relative cost of the bunch16 evaluation per window.
+/// When the order is given, reach probabilities of reordered groups are
+/// estimated conservatively by the probability of reaching the group.
+/// \param c The classifier
+/// \param st Statistics collected for the classifier
+/// \param params Cost parameters
+/// \param order Permutation of stages or NULL for the original order
+/// \returns Expected cost per window
+float predict_bunch16_cost(TClassifier * c, StageStatistics * st, ReorderParams * params, const unsigned * order);
+
+/// Number of distinct planes (sz_types) touched by the bunch starting at stage 'begin'.
+int bunch_plane_count(TClassifier * c, const unsigned * order, unsigned begin);
+
+}
+
+#endif
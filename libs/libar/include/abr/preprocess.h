@@ -25,6 +25,9 @@
 #define PP_CONV     0x04    ///< Convolution images (with inverted sign bit)
 #define PP_ICONV    0x08    ///< Rearranged (interleaved) convolution images
 #define PP_LBP      0x10    ///< Precalculated LBP operator images
+#define PP_CONV_4x4 0x20    ///< Convolution images for blocks larger than 2x2 (up to 4x4)
+#define PP_RANK     0x40    ///< Ranks of blocks in 3x3 neighbourhoods of convolution images
+#define PP_INTEGRAL2 0x80   ///< Integral image of squared intensities
 
 // Operations with added dependencies; e.g. integral image need a copy of image to be made
 // and thus PP_INTEGRAL_IMAGE invokes PP_COPY and PP_INTEGRAL operations.
@@ -33,17 +36,34 @@
 #define PP_CONV_IMAGE     (PP_COPY | PP_CONV)
 #define PP_ICONV_IMAGE    (PP_COPY | PP_CONV | PP_ICONV)
 #define PP_LBP_IMAGE      (PP_COPY | PP_CONV | PP_LBP)
+#define PP_CONV_4x4_IMAGE (PP_COPY | PP_CONV | PP_CONV_4x4)
+#define PP_RANK_IMAGE     (PP_COPY | PP_CONV | PP_RANK)
+#define PP_HAAR_IMAGE     (PP_COPY | PP_INTEGRAL | PP_INTEGRAL2)
 #define PP_ALL            (PP_COPY | PP_INTEGRAL | PP_CONV | PP_ICONV | PP_LBP )
 
+#define PP_TILE (32) ///< Tiles compared by incremental preprocessing
+
+#define CONV_PLANES     (4)  ///< Convolution planes of blocks up to 2x2
+#define CONV_PLANES_4x4 (16) ///< Convolution planes of blocks up to 4x4
+
+/// Convolution plane (sz_type) of w x h blocks (1 <= w,h <= 4).
+/// Blocks up to 2x2 keep types 0..3 so the 'iconv' tables remain valid.
+/// 0000hwHW - h,w are high and H,W low bits of (h-1) and (w-1)
+static inline int conv_plane(int w, int h)
+{
+    return (((h-1) & 2) << 2) | (((w-1) & 2) << 1) | (((h-1) & 1) << 1) | ((w-1) & 1);
+}
+
 /// Structure holding various versions of input image.
 struct PreprocessedImage
 {
     CvSize sz;          ///< Size of a source image
     
-    int block_count[4]; ///< Count of blocks in convolution images
+    int block_count[CONV_PLANES_4x4]; ///< Count of blocks in convolution images
     int iblock_size[4]; ///< Size of blocks in 'iconv' images
     int irow_size[4];   ///< Size of row in 'iconv' images
-    int cblock_size[4]; ///< Size of blocks in 'conv' images
+    int cblock_size[CONV_PLANES_4x4]; ///< Size of blocks in 'conv' images
+    int rplane_size[CONV_PLANES_4x4]; ///< Size of one of the nine planes in 'rank' images
 
     int * xtbl;         ///< Column addressing table in 'iconv'
     int * ytbl;         ///< Row addressing table in 'iconv'
@@ -51,9 +71,14 @@ struct PreprocessedImage
     IplImage tmp;       ///< Temporary image for convolution
     IplImage intensity; ///< Intensity image (copied or scaled source image). This is source for all preprocessing.
     IplImage integral;  ///< Integral image.
-    IplImage conv[4];   ///< Block-rearranged convolution images
+    IplImage integral2; ///< Integral image of squared intensities (modulo 2^32), allocated on first PP_INTEGRAL2
+    IplImage conv[CONV_PLANES_4x4]; ///< Block-rearranged convolution images (planes above 2x2 allocated on first PP_CONV_4x4)
     IplImage iconv[4];  ///< 2x2 Local-rearranged convolution images
     IplImage lbp[4];    ///< Pre-calculated LBP operator images
+    IplImage response;  ///< Classifier response of each window (see response_map), allocated on demand
+    IplImage stage_map; ///< Number of stages evaluated in each window (see response_map), allocated on demand
+    IplImage rank[CONV_PLANES_4x4]; ///< Ranks in 3x3 block neighbourhoods of 'conv' (see calc_ranks_3x3_sse), allocated on first PP_RANK
+    int pp_options;     ///< Planes valid for the current intensity image (see preprocess_image_incremental)
 };
 
 struct PreprocessedPyramid
@@ -79,6 +104,56 @@ void release_pyramid(PreprocessedPyramid ** PP);
 
 void insert_image(IplImage * img, PreprocessedPyramid * PP, int options);
 
+/// Preprocess an external 8 bit plane without wrapping or copying it,
+/// e.g. a grayscale frame or the Y plane of NV12/I420 from a decoder.
+/// When the plane has the size of PI, it is used directly as the intensity
+/// image (no copy) and it must stay valid and unchanged while PI is used;
+/// the next preprocess_image with PP_COPY returns PI to its own data.
+/// Otherwise the plane is resized to PI directly.
+/// \param data Ptr to the first pixel of the plane
+/// \param step Distance of rows in bytes
+/// \param sz Size of the plane
+/// \param PI Preprocessed image
+/// \param options Preprocessing options (PP_COPY is implied)
+void preprocess_plane(const unsigned char * data, int step, CvSize sz, PreprocessedImage * PI, int options);
+
+/// Insert an external 8 bit plane to the pyramid (see preprocess_plane).
+/// The plane is the intensity of the first level when the sizes match
+/// (even width and height), other levels are resampled from it directly.
+/// \param data Ptr to the first pixel of the plane
+/// \param step Distance of rows in bytes
+/// \param sz Size of the plane
+/// \param PP The pyramid
+/// \param options Preprocessing options
+void insert_plane(const unsigned char * data, int step, CvSize sz, PreprocessedPyramid * PP, int options);
+
+/// Preprocess the next frame of a stream recalculating only the changed tiles.
+/// The new intensity image is compared with the current one in tiles of
+/// PP_TILE pixels; all planes required by 'options' are recalculated only
+/// around the changed tiles (including the halo of filters, LBP and ranks)
+/// and the rest of the image is left untouched. The integral images are
+/// recalculated from the first changed row. Results are the same as from
+/// preprocess_image. When the image was not preprocessed with 'options'
+/// before, it is preprocessed completely.
+/// \param img Source image
+/// \param PI Preprocessed image of the previous frame
+/// \param options Preprocessing options (PP_COPY is implied)
+/// \param rects Changed areas in 'img' coordinates, tiles outside of them
+///              are not compared; NULL to compare the whole image
+/// \param count Number of rectangles
+/// \returns Number of recalculated tiles
+int preprocess_image_incremental(IplImage * img, PreprocessedImage * PI, int options, const CvRect * rects, int count);
+
+/// Insert the next frame of a stream to the pyramid recalculating only the
+/// changed tiles of each level (see preprocess_image_incremental).
+/// \param img Source image
+/// \param PP Pyramid with the previous frame
+/// \param options Preprocessing options
+/// \param rects Changed areas in 'img' coordinates or NULL to compare whole levels
+/// \param count Number of rectangles
+/// \returns Number of recalculated tiles of all levels
+int insert_image_incremental(IplImage * img, PreprocessedPyramid * PP, int options, const CvRect * rects, int count);
+
 }
 
 #endif
@@ -0,0 +1,60 @@
+/*
+ *  quant.h
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Quantised (int16 fixed point) representation of classifiers. The model
+ *  keeps 16 byte stage records and int16 alphas, thresholds and ranks so
+ *  that large cascades fit in the cache. It is evaluated by the _q variants
+ *  of the SSE engines.
+ *
+ */
+
+#ifndef _QUANT_H_
+#define _QUANT_H_
+
+#include "core.h"
+#include "preprocess.h"
+#include "structures.h"
+
+/// Comparison of detections of the float and the quantised engines.
+typedef struct
+{
+    unsigned long float_detections; ///< Detections of the float engine
+    unsigned long quant_detections; ///< Detections of the quantised engine
+    unsigned long lost;             ///< Float detections missing in quantised results
+    unsigned long added;            ///< Quantised detections missing in float results
+} QuantValidation;
+
+extern "C" {
+
+/// Create quantised model of the classifier and attach it to c->quant.
+/// The classifier must be initialized by init_classifier and its features
+/// must fit the 2x2 convolution planes (FSZ_2x2 LRD, LRP or LBP; the quantised
+/// engines do not read the 4x4 planes). The scale is selected so that the
+/// thresholds and sum of 16 alphas fit int16 with 2x headroom.
+/// \param c The classifier
+/// \returns 1 on success, 0 when the classifier cannot be quantised
+int quantise_classifier(TClassifier * c);
+
+/// Release the quantised model. The pointer is set to NULL.
+void release_quant_model(TQuantModel ** q);
+
+/// Scan the image with the float and the quantised engine and compare detections.
+/// The classifier must be prepared for the float engine.
+/// \param PI Image preprocessed for both engines
+/// \param c The classifier with quantised model
+/// \param sp Scan parameters
+/// \param float_scan The float engine
+/// \param quant_scan The quantised engine
+/// \param v Results are accumulated to this structure
+void validate_quant_scan(PreprocessedImage * PI, TClassifier * c, ScanParams * sp, ScanImageFunc float_scan, ScanImageFunc quant_scan, QuantValidation * v);
+
+}
+
+#endif
@@ -0,0 +1,46 @@
+// 
+//  rank.h
+//  Graph@FIT, DCGM, FIT, BUT, Brno
+//  
+//  NOTES
+//  Order of samples in the 3x3 neighbourhood (same as A, B of LRD/LRP features)
+//  0 1 2
+//  3 4 5
+//  6 7 8
+//
+//  Rank of a sample is the number of samples in the neighbourhood smaller than it.
+//  LRD feature is then rank(A) - rank(B), LRP feature LRP_ROW * rank(A) + rank(B).
+//
+
+#ifndef _RANK_H_
+#define _RANK_H_
+
+#include <cxcore.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// SSE optimized calculation of ranks in 3x3 px local areas of the 'src'.
+/// Source is one channel IPL_DEPTH_8U image with inverted sign bit (i.e. the
+/// convolution images). The 'dst' has nine planes of the size of 'src' following
+/// each other; plane k holds at (x,y) the rank of the k-th sample of the area
+/// with top-left corner at (x,y). Both images must have the same widthStep.
+/// \param src Source image
+/// \param dst Result rank planes (9 * src->height rows)
+void calc_ranks_3x3_sse(IplImage * src, IplImage * dst);
+
+/// Recalculate ranks of calc_ranks_3x3_sse only for areas with the top-left
+/// corner inside the rectangle. Other items are left untouched.
+/// \param src Source image
+/// \param dst Result rank planes (9 * src->height rows)
+/// \param r The rectangle
+void calc_ranks_3x3_rect(IplImage * src, IplImage * dst, CvRect r);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
+
@@ -0,0 +1,57 @@
+/*
+ *  response.h
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Dense response maps. Instead of thresholded detections, the classifier
+ *  response and the number of evaluated stages of every window are written
+ *  to PreprocessedImage::response and PreprocessedImage::stage_map. Value at
+ *  x,y belongs to the window with top-left corner at x,y.
+ *
+ */
+
+#ifndef _RESPONSE_H_
+#define _RESPONSE_H_
+
+#include "core.h"
+#include "preprocess.h"
+#include "structures.h"
+
+extern "C" {
+
+/// Evaluate the classifier in all windows and store the response map.
+/// PI->response is IPL_DEPTH_32F plane with responses (partial responses of
+/// rejected windows), PI->stage_map is IPL_DEPTH_16U plane with numbers of
+/// evaluated stages. Planes are (re)allocated when necessary. Windows not
+/// evaluated (closer than 'border' to the edge or not fitting the image) have
+/// response -FLT_MAX and zero stages.
+/// Each window is evaluated by 'eval' on its own (as in the scan functions of
+/// the engines), the scan functions themselves do not produce the map.
+/// The classifier must be prepared for the engine the 'eval' comes from.
+/// \param PI Preprocessed image
+/// \param c The classifier
+/// \param eval Evaluation function of an engine (e.g. get_eval_func_conv_bunch16)
+/// \param border Border of the engine (0 for bunch16 engines, 1 for the others)
+/// \returns Number of evaluated windows
+int response_map(PreprocessedImage * PI, TClassifier * c, ClassifierEvalFunc eval, unsigned border);
+
+/// Response map of the quantised model of the classifier.
+/// Same as response_map, but PI->response is IPL_DEPTH_16S plane with integer
+/// responses (saturated, multiply by c->quant->scale to get the float response)
+/// and not evaluated windows are SHRT_MIN.
+/// \param eval Evaluation function of quantised engine (e.g. get_eval_func_conv_bunch16_q)
+int response_map_q(PreprocessedImage * PI, TClassifier * c, QuantEvalFunc eval, unsigned border);
+
+/// Response maps of all pyramid levels.
+/// \param options Options of prepare_classifier used for each level
+/// \returns Number of evaluated windows
+int response_map_pyramid(PreprocessedPyramid * PP, TClassifier * c, ClassifierEvalFunc eval, unsigned border, int options);
+
+}
+
+#endif
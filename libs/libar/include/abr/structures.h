@@ -37,16 +37,41 @@ typedef struct
     float theta_b; // wald_boost threshold
     float * alpha; // Ptr to table with alphas
     
-    char sz_type;  // 2 * (h-1) + (w-1)
+    char sz_type;  // conv_plane(w, h); 2 * (h-1) + (w-1) up to 2x2
     char pos_type; // (4 * (y % 4) + (x % 4))
     unsigned offset;
+
+    float f_min, f_max; // Range of discretized feature values (HAAR, type of the feature in A)
 } TStage;
 
 typedef enum
 {
-    UNKNOWN, LRD, LRP, LBP, numClassifierTypes
+    UNKNOWN, LRD, LRP, LBP, MBLBP, HAAR, numClassifierTypes
 } ClassifierType;
 
+/// Haar feature types (TStage::A of HAAR stages)
+typedef enum
+{
+    HAAR_DH, HAAR_DV, HAAR_TH, HAAR_TV, HAAR_DIAG, HAAR_SRND, numHaarTypes
+} HaarType;
+
+#define HAAR_CORNERS (16) ///< Integral image corners of the largest (3x3) Haar feature
+
+/// Haar features of a bunch of 16 stages evaluated from integral image.
+/// Value of feature i is sum of coef[k][i] * integral[offset[k][i]] over
+/// the first 'corners' corners; offsets are relative to the corner up-left
+/// of the window. Normalised and discretized value (the alpha index) is
+/// f * scale[i] / stddev + shift[i].
+typedef struct
+{
+    int offset[HAAR_CORNERS][16]; ///< Corner offsets in integral image items (see prepare_classifier)
+    int coef[HAAR_CORNERS][16];   ///< Corner weights, zero for unused corners
+    float scale[16];              ///< (alpha_count-1) / (norm * w * h * (f_max - f_min))
+    float shift[16];              ///< 0.5 - f_min * (alpha_count-1) / (f_max - f_min)
+    int corners;                  ///< Corners used by any stage of the bunch
+    int reserved[3];              ///< Keeps bunches in an array 16 byte aligned
+} THaarBunch;
+
 typedef enum
 {
     C_STATIC, C_DYNAMIC
@@ -54,9 +79,40 @@ typedef enum
 
 typedef enum
 {
-    FSZ_UNRESTRICTED, FSZ_2x2
+    FSZ_UNRESTRICTED, FSZ_2x2, FSZ_4x4
 } FeatureSize;
 
+/// Compact stage record of a quantised classifier (16 bytes).
+/// Field names match TStage so the engines can share feature code. The feature
+/// code reads all fields of a stage together, so the records are kept as an
+/// array of structures; thresholds, alphas and ranks are separate arrays of
+/// TQuantModel.
+typedef struct
+{
+    short x, y;
+    unsigned char w, h;
+    unsigned char A, B;      // feature parameters
+    unsigned char sz_type;   // conv_plane(w, h); 2 * (h-1) + (w-1) up to 2x2
+    unsigned char pos_type;  // (4 * (y % 4) + (x % 4))
+    unsigned short reserved;
+    unsigned alpha;          // Offset of the alpha table in TQuantModel::alpha
+} TStageQ;
+
+/// Quantised representation of a classifier.
+/// Responses are int16 fixed point numbers, real value is scale * response.
+/// Per-stage data are stored in separate arrays padded with 15 zero stages.
+typedef struct
+{
+    float scale;           ///< Size of one quantisation step
+    unsigned stage_count;  ///< Number of stages
+    unsigned alpha_stride; ///< Number of alphas per stage
+    short threshold;       ///< Quantised final threshold
+    TStageQ * stage;       ///< Stage records
+    short * theta;         ///< Quantised WaldBoost thresholds
+    short * alpha;         ///< Quantised alphas (layout of TClassifier::alpha_table)
+    short * ranks;         ///< rank_table indices of A and B for each mask type (8 per stage)
+} TQuantModel;
+
 typedef enum
 {
     NS_NONE, // No suppression
@@ -83,6 +139,12 @@ typedef struct
     TStage * stage; ///< List of stages
     float * alpha; ///< List of alphas
     int * ranks; ///< Precalculated ranks
+
+    // Created by init_classifier
+    unsigned alpha_stride; ///< Number of items per stage in alpha_table
+    float * alpha_table; ///< Aligned alpha tables in the layout used by the engines
+    TQuantModel * quant; ///< Optional quantised model (see quantise_classifier)
+    THaarBunch * haar; ///< Haar features of HAAR classifiers in bunches of 16 stages
 } TClassifier;
 
 
@@ -0,0 +1,105 @@
+/*
+ *  tile.h
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Tiled multi-scale detection for very large images. Each pyramid level is
+ *  covered by overlapping tiles of constant size which are resampled from the
+ *  source, preprocessed and scanned in a per-thread PreprocessedImage, so the
+ *  memory used by preprocessing does not depend on the size of the image.
+ *  Every window position is owned by exactly one tile (the tile whose core
+ *  contains its top-left corner) so there are no duplicates at the seams.
+ *  Tiles are processed in parallel when the library is built with OpenMP.
+ *
+ *  Regions of interest use the same machinery. Only the regions covered by
+ *  the ROIs are resampled, preprocessed and scanned at each level, so the
+ *  cost depends on the area of the ROIs and not on the size of the image.
+ *
+ */
+
+#ifndef _TILE_H_
+#define _TILE_H_
+
+#include "core.h"
+#include "preprocess.h"
+#include "structures.h"
+
+/// Parameters of tiled detection.
+typedef struct
+{
+    int tile_size;         ///< Window positions in the core of a tile (in each direction, not used by ROI scan)
+    int octaves;           ///< Number of octaves of the pyramid
+    int levels_per_octave; ///< Levels in each octave
+    int pp_options;        ///< Preprocessing options of the engine
+    int pc_options;        ///< Options of prepare_classifier for the engine
+} TileParams;
+
+extern "C" {
+
+/// Detect objects in the image on all pyramid levels tile by tile.
+/// Tiles overlap by the window size plus a margin of the engine border at
+/// every level. Detections are in the coordinates of the source image.
+/// The classifier must be initialized; it is prepared by the function.
+/// \param img Source image (one channel, 8 bit)
+/// \param c The classifier
+/// \param sp Scan parameters passed to the engine
+/// \param scan Scan function of the engine
+/// \param tp Tiling parameters
+/// \param first Ptr to first free detection item
+/// \param last Ptr after last detection item
+/// \returns Number of detections (at most last - first)
+int detect_objects_tiled(IplImage * img, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        const TileParams * tp, Detection * first, Detection * last);
+
+/// Detect objects inside the given regions of interest on all pyramid levels.
+/// A detection belongs to a ROI when its window lies within the ROI. ROIs
+/// are mapped to each level, clipped and the overlapping ones are merged so
+/// every part of a level is preprocessed and scanned at most once.
+/// Detections are grouped by the ROIs in the order of 'rois', a detection
+/// lying in more ROIs is listed in each of them. Detections are in the
+/// coordinates of the source image.
+/// \param img Source image (one channel, 8 bit)
+/// \param c The classifier (initialized, it is prepared by the function)
+/// \param sp Scan parameters passed to the engine
+/// \param scan Scan function of the engine
+/// \param tp Pyramid and engine parameters (tile_size is not used)
+/// \param rois Regions of interest in the coordinates of the source image
+/// \param roi_count Number of ROIs
+/// \param first Ptr to first free detection item
+/// \param last Ptr after last detection item
+/// \param roi_detections Receives number of detections of each ROI (roi_count items)
+/// \returns Number of detections (at most last - first)
+int detect_objects_roi(IplImage * img, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        const TileParams * tp, const CvRect * rois, int roi_count,
+        Detection * first, Detection * last, int * roi_detections);
+
+/// Detect objects inside the ROIs, each ROI only on a range of pyramid levels.
+/// Same as detect_objects_roi, the ROI i is scanned on levels
+/// levels[2*i] to levels[2*i+1] (inclusive). The level l has scale
+/// 2^(l / levels_per_octave) relative to the source. With levels == NULL
+/// all levels are scanned.
+int detect_objects_roi_levels(IplImage * img, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        const TileParams * tp, const CvRect * rois, const int * levels, int roi_count,
+        Detection * first, Detection * last, int * roi_detections);
+
+/// Split the window positions of all levels to bands of similar area.
+/// Each band is a range of window rows of one level given as a ROI in the
+/// source image (the whole width, overlapping the neighbouring bands by a
+/// row) and its level range (both items equal) for detect_objects_roi_levels.
+/// \param img_sz Size of the source image
+/// \param c The classifier
+/// \param tp Pyramid parameters
+/// \param bands Wanted number of bands (each level has at least one)
+/// \param rois Receives the bands, NULL to get only their number
+/// \param levels Receives two items for each band (may be NULL)
+/// \returns Number of bands
+int split_bands(CvSize img_sz, const TClassifier * c, const TileParams * tp, int bands, CvRect * rois, int * levels);
+
+}
+
+#endif
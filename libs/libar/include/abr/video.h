@@ -0,0 +1,87 @@
+/*
+ *  video.h
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Tracking-assisted detection in video streams. Consecutive frames are
+ *  nearly identical so the whole frame is scanned only every N frames and
+ *  on scene changes. Other frames are scanned only around the objects
+ *  found in the previous frame (in position and scale) and in a slice of
+ *  the frame which rotates so new objects are found within a few frames.
+ *
+ */
+
+#ifndef _VIDEO_H_
+#define _VIDEO_H_
+
+#include "core.h"
+#include "preprocess.h"
+#include "structures.h"
+#include "tile.h"
+
+#include <vector>
+
+/// Parameters of video detection.
+typedef struct
+{
+    int full_interval;   ///< Full scan every N frames (0 - only the first frame and scene changes)
+    float scene_change;  ///< Mean absolute difference of frame thumbnails forcing a full scan (0 - off)
+    float dilate;        ///< Neighbourhood of a tracked object in each direction (relative to its size)
+    int scale_range;     ///< Pyramid levels scanned above and below the level of a tracked object
+    int slices;          ///< Number of frames in which the rotating slice covers the frame (0 - no slice)
+    int min_neighbors;   ///< Grouping of detections (see group_detections)
+    float eps;           ///< Grouping of detections (see group_detections)
+} VideoParams;
+
+/// Detection state carried between frames of one stream.
+struct VideoState
+{
+    VideoParams vp;
+    TileParams tp;                 ///< Pyramid and engine (tile_size is not used)
+    long frame;                    ///< Number of processed frames
+    int slice;                     ///< Next slice to scan
+    int full_scan;                 ///< Last frame was scanned completely
+    IplImage * thumbnail;          ///< Thumbnail of the last frame (scene change detection)
+    PreprocessedPyramid * PP;      ///< Pyramid for full scans
+    std::vector<Detection> tracks; ///< Grouped detections of the last frame
+};
+
+extern "C" {
+
+/// Create detection state of a stream.
+/// \param vp Video parameters
+/// \param tp Pyramid and engine parameters (tile_size is not used)
+VideoState * create_video_state(const VideoParams * vp, const TileParams * tp);
+
+/// Release the state. The pointer is set to NULL.
+void release_video_state(VideoState ** vs);
+
+/// Forget the tracked objects, the next frame is scanned completely.
+void reset_video_state(VideoState * vs);
+
+/// Detect objects in the next frame of the stream.
+/// Full scans use detect_objects on a pyramid; other frames use
+/// detect_objects_roi_levels on neighbourhoods of the tracked objects
+/// and the current slice. The neighbourhood must be large enough for the
+/// window at the largest scanned scale, i.e. 1 + 2 * dilate should be at
+/// least 2^(scale_range / levels_per_octave).
+/// Detections are grouped and they become the tracked objects.
+/// \param img Frame (one channel, 8 bit)
+/// \param c The classifier (initialized, it is prepared by the function)
+/// \param sp Scan parameters passed to the engine
+/// \param scan Scan function of the engine
+/// \param vs State of the stream
+/// \param first Ptr to first free detection item
+/// \param last Ptr after last detection item
+/// \returns Number of detections (grouped, in the coordinates of the frame)
+int detect_objects_video(IplImage * img, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        VideoState * vs, Detection * first, Detection * last);
+
+}
+
+#endif
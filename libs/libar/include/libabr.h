@@ -26,6 +26,15 @@
 #include <abr/core_simple.h>
 #include <abr/core_sse.h>
 #include <abr/classifier.h>
+#include <abr/budget.h>
 #include <abr/preprocess.h>
+#include <abr/family.h>
+#include <abr/group.h>
+#include <abr/motion.h>
+#include <abr/optimize.h>
+#include <abr/quant.h>
+#include <abr/response.h>
+#include <abr/tile.h>
+#include <abr/video.h>
 
 #endif
@@ -0,0 +1,190 @@
+/*
+ *  budget.cpp
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Detection with a time budget for each frame (see budget.h).
+ *
+ */
+
+#include "budget.h"
+#include "group.h"
+
+#include <cv.h>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+
+/// Detections buffer of one band
+#define BUDGET_DETECTIONS (4096)
+
+
+BudgetState * create_budget_state(const BudgetParams * bp, const TileParams * tp)
+{
+    BudgetState * bs = new BudgetState();
+    bs->bp = *bp;
+    bs->tp = *tp;
+    reset_budget_state(bs);
+    return bs;
+}
+
+void release_budget_state(BudgetState ** bs)
+{
+    if (bs && *bs)
+    {
+        delete *bs;
+        *bs = 0;
+    }
+}
+
+void reset_budget_state(BudgetState * bs)
+{
+    bs->frame = 0;
+    bs->img_sz = cvSize(0, 0);
+    bs->bands.clear();
+    bs->levels.clear();
+    bs->weight.clear();
+    bs->scanned.clear();
+    bs->cache.clear();
+    bs->hits.assign(bs->tp.octaves * bs->tp.levels_per_octave, 0.0f);
+    bs->cost = 0;
+}
+
+/// Split the frame to bands and estimate their share of window positions.
+static void init_bands(BudgetState * bs, CvSize img_sz, const TClassifier * c)
+{
+    const int n = split_bands(img_sz, c, &bs->tp, bs->bp.bands, 0, 0);
+    bs->img_sz = img_sz;
+    bs->bands.resize(n);
+    bs->levels.resize(2 * n);
+    if (n > 0)
+    {
+        split_bands(img_sz, c, &bs->tp, bs->bp.bands, &bs->bands[0], &bs->levels[0]);
+    }
+
+    bs->weight.resize(n);
+    double total = 0;
+    for (int b = 0; b < n; ++b)
+    {
+        const float scale = pow(2.0f, float(bs->levels[2*b]) / bs->tp.levels_per_octave);
+        const double cols = max(1.0, double(img_sz.width / scale) - c->width);
+        const double rows = max(1.0, double(bs->bands[b].height / scale) - c->height);
+        bs->weight[b] = cols * rows;
+        total += bs->weight[b];
+    }
+    for (int b = 0; b < n; ++b)
+    {
+        bs->weight[b] /= total;
+    }
+
+    bs->scanned.assign(n, -1);
+    bs->cache.assign(n, vector<Detection>());
+}
+
+/// Check whether the band is at a level around recent detections.
+static bool preferred(const BudgetState * bs, int b)
+{
+    const int level = bs->levels[2*b];
+    const int l0 = max(0, level - bs->bp.scale_range);
+    const int l1 = min<int>(bs->hits.size() - 1, level + bs->bp.scale_range);
+    for (int l = l0; l <= l1; ++l)
+    {
+        if (bs->hits[l] >= 0.5f)
+            return true;
+    }
+    return false;
+}
+
+int detect_objects_budget(IplImage * img, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        BudgetState * bs, Detection * first, Detection * last, CoverageReport * report)
+{
+    const int64 t0 = cvGetTickCount();
+    const double ms = cvGetTickFrequency() * 1e3;
+
+    if (bs->img_sz.width != img->width || bs->img_sz.height != img->height)
+    {
+        init_bands(bs, cvGetSize(img), c);
+    }
+
+    const int n = bs->bands.size();
+
+    // Bands waiting longest go first, never scanned bands before all
+    vector< pair<long, int> > order(n);
+    for (int b = 0; b < n; ++b)
+    {
+        long age = (bs->scanned[b] < 0) ? bs->frame + 1 : bs->frame - bs->scanned[b];
+        if (preferred(bs, b))
+            age += bs->bp.priority;
+        order[b] = make_pair(-age, b);
+    }
+    sort(order.begin(), order.end());
+
+    for (unsigned l = 0; l < bs->hits.size(); ++l)
+    {
+        bs->hits[l] *= bs->bp.decay;
+    }
+
+    vector<Detection> found(BUDGET_DETECTIONS);
+    int scanned = 0;
+    double covered = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        const int b = order[i].second;
+        const int64 t1 = cvGetTickCount();
+
+        // Clock is checked only between bands, the estimate keeps the last band within the budget
+        if (bs->bp.budget > 0 && scanned > 0 && (t1 - t0) / ms + bs->cost * bs->weight[b] > bs->bp.budget)
+            break;
+
+        int band_detections = 0;
+        const int k = detect_objects_roi_levels(img, c, sp, scan, &bs->tp, &bs->bands[b], &bs->levels[2*b], 1,
+                &found[0], &found[0] + found.size(), &band_detections);
+        bs->cache[b].assign(found.begin(), found.begin() + k);
+        bs->scanned[b] = bs->frame;
+        bs->hits[bs->levels[2*b]] += k;
+
+        const double sample = (cvGetTickCount() - t1) / ms / bs->weight[b];
+        bs->cost = (bs->cost > 0) ? 0.8 * bs->cost + 0.2 * sample : sample;
+
+        ++scanned;
+        covered += bs->weight[b];
+    }
+
+    // Detections of all bands, the neighbouring bands share a row of windows
+    vector<Detection> dets;
+    int stale = 0;
+    long oldest = 0;
+    for (int b = 0; b < n; ++b)
+    {
+        dets.insert(dets.end(), bs->cache[b].begin(), bs->cache[b].end());
+        if (bs->scanned[b] != bs->frame)
+            stale += bs->cache[b].size();
+        oldest = max(oldest, (bs->scanned[b] < 0) ? bs->frame + 1 : bs->frame - bs->scanned[b]);
+    }
+    const int count = dets.empty() ? 0 : unique_detections(&dets[0], &dets[0] + dets.size());
+
+    if (report)
+    {
+        report->bands = n;
+        report->scanned = scanned;
+        report->carried = n - scanned;
+        report->coverage = covered;
+        report->stale = stale;
+        report->oldest = oldest;
+        report->elapsed = (cvGetTickCount() - t0) / ms;
+    }
+
+    ++bs->frame;
+
+    const int m = min<int>(count, last - first);
+    copy(dets.begin(), dets.begin() + m, first);
+    return m;
+}
@@ -17,15 +17,19 @@
 
 #include "classifier.h"
 #include "simplexml.h"
+#include "quant.h"
 
 #include <sstream>
 #include <iostream>
 #include <iomanip>
 #include <map>
 #include <stack>
+#include <cstdlib>
 #include <vector>
 #include <list>
 #include <cassert>
+#include <cstring>
+#include <algorithm>
 
 using namespace std;
 
@@ -50,6 +54,18 @@ void release_classifier(TClassifier** const classifier)
 	{
 	  delete [] c.ranks;
 	}
+
+        if (c.alpha_table)
+        {
+            free(c.alpha_table);
+        }
+
+        if (c.haar)
+        {
+            free(c.haar);
+        }
+
+        release_quant_model(&c.quant);
         
         delete *classifier;
         *classifier = 0;
@@ -57,6 +73,55 @@ void release_classifier(TClassifier** const classifier)
 }
 
 
+TClassifier * create_classifier_view(const TClassifier * c)
+{
+    if (!c || !c->stage)
+        return 0;
+
+    TClassifier * view = new TClassifier(*c);
+
+    // release_classifier must not free the shared data
+    view->model = C_STATIC;
+
+    view->stage = new TStage[c->stage_count];
+    copy(c->stage, c->stage + c->stage_count, view->stage);
+
+    if (c->ranks)
+    {
+        view->ranks = new int[8 * c->stage_count];
+        copy(c->ranks, c->ranks + 8 * c->stage_count, view->ranks);
+    }
+
+    if (c->haar)
+    {
+        const unsigned size = ((c->stage_count + 15) / 16) * sizeof(THaarBunch);
+        void * haar = 0;
+        if (posix_memalign(&haar, 16, size) != 0)
+        {
+            view->haar = 0;
+            release_classifier_view(&view);
+            return 0;
+        }
+        memcpy(haar, c->haar, size);
+        view->haar = (THaarBunch*)haar;
+    }
+
+    return view;
+}
+
+void release_classifier_view(TClassifier ** view)
+{
+    if (view && *view)
+    {
+        delete [] (*view)->stage;
+        delete [] (*view)->ranks;
+        free((*view)->haar);
+        delete *view;
+        *view = 0;
+    }
+}
+
+
 static void loadLRDFeature(xmlNodePtr fNode, TStage * stage)
 {
     if (!fNode) return;
@@ -91,6 +156,10 @@ static void loadLBPFeature(xmlNodePtr fNode, TStage * stage)
     {
         lrNode = getNode("LBPFeature", fNode);
     }
+    if (!lrNode)
+    {
+        lrNode = getNode("MBLBPFeature", fNode);
+    }
     if (!lrNode) return;
 
     getAttr(stage->x, "positionX", lrNode);
@@ -99,6 +168,42 @@ static void loadLBPFeature(xmlNodePtr fNode, TStage * stage)
     getAttr(stage->h, "blockHeight", lrNode);
 }
 
+/// Names of Haar features (indexed by HaarType)
+static const char * const haar_feature_names[numHaarTypes] = {
+    "HaarHorizontalDoubleFeature",
+    "HaarVerticalDoubleFeature",
+    "HaarHorizontalTernalFeature",
+    "HaarVerticalTernalFeature",
+    "HaarDiagonalFeature",
+    "HaarSurroundFeature",
+};
+
+// false if the stage has no known Haar feature
+static bool loadHaarFeature(xmlNodePtr fNode, TStage * stage)
+{
+    if (!fNode) return false;
+
+    xmlNodePtr discretizeNode = getNode("TCont2DiscFeature", fNode);
+    if (!discretizeNode) return false;
+
+    getAttr(stage->f_min, "minValue", discretizeNode);
+    getAttr(stage->f_max, "maxValue", discretizeNode);
+
+    xmlNodePtr haarNode = 0;
+    for (int tp = 0; tp < numHaarTypes && !haarNode; ++tp)
+    {
+        haarNode = getNode(haar_feature_names[tp], discretizeNode);
+        if (haarNode) stage->A = tp;
+    }
+    if (!haarNode) return false;
+
+    getAttr(stage->x, "positionX", haarNode);
+    getAttr(stage->y, "positionY", haarNode);
+    getAttr(stage->w, "blockWidth", haarNode);
+    getAttr(stage->h, "blockHeight", haarNode);
+    return true;
+}
+
 static void loadHistogramWeakHypothesis(xmlNodePtr hNode, vector<float> & predictTable)
 {
     if (!hNode) return;
@@ -136,7 +241,7 @@ static void loadDTWeakHypothesis(xmlNodePtr hNode, vector<float> & predictTable)
 }
 
 
-static void loadLRDClassifier(xmlNodePtr stages, TClassifier * classifier);
+static bool loadLRDClassifier(xmlNodePtr stages, TClassifier * classifier);
 
 
 TClassifier * loadClassifier(xmlNodePtr);
@@ -228,6 +333,14 @@ static ClassifierType determineClassifierType(xmlNodePtr classifierRoot)
     {
         return LBP;
     }
+    if (tp == string("MBLBP"))
+    {
+        return MBLBP;
+    }
+    if (tp == string("HAAR"))
+    {
+        return HAAR;
+    }
     // No 'type' specified, try to determine by classifier content
 
     map<string, int> elements;
@@ -236,6 +349,11 @@ static ClassifierType determineClassifierType(xmlNodePtr classifierRoot)
     knownTypes["LRDFeature"] = LRD;
     knownTypes["LRP"] = LRP;
     knownTypes["LBPFeature"] = LBP;
+    knownTypes["MBLBPFeature"] = MBLBP;
+    for (int i = 0; i < numHaarTypes; ++i)
+    {
+        knownTypes[haar_feature_names[i]] = HAAR;
+    }
 
     // Enumerate elements used in the classifier
     stack<xmlNodePtr> s;
@@ -304,7 +422,11 @@ TClassifier * loadClassifier(xmlNodePtr classifierRoot)
 
     classifier->tp = determineClassifierType(classifierRoot);
 
-    loadLRDClassifier(classifierRoot->children, classifier);
+    if (!loadLRDClassifier(classifierRoot->children, classifier))
+    {
+        release_classifier(&classifier);
+        return 0;
+    }
 
     /*
     cerr << "Classifier info:" << endl;
@@ -319,10 +441,11 @@ TClassifier * loadClassifier(xmlNodePtr classifierRoot)
 
 // LRD/LRP/LBP specific stuff
 
-static void loadLRDClassifier(xmlNodePtr stages, TClassifier * classifier)
+static bool loadLRDClassifier(xmlNodePtr stages, TClassifier * classifier)
 {
     vector<TStage> tmpStages;
     vector< vector<float> > tmpPredict;
+    int errors = 0;
     
     for (xmlNodePtr node = stages; node; node = node->next)
     {
@@ -366,11 +489,18 @@ static void loadLRDClassifier(xmlNodePtr stages, TClassifier * classifier)
             {
                 if (classifier->tp == LRD || classifier->tp == LRP)
                     loadLRDFeature(hypothesisNode, &stage);
-                if (classifier->tp == LBP)
+                if (classifier->tp == LBP || classifier->tp == MBLBP)
                     loadLBPFeature(hypothesisNode, &stage);
+                if (classifier->tp == HAAR && !loadHaarFeature(hypothesisNode, &stage))
+                {
+                    cerr << "Unknown Haar feature in stage " << tmpStages.size() << endl;
+                    ++errors;
+                }
             }
-            if (stage.w > 2 || stage.h > 2)
+            if (stage.w > 4 || stage.h > 4)
                 classifier->fsz = FSZ_UNRESTRICTED;
+            else if ((stage.w > 2 || stage.h > 2) && classifier->fsz == FSZ_2x2)
+                classifier->fsz = FSZ_4x4;
             //cout << stage.x << ";" << stage.y << "]" << endl;
             tmpStages.push_back(stage);
         }
@@ -383,37 +513,45 @@ static void loadLRDClassifier(xmlNodePtr stages, TClassifier * classifier)
     if (classifier->tp == LRD) classifier->alpha_count = 17;
     if (classifier->tp == LRP) classifier->alpha_count = 100;
     if (classifier->tp == LBP) classifier->alpha_count = 256;
+    if (classifier->tp == MBLBP) classifier->alpha_count = 256;
+    if (classifier->tp == HAAR && !tmpPredict.empty()) classifier->alpha_count = tmpPredict[0].size(); // one alpha per bin
     assert(classifier->alpha_count > 0);
     classifier->threshold = 0.0f;
 
+    if (classifier->tp == HAAR && classifier->alpha_count > HAAR_MAX_BINS)
+    {
+        cerr << "Too many bins of Haar features (" << classifier->alpha_count << ", at most " << HAAR_MAX_BINS << ")" << endl;
+        ++errors;
+    }
+
     classifier->stage = new TStage[tmpStages.size()];
     classifier->alpha = new float[tmpStages.size() * classifier->alpha_count];
     classifier->ranks = new int[8 * tmpStages.size()]; // Alloc always or only in necessary cases (LRD, LRP)?
     fill(classifier->ranks, classifier->ranks + 8*tmpStages.size(), 0);
 
-    int errors = 0;
-
     for (unsigned s = 0; s < tmpStages.size(); ++s)
     {
         ((TStage*)(classifier->stage))[s] = tmpStages[s];
+        // All stages must have the same number of alphas
         if (tmpPredict[s].size() != classifier->alpha_count)
         {
-            cout << tmpPredict[s].size() << endl;
+            cerr << "Stage " << s << " has " << tmpPredict[s].size() << " alphas, expected " << classifier->alpha_count << endl;
             ++errors;
+            continue;
         }
         float * dstAlpha = classifier->alpha + classifier->alpha_count * s;
 
         copy(tmpPredict[s].begin(), tmpPredict[s].end(), dstAlpha);
     }
 
-    // TODO ALPHA rearrangement for LRP
+    // Alphas are re-packed for the engines by init_classifier
 
     if (errors)
     {
         cerr << "Cannot load the classifier (" << errors << " errors occured)." << endl;
-        release_classifier(&classifier);
-        return;
+        return false;
     }
+    return true;
 }
 
 
@@ -423,11 +561,14 @@ const char *const classifierTypeStrings[] = {
     "LRD",
     "LRP",
     "LBP",
+    "MBLBP",
+    "HAAR",
 };
 
 const char *const fsz_string[] = {
     "FSZ_UNRESTRICTED",
     "FSZ_2x2",
+    "FSZ_4x4",
 };
 
 
@@ -513,6 +654,7 @@ void export_classifier_source(TClassifier * c, ostream & str, const char * name,
             showpoint << fixed << setprecision(8)<< stg.theta_b << ", " <<
             "_alphas_" << name << "+" << s*c->alpha_count << ", " << // alpha
             0 << ", " << 0 << ", " << 0 << ", " << // conv, code
+            stg.f_min << ", " << stg.f_max << ", " << // discretization (HAAR)
             "},\n"; // szType, posType
     }
     str << "};\n\n" << flush;
@@ -529,3 +671,51 @@ void export_classifier_source(TClassifier * c, ostream & str, const char * name,
 }
 
 
+
+void export_classifier_XML(TClassifier * c, ostream & str, const char * name)
+{
+    if (c->tp == UNKNOWN)
+    {
+        str << "<!-- UNKNOWN CLASSIFIER -->\n";
+        return;
+    }
+
+    const char * feature_name = (c->tp == LBP) ? "LBPFeature" : (c->tp == MBLBP) ? "MBLBPFeature" : (c->tp == LRP) ? "LRP" : "LRDFeature";
+
+    str << "<WaldBoostClassifier classifierName=\"" << name << "\" type=\"" << classifierTypeStrings[c->tp] << "\" ";
+    str << "imageSizeX=\"" << c->width << "\" imageSizeY=\"" << c->height << "\">\n";
+
+    float * alpha = c->alpha;
+    for (unsigned s = 0; s < c->stage_count; ++s, alpha += c->alpha_count)
+    {
+        const TStage & stg = c->stage[s];
+        str << "  <stage negT=\"" << setprecision(9) << stg.theta_b << "\">\n";
+        str << "    <HistogramWeakHypothesis predictionValues=\"";
+        for (unsigned a = 0; a < c->alpha_count; ++a)
+        {
+            str << alpha[a] << " ";
+        }
+        str << "\">\n";
+        if (c->tp == HAAR)
+        {
+            str << "      <TCont2DiscFeature minValue=\"" << stg.f_min << "\" maxValue=\"" << stg.f_max << "\" ";
+            str << "numberOfBins=\"" << c->alpha_count << "\">\n";
+            str << "        <" << haar_feature_names[int(stg.A) % numHaarTypes] << " positionX=\"" << stg.x << "\" positionY=\"" << stg.y << "\" ";
+            str << "blockWidth=\"" << stg.w << "\" blockHeight=\"" << stg.h << "\"/>\n";
+            str << "      </TCont2DiscFeature>\n";
+            str << "    </HistogramWeakHypothesis>\n";
+            str << "  </stage>\n";
+            continue;
+        }
+        str << "      <" << feature_name << " positionX=\"" << stg.x << "\" positionY=\"" << stg.y << "\" ";
+        if (c->tp != LBP && c->tp != MBLBP)
+        {
+            str << "blockA=\"" << int(stg.A) << "\" blockB=\"" << int(stg.B) << "\" ";
+        }
+        str << "blockWidth=\"" << stg.w << "\" blockHeight=\"" << stg.h << "\"/>\n";
+        str << "    </HistogramWeakHypothesis>\n";
+        str << "  </stage>\n";
+    }
+
+    str << "</WaldBoostClassifier>" << endl;
+}
@@ -1,31 +1,200 @@
 #include "core.h"
 #include "const.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
 #include <vector>
 #include <cstdio>
+#include <cstring>
 
 using namespace std;
 
-// Shuffle alphas for LRP
+/// Number of alpha table items per stage (multiple of ALPHA_ALIGN).
+static unsigned alpha_table_stride(ClassifierType tp)
+{
+    switch (tp)
+    {
+    case LRD: return 32;                // 17 used
+    case LRP: return LRP_ROW * 10;      // 16 * 9 + 9 + 1 used
+    case LBP: return 256;
+    case MBLBP: return 256;
+    case HAAR: return HAAR_MAX_BINS;
+    default: return 0;
+    }
+}
+
+/// Grid of the Haar features (cells in each direction)
+static const int haar_grid[numHaarTypes][2] = {
+    {2, 1}, // DH
+    {1, 2}, // DV
+    {3, 1}, // TH
+    {1, 3}, // TV
+    {2, 2}, // DIAG
+    {3, 3}, // SRND
+};
+
+/// Normalisation of the Haar features
+static const int haar_norm[numHaarTypes] = { 1, 1, 2, 2, 2, 8 };
+
+/// Weights of the cells of the Haar features (row by row)
+static const int haar_weights[numHaarTypes][9] = {
+    {-1,  1},
+    {-1,  1},
+    { 1, -2,  1},
+    { 1, -2,  1},
+    { 1, -1, -1,  1},
+    { 1,  1,  1,  1, -8,  1,  1,  1,  1},
+};
+
+/// Weight of a cell, zero outside of the grid.
+static int haar_weight(int tp, int i, int j)
+{
+    const int xs = haar_grid[tp][0], ys = haar_grid[tp][1];
+    if (i < 0 || j < 0 || i >= xs || j >= ys)
+        return 0;
+    return haar_weights[tp][j * xs + i];
+}
+
+/// Corner weights and discretization of HAAR stages.
+/// Corner (i,j) of the grid collects weights of the four cells touching it
+/// so each feature is evaluated from at most 16 integral image items.
+static void init_haar_bunches(TClassifier * c)
+{
+    const unsigned bunches = (c->stage_count + 15) / 16;
+    for (unsigned b = 0; b < bunches; ++b)
+    {
+        THaarBunch & h = c->haar[b];
+        h.corners = 0;
+        for (unsigned i = 0; i < 16 && 16 * b + i < c->stage_count; ++i)
+        {
+            const TStage & stg = c->stage[16 * b + i];
+            const int tp = min<unsigned>(stg.A, numHaarTypes - 1);
+            const int xs = haar_grid[tp][0], ys = haar_grid[tp][1];
+            int k = 0;
+            for (int cy = 0; cy <= ys; ++cy)
+            {
+                for (int cx = 0; cx <= xs; ++cx, ++k)
+                {
+                    h.coef[k][i] = haar_weight(tp, cx-1, cy-1) - haar_weight(tp, cx, cy-1)
+                                 - haar_weight(tp, cx-1, cy) + haar_weight(tp, cx, cy);
+                }
+            }
+            h.corners = max(h.corners, k);
+
+            const float range = (stg.f_max > stg.f_min) ? stg.f_max - stg.f_min : 1.0f;
+            const float bins = float(c->alpha_count - 1) / range;
+            h.scale[i] = bins / (haar_norm[tp] * stg.w * stg.h);
+            h.shift[i] = 0.5f - stg.f_min * bins;
+        }
+    }
+}
+
+/// Integral image offsets of the Haar corners for the row size of the image.
+static void prepare_haar_bunches(TClassifier * c, int row)
+{
+    const unsigned bunches = (c->stage_count + 15) / 16;
+    for (unsigned b = 0; b < bunches; ++b)
+    {
+        THaarBunch & h = c->haar[b];
+        for (unsigned i = 0; i < 16 && 16 * b + i < c->stage_count; ++i)
+        {
+            const TStage & stg = c->stage[16 * b + i];
+            const int tp = min<unsigned>(stg.A, numHaarTypes - 1);
+            const int xs = haar_grid[tp][0], ys = haar_grid[tp][1];
+            int k = 0;
+            for (int cy = 0; cy <= ys; ++cy)
+            {
+                for (int cx = 0; cx <= xs; ++cx, ++k)
+                {
+                    h.offset[k][i] = (stg.y + cy * stg.h) * row + stg.x + cx * stg.w;
+                }
+            }
+        }
+    }
+}
+
+/// Re-pack alphas of one stage to the engine layout.
+static void pack_alphas(ClassifierType tp, const float * src, unsigned count, float * dst)
+{
+    if (tp == LRP)
+    {
+        for (unsigned i = 0; i < count; ++i)
+        {
+            // Source index is rankA + 10 * rankB
+            dst[LRP_ROW * (i % 10) + (i / 10)] = src[i];
+        }
+    }
+    else
+    {
+        copy(src, src + count, dst);
+    }
+}
+
 int init_classifier(TClassifier* c)
 {
-    float * stg_alpha = c->alpha;
+    const unsigned stride = alpha_table_stride(c->tp);
+    assert(stride * sizeof(float) % ALPHA_ALIGN == 0);
+    assert(c->alpha_count <= stride); // checked by the loader
+
+    // Padding allows the bunch engines to look up 16 stages from any stage
+    const unsigned table_stages = c->stage_count + 15;
+
+    if (c->alpha_table)
+    {
+        free(c->alpha_table);
+        c->alpha_table = 0;
+    }
+
+    if (c->haar)
+    {
+        free(c->haar);
+        c->haar = 0;
+    }
+
+    void * table = 0;
+    if (stride == 0 || posix_memalign(&table, ALPHA_ALIGN, table_stages * stride * sizeof(float)) != 0)
+        return 0;
+
+    c->alpha_stride = stride;
+    c->alpha_table = (float*)table;
+    fill(c->alpha_table, c->alpha_table + table_stages * stride, 0.0f);
 
-    for (unsigned s = 0; s < c->stage_count; ++s, stg_alpha += c->alpha_count)
+    int conv_4x4 = 1;
+
+    for (unsigned s = 0; s < c->stage_count; ++s)
     {
         TStage* const stage = c->stage + s;
 
-        if (stage->w > 2 || stage->h > 2)
-            return 0;
+        stage->alpha = c->alpha_table + s * stride;
+        pack_alphas(c->tp, c->alpha + s * c->alpha_count, c->alpha_count, stage->alpha);
 
-        // get feature type
-        // 000000hw
-        stage->alpha = stg_alpha;
-        stage->sz_type = ((stage->h-1) << 1) | (stage->w-1);
         stage->pos_type = ((stage->y & 0x03) << 2) | (stage->x & 0x03);
         stage->offset = 0;
+
+        if (stage->w > 4 || stage->h > 4)
+        {
+            conv_4x4 = 0;
+            continue;
+        }
+
+        // get feature type
+        // 000000hw for blocks up to 2x2
+        stage->sz_type = conv_plane(stage->w, stage->h);
     }
 
-    return 1;
+    if (c->tp == HAAR)
+    {
+        // Padding stages of the last bunch have zero weights
+        const unsigned bunches = (c->stage_count + 15) / 16;
+        void * haar = 0;
+        if (posix_memalign(&haar, 16, bunches * sizeof(THaarBunch)) != 0)
+            return 0;
+        c->haar = (THaarBunch*)haar;
+        memset(c->haar, 0, bunches * sizeof(THaarBunch));
+        init_haar_bunches(c);
+    }
+
+    return conv_4x4;
 }
 
 
@@ -54,6 +223,11 @@ void prepare_classifier(TClassifier * c, PreprocessedImage * PI, int options)
             TStage * stage = (TStage*)c->stage + s;
             stage->offset = stage->y * img->widthStep + (stage->x * px_sz);
         }
+
+        if (c->haar && (options & OFFSET_INTEGRAL))
+        {
+            prepare_haar_bunches(c, img->widthStep / sizeof(int));
+        }
     }
 
     if (options & RECALC_RANKS)
@@ -65,6 +239,9 @@ void prepare_classifier(TClassifier * c, PreprocessedImage * PI, int options)
             const TStage & stage = c->stage[s];
             int * ranks = c->ranks + 8 * s;
 
+            if (stage.sz_type >= CONV_PLANES) // no 'iconv' planes
+                continue;
+
             for (int t = 0; t < 4; ++t)
             {
                 int & A = ranks[2 * t + 0];
@@ -14,7 +14,7 @@
  *  'Simple' classifier evaluation engine. This engine uses intensity or
  *  integral image to evaluate classifier. It can be used as reference but it
  *  is _very_ slow. There are no size restrictions on features used.  It
- *  supports monolithic classifiers with LRD, LRP or LBP features.
+ *  supports monolithic classifiers with LRD, LRP, LBP or MB-LBP features.
  *
  */
 
@@ -223,9 +223,11 @@ float eval_lrp_stage_simple(IplImage * image, unsigned offset, TStage * stg, int
 
     calc_ranks_2(values, 9, stg->A, stg->B, &countA, &countB);
 
+    // The source alpha index is countA + 10 * countB (as in the legacy engine),
+    // init_classifier packs it to LRP_ROW * countA + countB
     *feature = countA + 10 * countB;
 
-    return stg->alpha[*feature];
+    return stg->alpha[LRP_ROW * countA + countB];
 }
 
 
@@ -329,6 +331,7 @@ static ClassifierEvalFunc get_eval_func(TClassifier * c, ImType tp)
         switch (c->tp)
         {
         case LBP:
+        case MBLBP:
             eval = eval_classifier_simple< eval_lbp_stage_simple<sum_3x3_regions_intensity>, IMG_INTENSITY>;
             break;
         case LRP:
@@ -346,6 +349,7 @@ static ClassifierEvalFunc get_eval_func(TClassifier * c, ImType tp)
         switch (c->tp)
         {
         case LBP:
+        case MBLBP:
             eval = eval_classifier_simple< eval_lbp_stage_simple<sum_3x3_regions_integral>, IMG_INTEGRAL>;
             break;
         case LRP:
@@ -412,16 +416,26 @@ int scan_image_integral(PreprocessedImage * PI, TClassifier * c, ScanParams * sp
     return scan_image_simple(PI, c, sp, first, last, hist, IMG_INTEGRAL);
 }
 
+ClassifierEvalFunc get_eval_func_intensity(TClassifier * c)
+{
+    return get_eval_func(c, IMG_INTENSITY);
+}
+
+ClassifierEvalFunc get_eval_func_integral(TClassifier * c)
+{
+    return get_eval_func(c, IMG_INTEGRAL);
+}
+
 int is_classifier_supported_intensity(const TClassifier * c)
 {
-    if (c->tp == LBP || c->tp == LRP || c->tp == LRD)
+    if (c->tp == LBP || c->tp == LRP || c->tp == LRD || c->tp == MBLBP)
         return 1;
     return 0;
 }
 
 int is_classifier_supported_integral(const TClassifier * c)
 {
-    if (c->tp == LBP || c->tp == LRP || c->tp == LRD)
+    if (c->tp == LBP || c->tp == LRP || c->tp == LRD || c->tp == MBLBP)
         return 1;
     return 0;
 }
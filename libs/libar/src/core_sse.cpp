@@ -1,9 +1,3 @@
-//
-// TODO
-// * LRP
-// ** Preskladani alf v klasifikatoru 10*countA+countB -> 16 * countA + countB
-// ** Debug kodu
-
 // OpenCV for image representation
 #include <cv.h>
 #include <highgui.h>
@@ -15,6 +9,8 @@
 #include <mmintrin.h>
 #include <pmmintrin.h>
 #include <emmintrin.h>
+#include <smmintrin.h>
+#include <immintrin.h>
 
 #include "core.h"
 #include "core_sse.h"
@@ -215,236 +211,205 @@ static inline __attribute__((const,always_inline)) __m128i eval_lrp_16(const __m
     sumB = _mm_add_epi8(sumB, _mm_and_si128(_mm_cmpgt_epi8(B, data[7]), ones.q));
     sumB = _mm_add_epi8(sumB, _mm_and_si128(_mm_cmpgt_epi8(B, data[8]), ones.q));
     
-    sumA = _mm_slli_si128(sumA, 4); // 16 * A + B more simple then 10 * A + B
+    sumA = _mm_slli_epi16(sumA, 4); // LRP_ROW * A + B, ranks < 16 so bytes do not overflow
     
     return _mm_add_epi8(sumA, sumB);
 }
 
-// This evaluates classifier on a preprocessed image
-// * The image is pre-convolved, NOT interleaved convolution!
-// * The evaluation proceeds in bunches of 16 weak classifiers
-// Properties:
-// * Faster than 16 separate evaluations
-// * Better for later stages of classification
-// * Not good for first stages as waldboost may stop evaluation earlier 
-static int eval_classifier_lbp_bunch16(PreprocessedImage * PI, TClassifier * c, int x, int y, unsigned begin, unsigned end, int * features, float * hypotheses, float * response, int * stages)
+/// Look up alphas of up to 8 consecutive stages.
+/// Tables of consecutive stages follow each other with 'stride' items
+/// (see init_classifier).
+/// \param table Alpha table of the first stage
+/// \param stride Items per stage (c->alpha_stride)
+/// \param count Number of stages to look up (1 to 8), other lanes are not loaded
+/// \param idx Feature values of the stages
+/// \param hypotheses Alphas of the stages
+typedef void (*LookupAlphasFunc)(const float * table, unsigned stride, int count, const unsigned char * idx, float * hypotheses);
+
+static void lookup_alphas_8_scalar(const float * table, unsigned stride, int count, const unsigned char * idx, float * hypotheses)
 {
-    end = min(end, c->stage_count);
-    int mod_pos = get_mod_position(x, y);
-    TStage * s;
-    int bunch_begin = begin;
-    for (s = c->stage+begin; s < c->stage+end; s += 16, bunch_begin += 16)
+    for (int i = 0; i < count; ++i, table += stride)
     {
-        int valid_stages = std::min<unsigned long>(c->stage_count - (s - c->stage), 16u);
-        // Load data
-        int128 feature_data[9];
+        hypotheses[i] = table[idx[i]];
+    }
+}
 
-        for (int i = 0; i < valid_stages; ++i) // feature idx
-        {
-            TStage * stg = s + i;
-            IplImage * conv = &(PI->conv[(int)stg->sz_type]);
-            
-            int table_idx = (stg->sz_type << 8) | mod_pos | stg->pos_type;
-
-            int abs_x = x + stg->x;
-            int abs_y = y + stg->y;
-            int pos_x = abs_x / stg->w;
-            int pos_y = abs_y / stg->h;
-
-            //select block and mask
-            // May use blockTable[szType]
-            //int mod_x = abs_x & (stg->w-1);
-            //int mod_y = abs_y & (stg->h-1);
-            //int block = ((stg->w) * mod_y) + mod_x;
-            int block = block_table[table_idx];
-
-            //cerr << "w=" << stg->w << ", h=" << stg->h << ", block=" << block << endl;
-            
-            char * base = (char*)(conv->imageData + block * PI->cblock_size[(int)stg->sz_type]) + (pos_y * conv->widthStep) + pos_x;
-            feature_data[0].i8[i] = *(base + 0);
-            feature_data[1].i8[i] = *(base + 1);
-            feature_data[2].i8[i] = *(base + 2);
-            base += conv->widthStep;
-            feature_data[3].i8[i] = *(base + 0);
-            feature_data[4].i8[i] = *(base + 1);
-            feature_data[5].i8[i] = *(base + 2);
-            base += conv->widthStep;
-            feature_data[6].i8[i] = *(base + 0);
-            feature_data[7].i8[i] = *(base + 1);
-            feature_data[8].i8[i] = *(base + 2);
-        }
-        // xor after loading?
+// Built for AVX2 regardless of the compiler flags, used only when the CPU has it
+static __attribute__((target("avx2"))) void lookup_alphas_8_avx2(const float * table, unsigned stride, int count, const unsigned char * idx, float * hypotheses)
+{
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(count), lane);
+    const __m256i offsets = _mm256_mullo_epi32(lane, _mm256_set1_epi32(stride));
+    const __m256i i8 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)idx));
+    const __m256 alphas = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), table, _mm256_add_epi32(offsets, i8), _mm256_castsi256_ps(mask), sizeof(float));
+    _mm256_maskstore_ps(hypotheses, mask, alphas);
+}
 
-        // Eval all 16 features using SIMD
-        __m128i responses = eval_lbp_16((__m128i*)feature_data);
-        _mm_empty();
-        
-        // Eval weak classifiers
-        unsigned char * lbp = (unsigned char*)(&responses);
+static LookupAlphasFunc select_lookup_alphas()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? lookup_alphas_8_avx2 : lookup_alphas_8_scalar;
+}
 
-        TStage * stg = s;
-        int stg_idx = bunch_begin;
-        while(stg != s + valid_stages)
-        {
-            features[stg_idx] = *lbp;
-            hypotheses[stg_idx] = stg->alpha[*lbp];
-            *response += hypotheses[stg_idx];
-            //fprintf(stderr, "[%d,%f] ", features[stg_idx], hypotheses[stg_idx]);
+/// Alpha lookup of the bunch engines, selected by the CPU when the library is loaded.
+/// The engines look up a bunch in halves of 8 stages and the second half only
+/// when the window was not rejected in the first one.
+static const LookupAlphasFunc lookup_alphas_8 = select_lookup_alphas();
 
-            if (*response < stg->theta_b)
-            {
-                *stages += stg_idx - begin + 1;
-                //fprintf(stderr, "\n");
-                return 0;
-            }
-            ++stg, ++lbp, ++stg_idx;
-        }
-    }
+/// Offset of the top-left block of a stage in its convolution plane (and rank planes).
+/// Works with both TStage and TStageQ (same field names). Blocks up to 2x2 use the
+/// constant tables, larger blocks (PP_CONV_4x4 planes) calculate the block directly.
+template <typename Stage>
+static inline __attribute__((always_inline)) int conv_offset(PreprocessedImage * PI, const Stage * stg, int x, int y, int mod_pos)
+{
+    const int abs_x = x + stg->x;
+    const int abs_y = y + stg->y;
+    const int pos_x = abs_x / stg->w;
+    const int pos_y = abs_y / stg->h;
 
-    *stages += end - begin;
-    //fprintf(stderr, "\n");
-    return 1;
+    //select block
+    const int block = (stg->sz_type < CONV_PLANES)
+        ? block_table[(stg->sz_type << 8) | mod_pos | stg->pos_type]
+        : (abs_y % stg->h) * stg->w + (abs_x % stg->w);
+
+    return block * PI->cblock_size[(int)stg->sz_type] + (pos_y * PI->conv[(int)stg->sz_type].widthStep) + pos_x;
 }
 
+/// Load 3x3 block neighbourhoods of a bunch of 16 stages from the convolution planes.
+template <typename Stage>
+static inline __attribute__((always_inline)) void load_bunch16(PreprocessedImage * PI, const Stage * s, int valid_stages, int x, int y, int mod_pos, int128 * feature_data)
+{
+    for (int i = 0; i < valid_stages; ++i) // feature idx
+    {
+        const Stage * const stg = s + i;
+        const IplImage * const conv = &(PI->conv[(int)stg->sz_type]);
+
+        const char * base = conv->imageData + conv_offset(PI, stg, x, y, mod_pos);
+        feature_data[0].i8[i] = *(base + 0);
+        feature_data[1].i8[i] = *(base + 1);
+        feature_data[2].i8[i] = *(base + 2);
+        base += conv->widthStep;
+        feature_data[3].i8[i] = *(base + 0);
+        feature_data[4].i8[i] = *(base + 1);
+        feature_data[5].i8[i] = *(base + 2);
+        base += conv->widthStep;
+        feature_data[6].i8[i] = *(base + 0);
+        feature_data[7].i8[i] = *(base + 1);
+        feature_data[8].i8[i] = *(base + 2);
+    }
+}
 
-static int eval_classifier_lrd_bunch16(PreprocessedImage * PI, TClassifier * c, int x, int y, unsigned begin, unsigned end, int * features, float * hypotheses, float * response, int * stages)
+/// Select values of blocks A and B of each stage from loaded bunch.
+template <typename Stage>
+static inline __attribute__((always_inline)) void select_ab_bunch16(const Stage * s, int valid_stages, const int128 * feature_data, int128 & A, int128 & B)
 {
-    end = min(end, c->stage_count);
-    int mod_pos = get_mod_position(x, y);
-    TStage* s;
-    int bunch_begin = begin;
-    for (s = c->stage+begin; s < c->stage+end; s += 16, bunch_begin += 16)
+    for (int i = 0; i < valid_stages; ++i)
     {
-        int valid_stages = std::min<unsigned long>(c->stage_count - (s - c->stage), 16u);
-        // Load data
-        int128 feature_data[9], A, B;
+        A.u8[i] = feature_data[(int)s[i].A].u8[i];
+        B.u8[i] = feature_data[(int)s[i].B].u8[i];
+    }
+}
 
-        for (int i = 0; i < valid_stages; ++i) // feature idx
-        {
-            TStage* const stg = s + i;
-            IplImage* const conv = &(PI->conv[(int)stg->sz_type]);
-            
-            int table_idx = (stg->sz_type << 8) | mod_pos | stg->pos_type;
-            int abs_x = x + stg->x;
-            int abs_y = y + stg->y;
-            int pos_x = abs_x / stg->w;
-            int pos_y = abs_y / stg->h;
-            int block = block_table[table_idx];
-
-            const char* base = (char*)(conv->imageData + block * PI->cblock_size[(int)stg->sz_type]) + (pos_y * conv->widthStep) + pos_x;
-            
-	    feature_data[0].i8[i] = *(base + 0);// ^ 0x80;
-            feature_data[1].i8[i] = *(base + 1);// ^ 0x80;
-            feature_data[2].i8[i] = *(base + 2);// ^ 0x80;
-
-	    base += conv->widthStep;
-            feature_data[3].i8[i] = *(base + 0);// ^ 0x80;
-            feature_data[4].i8[i] = *(base + 1);// ^ 0x80;
-            feature_data[5].i8[i] = *(base + 2);// ^ 0x80;
-            
-	    
-	    base += conv->widthStep;
-            feature_data[6].i8[i] = *(base + 0);// ^ 0x80;
-            feature_data[7].i8[i] = *(base + 1);// ^ 0x80;
-            feature_data[8].i8[i] = *(base + 2);// ^ 0x80;
-            A.u8[i] = feature_data[(int)stg->A].u8[i];
-            B.u8[i] = feature_data[(int)stg->B].u8[i];
-        }
+/// Feature values (alpha table indices) of a bunch of 16 LBP stages.
+template <typename Stage>
+static inline __m128i lbp_features_16(PreprocessedImage * PI, const Stage * s, int valid_stages, int x, int y, int mod_pos)
+{
+    int128 feature_data[9];
+    load_bunch16(PI, s, valid_stages, x, y, mod_pos, feature_data);
+    // xor after loading?
+    return eval_lbp_16((__m128i*)feature_data);
+}
 
-        // Eval all 16 features using SIMD
-        __m128i responses = eval_lrd_16((__m128i*)feature_data, A.q, B.q);
-        _mm_empty();
-        
-        // Eval weak classifiers
-        unsigned char * lbp = (unsigned char*)(&responses);
+/// Feature values (alpha table indices) of a bunch of 16 LRD stages.
+template <typename Stage>
+static inline __m128i lrd_features_16(PreprocessedImage * PI, const Stage * s, int valid_stages, int x, int y, int mod_pos)
+{
+    int128 feature_data[9], A, B;
+    load_bunch16(PI, s, valid_stages, x, y, mod_pos, feature_data);
+    select_ab_bunch16(s, valid_stages, feature_data, A, B);
+    return eval_lrd_16((__m128i*)feature_data, A.q, B.q);
+}
 
-        const TStage* stg = s;
-        int stg_idx = bunch_begin;
-        while(stg != s + valid_stages)
-        {
-            features[stg_idx] = *lbp;
-            hypotheses[stg_idx] = stg->alpha[*lbp];
-            *response += hypotheses[stg_idx];
-            //fprintf(stderr, "[%d,%f] ", features[stg_idx], hypotheses[stg_idx]);
+/// Feature values (alpha table indices) of a bunch of 16 LRP stages.
+template <typename Stage>
+static inline __m128i lrp_features_16(PreprocessedImage * PI, const Stage * s, int valid_stages, int x, int y, int mod_pos)
+{
+    int128 feature_data[9], A, B;
+    load_bunch16(PI, s, valid_stages, x, y, mod_pos, feature_data);
+    select_ab_bunch16(s, valid_stages, feature_data, A, B);
+    // Sign bit is already inverted in the convolution planes (as for LRD)
+    return eval_lrp_16((__m128i*)feature_data, A.q, B.q);
+}
 
-            if (*response < stg->theta_b)
-            {
-                *stages += stg_idx - begin + 1;
-                //fprintf(stderr, "\n");
-                return 0;
-            }
-            ++stg, ++lbp, ++stg_idx;
-        }
+/// Feature values of a bunch of 16 LRD stages from the rank planes (PP_RANK).
+template <typename Stage>
+static inline __m128i lrd_rank_features_16(PreprocessedImage * PI, const Stage * s, int valid_stages, int x, int y, int mod_pos)
+{
+    int128 f = {{0}};
+    for (int i = 0; i < valid_stages; ++i)
+    {
+        const Stage * const stg = s + i;
+        const int sz_type = stg->sz_type;
+        const unsigned char * rank = (unsigned char*)PI->rank[sz_type].imageData + conv_offset(PI, stg, x, y, mod_pos);
+        f.u8[i] = 8 + rank[stg->A * PI->rplane_size[sz_type]] - rank[stg->B * PI->rplane_size[sz_type]];
     }
+    return f.q;
+}
 
-    *stages += end - begin;
-    //fprintf(stderr, "\n");
-    return 1;
+/// Feature values of a bunch of 16 LRP stages from the rank planes (PP_RANK).
+template <typename Stage>
+static inline __m128i lrp_rank_features_16(PreprocessedImage * PI, const Stage * s, int valid_stages, int x, int y, int mod_pos)
+{
+    int128 f = {{0}};
+    for (int i = 0; i < valid_stages; ++i)
+    {
+        const Stage * const stg = s + i;
+        const int sz_type = stg->sz_type;
+        const unsigned char * rank = (unsigned char*)PI->rank[sz_type].imageData + conv_offset(PI, stg, x, y, mod_pos);
+        f.u8[i] = LRP_ROW * rank[stg->A * PI->rplane_size[sz_type]] + rank[stg->B * PI->rplane_size[sz_type]];
+    }
+    return f.q;
 }
 
-static int eval_classifier_lrp_bunch16(PreprocessedImage * PI, TClassifier * c, int x, int y, unsigned begin, unsigned end, int * features, float * hypotheses, float * response, int * stages)
+typedef __m128i (*BunchFeatureFunc)(PreprocessedImage * PI, const TStage * s, int valid_stages, int x, int y, int mod_pos);
+
+// This evaluates classifier on a preprocessed image
+// * The image is pre-convolved, NOT interleaved convolution!
+// * The evaluation proceeds in bunches of 16 weak classifiers
+// Properties:
+// * Faster than 16 separate evaluations
+// * Better for later stages of classification
+// * Not good for first stages as waldboost may stop evaluation earlier 
+template <BunchFeatureFunc features16>
+static int eval_classifier_bunch16(PreprocessedImage * PI, TClassifier * c, int x, int y, unsigned begin, unsigned end, int * features, float * hypotheses, float * response, int * stages)
 {
     end = min(end, c->stage_count);
     const int mod_pos = get_mod_position(x, y);
-    TStage* s = 0;
+    const TStage * s = 0;
     int bunch_begin = begin;
     for (s = c->stage+begin; s < c->stage+end; s += 16, bunch_begin += 16)
     {
         const int valid_stages = std::min<unsigned long>(c->stage_count - (s - c->stage), 16u);
-	
-        // Load data
-        int128 feature_data[9], A, B;
-
-        for (int i = 0; i < valid_stages; ++i) // feature idx
-        {
-            const TStage* const stg = s + i;
-            const IplImage* const conv = &(PI->conv[(int)stg->sz_type]);
-            
-            const int table_idx = (stg->sz_type << 8) | mod_pos | stg->pos_type;
-            const int abs_x = x + stg->x;
-            const int abs_y = y + stg->y;
-            const int pos_x = abs_x / stg->w;
-            const int pos_y = abs_y / stg->h;
-            const int block = block_table[table_idx];
-
-            const char* base = (char*)(conv->imageData + block * PI->cblock_size[(int)stg->sz_type]) + (pos_y * conv->widthStep) + pos_x;
-            feature_data[0].i8[i] = *(base + 0);// ^ 0x80;
-            feature_data[1].i8[i] = *(base + 1);// ^ 0x80;
-            feature_data[2].i8[i] = *(base + 2);// ^ 0x80;
-            
-	    base += conv->widthStep;
-            feature_data[3].i8[i] = *(base + 0);// ^ 0x80;
-            feature_data[4].i8[i] = *(base + 1);// ^ 0x80;
-            feature_data[5].i8[i] = *(base + 2);// ^ 0x80;
-            
-	    base += conv->widthStep;
-            feature_data[6].i8[i] = *(base + 0);// ^ 0x80;
-            feature_data[7].i8[i] = *(base + 1);// ^ 0x80;
-            feature_data[8].i8[i] = *(base + 2);// ^ 0x80;
-            
-	    A.u8[i] = feature_data[(int)stg->A].u8[i];
-            B.u8[i] = feature_data[(int)stg->B].u8[i];
-        }
-        // xor after loading?
-        // xor during PP?
-        for (int i = 0; i < 9; ++i) // will be unrolled?
-	{
-	  feature_data[i].q = _mm_xor_si128(feature_data[i].q, sign_bit.q);
-	}
 
         // Eval all 16 features using SIMD
-        __m128i responses = eval_lrp_16((__m128i*)feature_data, A.q, B.q);
+        __m128i responses = features16(PI, s, valid_stages, x, y, mod_pos);
         _mm_empty();
-        
+
         // Eval weak classifiers
-        const unsigned char* lbp = (unsigned char*)(&responses);
+        const unsigned char * lbp = (unsigned char*)(&responses);
+        float alphas[16];
 
-        const TStage* stg = s;
+        const TStage * stg = s;
         int stg_idx = bunch_begin;
         while(stg != s + valid_stages)
         {
+            const int lane = stg - s;
+            if ((lane & 7) == 0)
+            {
+                lookup_alphas_8(stg->alpha, c->alpha_stride, std::min(valid_stages - lane, 8), lbp, alphas + lane);
+            }
             features[stg_idx] = *lbp;
-            hypotheses[stg_idx] = stg->alpha[*lbp];
+            hypotheses[stg_idx] = alphas[lane];
             *response += hypotheses[stg_idx];
             //fprintf(stderr, "[%d,%f] ", features[stg_idx], hypotheses[stg_idx]);
 
@@ -463,38 +428,35 @@ static int eval_classifier_lrp_bunch16(PreprocessedImage * PI, TClassifier * c,
     return 1;
 }
 
-// histogram of stage counts?
-int scan_image_conv_bunch16(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
-        Detection * first, Detection * last, int * hist)
+static int eval_classifier_lbp_bunch16(PreprocessedImage * PI, TClassifier * c, int x, int y, unsigned begin, unsigned end, int * features, float * hypotheses, float * response, int * stages)
 {
-    if (c->fsz != FSZ_2x2)
-    {
-        return 0;
-    }
+    return eval_classifier_bunch16<lbp_features_16<TStage> >(PI, c, x, y, begin, end, features, hypotheses, response, stages);
+}
 
-    ClassifierEvalFunc eval = 0;
+static int eval_classifier_lrd_bunch16(PreprocessedImage * PI, TClassifier * c, int x, int y, unsigned begin, unsigned end, int * features, float * hypotheses, float * response, int * stages)
+{
+    return eval_classifier_bunch16<lrd_features_16<TStage> >(PI, c, x, y, begin, end, features, hypotheses, response, stages);
+}
 
-    switch (c->tp)
-    {
-    case LRD:
-        eval = eval_classifier_lrd_bunch16;
-        break;
-    case LRP:
-        eval = eval_classifier_lrp_bunch16;
-        break;
-    case LBP:
-        eval = eval_classifier_lbp_bunch16;
-        break;
-    default:
-        break;
-    }
-    
-    if (!eval) 
-    {
-      return 0;
-    }
-     
+static int eval_classifier_lrp_bunch16(PreprocessedImage * PI, TClassifier * c, int x, int y, unsigned begin, unsigned end, int * features, float * hypotheses, float * response, int * stages)
+{
+    return eval_classifier_bunch16<lrp_features_16<TStage> >(PI, c, x, y, begin, end, features, hypotheses, response, stages);
+}
+
+static int eval_classifier_lrd_rank_bunch16(PreprocessedImage * PI, TClassifier * c, int x, int y, unsigned begin, unsigned end, int * features, float * hypotheses, float * response, int * stages)
+{
+    return eval_classifier_bunch16<lrd_rank_features_16<TStage> >(PI, c, x, y, begin, end, features, hypotheses, response, stages);
+}
+
+static int eval_classifier_lrp_rank_bunch16(PreprocessedImage * PI, TClassifier * c, int x, int y, unsigned begin, unsigned end, int * features, float * hypotheses, float * response, int * stages)
+{
+    return eval_classifier_bunch16<lrp_rank_features_16<TStage> >(PI, c, x, y, begin, end, features, hypotheses, response, stages);
+}
 
+/// Scan all windows with bunch16 evaluation function.
+static int scan_image_bunch16(ClassifierEvalFunc eval, PreprocessedImage * PI, TClassifier * c,
+        Detection * first, Detection * last, int * hist)
+{
     int features[c->stage_count];
     float hypotheses[c->stage_count];
     float response;
@@ -535,9 +497,84 @@ int scan_image_conv_bunch16(PreprocessedImage * PI, TClassifier * c, ScanParams
     return det - first;
 }
 
+ClassifierEvalFunc get_eval_func_conv_bunch16(TClassifier * c)
+{
+    if (!is_classifier_supported_conv_bunch16(c))
+    {
+        return 0;
+    }
+
+    switch (c->tp)
+    {
+    case LRD:
+        return eval_classifier_lrd_bunch16;
+    case LRP:
+        return eval_classifier_lrp_bunch16;
+    case LBP:
+        return eval_classifier_lbp_bunch16;
+    default:
+        return 0;
+    }
+}
+
+// histogram of stage counts?
+int scan_image_conv_bunch16(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
+        Detection * first, Detection * last, int * hist)
+{
+    if (c->fsz == FSZ_4x4 && !PI->conv[CONV_PLANES].imageData)
+    {
+        return 0; // Image not preprocessed with PP_CONV_4x4
+    }
+
+    ClassifierEvalFunc eval = get_eval_func_conv_bunch16(c);
+    
+    if (!eval) 
+    {
+      return 0;
+    }
+
+    return scan_image_bunch16(eval, PI, c, first, last, hist);
+}
+
+ClassifierEvalFunc get_eval_func_rank_bunch16(TClassifier * c)
+{
+    if (!is_classifier_supported_rank_bunch16(c))
+    {
+        return 0;
+    }
+
+    return (c->tp == LRD) ? eval_classifier_lrd_rank_bunch16 : eval_classifier_lrp_rank_bunch16;
+}
+
+int scan_image_rank_bunch16(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
+        Detection * first, Detection * last, int * hist)
+{
+    ClassifierEvalFunc eval = get_eval_func_rank_bunch16(c);
+
+    if (!eval)
+    {
+        return 0;
+    }
+
+    const int planes = (c->fsz == FSZ_4x4) ? CONV_PLANES_4x4 : CONV_PLANES;
+    if (!PI->rank[planes-1].imageData)
+    {
+        return 0; // Image not preprocessed with PP_RANK (and PP_CONV_4x4)
+    }
+
+    return scan_image_bunch16(eval, PI, c, first, last, hist);
+}
+
+int is_classifier_supported_rank_bunch16(TClassifier * c)
+{
+    if ((c->tp == LRP || c->tp == LRD) && (c->fsz == FSZ_2x2 || c->fsz == FSZ_4x4))
+        return 1;
+    return 0;
+}
+
 int is_classifier_supported_conv_bunch16(const TClassifier* const c)
 {
-    if ((c->tp == LBP || c->tp == LRP || c->tp == LRD) && c->fsz == FSZ_2x2)
+    if ((c->tp == LBP || c->tp == LRP || c->tp == LRD) && (c->fsz == FSZ_2x2 || c->fsz == FSZ_4x4))
         return 1;
     return 0;
 }
@@ -549,11 +586,25 @@ int is_classifier_supported_conv_bunch16(const TClassifier* const c)
 // LRD, LRP, LBP
 //
 
-inline float eval_lrd_stage_iconv(
+/// Offset of a ranked block relative to the feature data.
+/// Precalculated ranks of TClassifier are offsets already.
+static inline int rank_offset(const int * ranks, int i, int row_size)
+{
+    return ranks[i];
+}
+
+/// Image independent ranks of quantised models are rank_table indices.
+static inline int rank_offset(const short * ranks, int i, int row_size)
+{
+    const int r = ranks[i];
+    return (r >= 8) ? r + row_size - 8 : r;
+}
+
+template <typename Stage, typename Rank>
+static inline int lrd_feature_iconv(
         PreprocessedImage * PI,
         int x, int y, int mod_pos,
-        const TStage * stg, const int * ranks,
-        int * feature)
+        const Stage * stg, const Rank * ranks)
 {
     // index to tables - depends on feature size, sample position and feature position relative to sample
     const int table_idx = (stg->sz_type << 8) | mod_pos | stg->pos_type;
@@ -576,8 +627,8 @@ inline float eval_lrd_stage_iconv(
     
     // Get the A nd B rank index according to the shift type
 
-    const int A_offset = ranks[2 * mask_type + 0];
-    const int B_offset = ranks[2 * mask_type + 1];
+    const int A_offset = rank_offset(ranks, 2 * mask_type + 0, PI->irow_size[int(stg->sz_type)]);
+    const int B_offset = rank_offset(ranks, 2 * mask_type + 1, PI->irow_size[int(stg->sz_type)]);
 
     const register __m128i data = _mm_set_epi64(*(__m64*)(data1), *(__m64*)(data0));
     const register __m128i zero = _mm_setzero_si128();
@@ -599,18 +650,17 @@ inline float eval_lrd_stage_iconv(
         )
     }; 
 
-	*feature = (diff.s16[4] + diff.s16[0]) + 8;
     _mm_empty();
 
-    return stg->alpha[*feature];
+	return (diff.s16[4] + diff.s16[0]) + 8;
 }
 
 
-inline float eval_lrp_stage_iconv(
+template <typename Stage, typename Rank>
+static inline int lrp_feature_iconv(
         PreprocessedImage * PI,
         int x, int y, int mod_pos,
-        const TStage * stg, const int * ranks,
-        int * feature)
+        const Stage * stg, const Rank * ranks)
 {
     // index to tables - depends on feature size, sample position and feature position relative to sample
     const int table_idx = (stg->sz_type << 8) | mod_pos | stg->pos_type;
@@ -633,8 +683,8 @@ inline float eval_lrp_stage_iconv(
     
     // Get the A nd B rank index according to the shift type
 
-    const int A_offset = ranks[2 * mask_type + 0];
-    const int B_offset = ranks[2 * mask_type + 1];
+    const int A_offset = rank_offset(ranks, 2 * mask_type + 0, PI->irow_size[int(stg->sz_type)]);
+    const int B_offset = rank_offset(ranks, 2 * mask_type + 1, PI->irow_size[int(stg->sz_type)]);
 
     const register __m128i data = _mm_set_epi64(*(__m64*)(data1), *(__m64*)(data0));
     const register __m128i zero = _mm_setzero_si128();
@@ -659,17 +709,16 @@ inline float eval_lrp_stage_iconv(
                 masks[mask_type].q),
             zero)}; 
 
-	*feature = 10 * (countB.s16[4] + countB.s16[0]) + (countA.s16[4] + countA.s16[0]);
     _mm_empty();
 
-    return stg->alpha[*feature];
+	return LRP_ROW * (countB.s16[4] + countB.s16[0]) + (countA.s16[4] + countA.s16[0]);
 }
 
-float eval_lbp_stage_iconv(
+template <typename Stage, typename Rank>
+static inline int lbp_feature_iconv(
         PreprocessedImage * PI,
         int x, int y, int mod_pos,
-        const TStage * stg, const int * ranks,
-        int * feature)
+        const Stage * stg, const Rank * ranks)
 {
     // index to tables - depends on feature size, sample position and feature position relative to sample
     const int table_idx = (stg->sz_type << 8) | mod_pos | stg->pos_type;
@@ -712,9 +761,38 @@ float eval_lbp_stage_iconv(
             zero)
     };
 
-    *feature = result.ss[4] + result.ss[0];
     _mm_empty();
     
+    return result.ss[4] + result.ss[0];
+}
+
+inline float eval_lrd_stage_iconv(
+        PreprocessedImage * PI,
+        int x, int y, int mod_pos,
+        const TStage * stg, const int * ranks,
+        int * feature)
+{
+    *feature = lrd_feature_iconv(PI, x, y, mod_pos, stg, ranks);
+    return stg->alpha[*feature];
+}
+
+inline float eval_lrp_stage_iconv(
+        PreprocessedImage * PI,
+        int x, int y, int mod_pos,
+        const TStage * stg, const int * ranks,
+        int * feature)
+{
+    *feature = lrp_feature_iconv(PI, x, y, mod_pos, stg, ranks);
+    return stg->alpha[*feature];
+}
+
+float eval_lbp_stage_iconv(
+        PreprocessedImage * PI,
+        int x, int y, int mod_pos,
+        const TStage * stg, const int * ranks,
+        int * feature)
+{
+    *feature = lbp_feature_iconv(PI, x, y, mod_pos, stg, ranks);
     return stg->alpha[*feature];
 }
 
@@ -755,30 +833,30 @@ int eval_classifier_iconv(
 }
 
 
-int scan_image_iconv(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
-        Detection * first, Detection * last, int * hist)
+ClassifierEvalFunc get_eval_func_iconv(TClassifier * c)
 {
     if (c->fsz != FSZ_2x2)
     {
         return 0;
     }
 
-    ClassifierEvalFunc eval = 0;
-
     switch (c->tp)
     {
     case LRD:
-        eval = eval_classifier_iconv<eval_lrd_stage_iconv>;
-        break;
+        return eval_classifier_iconv<eval_lrd_stage_iconv>;
     case LRP:
-        eval = eval_classifier_iconv<eval_lrp_stage_iconv>;
-        break;
+        return eval_classifier_iconv<eval_lrp_stage_iconv>;
     case LBP:
-        eval = eval_classifier_iconv<eval_lbp_stage_iconv>;
-        break;
+        return eval_classifier_iconv<eval_lbp_stage_iconv>;
     default:
-        break;
+        return 0;
     };
+}
+
+int scan_image_iconv(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
+        Detection * first, Detection * last, int * hist)
+{
+    ClassifierEvalFunc eval = get_eval_func_iconv(c);
 
     if (!eval)
     {
@@ -915,3 +993,515 @@ int scan_image_iconv_conv(PreprocessedImage * PI, TClassifier * c, ScanParams *
     return det - first;
 }
 
+
+
+////////////////////////////////////////////////////////////////////////////////
+// INTEGRAL IMAGE PROCESSING
+// MB-LBP
+////////////////////////////////////////////////////////////////////////////////
+
+/// Sums of 3x3 grid of w x h blocks from 4x4 integral image corners.
+/// Each row of blocks is returned in one vector, lane 3 is undefined.
+/// \param I Integral image at the top-left corner (one pixel up-left of the first block)
+/// \param w Width of blocks
+/// \param row Height of blocks in integral image items
+static inline __attribute__((always_inline)) void sum_3x3_integral_sse(const int * I, int w, int row, __m128i * sums)
+{
+    __m128i prev = _mm_setr_epi32(I[0], I[w], I[2*w], I[3*w]);
+    for (int r = 0; r < 3; ++r)
+    {
+        I += row;
+        const __m128i next = _mm_setr_epi32(I[0], I[w], I[2*w], I[3*w]);
+        const __m128i cols = _mm_sub_epi32(next, prev); // sums from the left edge
+        sums[r] = _mm_sub_epi32(_mm_srli_si128(cols, 4), cols);
+        prev = next;
+    }
+}
+
+/// MB-LBP code of a stage.
+/// Block sums are at most 255 * w * h so the signed comparison is safe.
+static inline int mblbp_feature_integral(const IplImage * integral, int offset, const TStage * stg)
+{
+    const int * I = (const int*)(integral->imageData + offset + stg->offset);
+    __m128i sums[3];
+    sum_3x3_integral_sse(I, stg->w, stg->h * (integral->widthStep / sizeof(int)), sums);
+
+    const __m128i center = _mm_shuffle_epi32(sums[1], _MM_SHUFFLE(1,1,1,1));
+
+    // Bit i of 'greater' is set when block i is greater than the center
+    const int greater =
+        ((_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(sums[0], center))) & 7) << 0) |
+        ((_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(sums[1], center))) & 7) << 3) |
+        ((_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(sums[2], center))) & 7) << 6);
+
+    int code = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        code |= ((greater >> lbp_bit_order[i]) & 1) << i;
+    }
+    return code;
+}
+
+static int eval_classifier_mblbp(PreprocessedImage * PI, TClassifier * c, int x, int y, unsigned begin, unsigned end, int * features, float * hypotheses, float * response, int * stages)
+{
+    end = min(end, c->stage_count);
+    const IplImage * const integral = &(PI->integral);
+
+    // Block corners are one pixel up-left in the integral image
+    const int offset = (y - 1) * integral->widthStep + (x - 1) * sizeof(int);
+
+    for (unsigned i = begin; i < end; ++i)
+    {
+        const TStage * s = c->stage + i;
+        features[i] = mblbp_feature_integral(integral, offset, s);
+        hypotheses[i] = s->alpha[features[i]];
+        *response += hypotheses[i];
+
+        if (*response < s->theta_b)
+        {
+            *stages += i - begin + 1;
+            return 0;
+        }
+    }
+
+    *stages += end - begin;
+    return 1;
+}
+
+ClassifierEvalFunc get_eval_func_mblbp(TClassifier * c)
+{
+    return is_classifier_supported_mblbp(c) ? eval_classifier_mblbp : 0;
+}
+
+int scan_image_mblbp(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
+        Detection * first, Detection * last, int * hist)
+{
+    if (!is_classifier_supported_mblbp(c))
+    {
+        return 0;
+    }
+
+    int features[c->stage_count];
+    float hypotheses[c->stage_count];
+    float response;
+    int stages;
+
+    Detection * det = first;
+
+    for (unsigned y = 1; y < PI->sz.height-c->height-1; ++y)
+    {
+        for (unsigned x = 1; x < PI->sz.width-c->width-1; ++x)
+        {
+            response = 0.0f;
+            stages = 0;
+            int d = eval_classifier_mblbp(PI, c, x, y, 0, c->stage_count, features, hypotheses, &response, &stages);
+            if (hist) hist[stages-1]++;
+            if (d && (response > c->threshold))
+            {
+                Detection tmp = {x, y, c->width, c->height, response, 0.0f};
+                *det = tmp;
+                ++det;
+                if (det == last)
+                {
+                    return det - first;
+                }
+            }
+        }
+    }
+
+    return det - first;
+}
+
+int is_classifier_supported_mblbp(TClassifier * c)
+{
+    if (c->tp == MBLBP)
+        return 1;
+    return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// INTEGRAL IMAGE PROCESSING
+// Haar
+////////////////////////////////////////////////////////////////////////////////
+
+/// Reciprocal standard deviation of intensity in the window (1 for flat windows).
+/// Both integral images are read at the corners up-left of the window.
+static inline float haar_window_norm(const PreprocessedImage * PI, const TClassifier * c, int x, int y)
+{
+    const int row = PI->integral.widthStep / sizeof(int);
+    const int a = (y - 1) * row + (x - 1);
+    const int b = a + c->width;
+    const int d = a + c->height * row;
+    const int e = d + c->width;
+
+    const unsigned * I = (const unsigned*)PI->integral.imageData;
+    const unsigned * I2 = (const unsigned*)PI->integral2.imageData;
+    const float n = float(c->width * c->height);
+    const float mean = float(I[e] - I[b] - I[d] + I[a]) / n;
+    const float var = float(I2[e] - I2[b] - I2[d] + I2[a]) / n - mean * mean;
+
+    return (var > 0.0f) ? 1.0f / sqrtf(var) : 1.0f;
+}
+
+/// Alpha indices of a bunch of 16 Haar stages.
+/// Corners are gathered one by one, weighting, normalisation and discretization
+/// run on four vectors of four stages. Feature values are exact in 32 bit
+/// arithmetic even if the integral image itself wraps around.
+static inline __attribute__((always_inline)) __m128i haar_features_16(const int * I, const THaarBunch * h, float norm, int max_bin)
+{
+    __m128i acc[4] = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+
+    for (int k = 0; k < h->corners; ++k)
+    {
+        const int * o = h->offset[k];
+        for (int q = 0; q < 4; ++q, o += 4)
+        {
+            const __m128i v = _mm_setr_epi32(I[o[0]], I[o[1]], I[o[2]], I[o[3]]);
+            const __m128i w = _mm_load_si128((const __m128i*)(h->coef[k] + 4 * q));
+            acc[q] = _mm_add_epi32(acc[q], _mm_mullo_epi32(v, w));
+        }
+    }
+
+    const __m128 n = _mm_set1_ps(norm);
+    const __m128i lo = _mm_setzero_si128();
+    const __m128i hi = _mm_set1_epi32(max_bin);
+    __m128i bins[4];
+    for (int q = 0; q < 4; ++q)
+    {
+        const __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(acc[q]), n);
+        const __m128 v = _mm_add_ps(_mm_mul_ps(f, _mm_load_ps(h->scale + 4 * q)), _mm_load_ps(h->shift + 4 * q));
+        bins[q] = _mm_min_epi32(_mm_max_epi32(_mm_cvttps_epi32(v), lo), hi);
+    }
+
+    return _mm_packus_epi16(_mm_packs_epi32(bins[0], bins[1]), _mm_packs_epi32(bins[2], bins[3]));
+}
+
+// Bunches are aligned to multiples of 16 stages (c->haar), stages of the
+// first bunch before 'begin' are evaluated but not accumulated.
+static int eval_classifier_haar(PreprocessedImage * PI, TClassifier * c, int x, int y, unsigned begin, unsigned end, int * features, float * hypotheses, float * response, int * stages)
+{
+    end = min(end, c->stage_count);
+    const int row = PI->integral.widthStep / sizeof(int);
+    const int * I = (const int*)PI->integral.imageData + (y - 1) * row + (x - 1);
+    const float norm = haar_window_norm(PI, c, x, y);
+
+    for (unsigned b = begin / 16; 16 * b < end; ++b)
+    {
+        int128 idx;
+        idx.q = haar_features_16(I, c->haar + b, norm, c->alpha_count - 1);
+
+        float alphas[16];
+
+        const unsigned last = std::min(end, 16 * b + 16);
+        for (unsigned i = std::max(begin, 16 * b); i < last; ++i)
+        {
+            // Halves of the bunch are looked up when reached, nothing is
+            // loaded after the window is rejected
+            const unsigned lane = i - 16 * b;
+            if (i == begin || (lane & 7) == 0)
+            {
+                const unsigned half = lane & 8;
+                const unsigned count = std::min(half + 8, last - 16 * b) - half;
+                lookup_alphas_8(c->stage[16 * b + half].alpha, c->alpha_stride, count, idx.u8 + half, alphas + half);
+            }
+            features[i] = idx.u8[lane];
+            hypotheses[i] = alphas[lane];
+            *response += hypotheses[i];
+
+            if (*response < c->stage[i].theta_b)
+            {
+                *stages += i - begin + 1;
+                return 0;
+            }
+        }
+    }
+
+    *stages += end - begin;
+    return 1;
+}
+
+ClassifierEvalFunc get_eval_func_haar(TClassifier * c)
+{
+    return is_classifier_supported_haar(c) ? eval_classifier_haar : 0;
+}
+
+int scan_image_haar(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
+        Detection * first, Detection * last, int * hist)
+{
+    if (!is_classifier_supported_haar(c) || !PI->integral2.imageData)
+    {
+        return 0; // Image not preprocessed with PP_HAAR_IMAGE
+    }
+
+    int features[c->stage_count];
+    float hypotheses[c->stage_count];
+    float response;
+    int stages;
+
+    Detection * det = first;
+
+    for (unsigned y = 1; y < PI->sz.height-c->height-1; ++y)
+    {
+        for (unsigned x = 1; x < PI->sz.width-c->width-1; ++x)
+        {
+            response = 0.0f;
+            stages = 0;
+            int d = eval_classifier_haar(PI, c, x, y, 0, c->stage_count, features, hypotheses, &response, &stages);
+            if (hist) hist[stages-1]++;
+            if (d && (response > c->threshold))
+            {
+                Detection tmp = {x, y, c->width, c->height, response, 0.0f};
+                *det = tmp;
+                ++det;
+                if (det == last)
+                {
+                    return det - first;
+                }
+            }
+        }
+    }
+
+    return det - first;
+}
+
+int is_classifier_supported_haar(TClassifier * c)
+{
+    if (c->tp == HAAR && c->haar && c->alpha_count > 0 && c->alpha_count <= HAAR_MAX_BINS)
+        return 1;
+    return 0;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Evaluation of quantised models
+// LRD, LRP, LBP
+//
+
+typedef int (*StageFeatureFuncQ)(PreprocessedImage * PI,
+        int x, int y, int mod_pos,
+        const TStageQ * stg, const short * ranks);
+
+/// Quantised evaluation on interleaved convolution.
+/// Response is accumulated in 32 bit integer, so the result is exact sum of quantised alphas.
+template <StageFeatureFuncQ feature>
+static int eval_quant_iconv(PreprocessedImage * PI, const TQuantModel * q, int x, int y, int * response, int * stages)
+{
+    const int mod_pos = get_mod_position(x, y);
+    const short * rank = q->ranks;
+    int r = 0;
+    for (unsigned s = 0; s < q->stage_count; ++s, rank += 8)
+    {
+        const TStageQ * const stg = q->stage + s;
+        r += q->alpha[stg->alpha + feature(PI, x, y, mod_pos, stg, rank)];
+        if (r < q->theta[s])
+        {
+            *response = r;
+            *stages = s + 1;
+            return 0;
+        }
+    }
+    *response = r;
+    *stages = q->stage_count;
+    return 1;
+}
+
+/// Inclusive prefix sum of 8 int16 values (saturated).
+static inline __attribute__((const,always_inline)) __m128i prefix_sum_epi16(__m128i v)
+{
+    v = _mm_adds_epi16(v, _mm_slli_si128(v, 2));
+    v = _mm_adds_epi16(v, _mm_slli_si128(v, 4));
+    v = _mm_adds_epi16(v, _mm_slli_si128(v, 8));
+    return v;
+}
+
+/// Broadcast the last int16 item of the vector.
+static inline __attribute__((const,always_inline)) __m128i broadcast_last_epi16(__m128i v)
+{
+    v = _mm_shufflehi_epi16(v, 0xFF);
+    return _mm_unpackhi_epi64(v, v);
+}
+
+/// Sign extend the low four int16 items to int32.
+static inline __attribute__((const,always_inline)) __m128i unpacklo_epi16_epi32(__m128i v)
+{
+    return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+}
+
+/// Sign extend the high four int16 items to int32.
+static inline __attribute__((const,always_inline)) __m128i unpackhi_epi16_epi32(__m128i v)
+{
+    return _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+}
+
+typedef __m128i (*BunchFeatureFuncQ)(PreprocessedImage * PI, const TStageQ * s, int valid_stages, int x, int y, int mod_pos);
+
+/// Quantised evaluation in bunches of 16 stages on convolution planes.
+/// Partial responses of all stages of a bunch are calculated at once by
+/// int16 prefix sum (it does not saturate, see quantise_classifier), added
+/// to the int32 response of the preceding bunches and compared with
+/// thresholds of the bunch. The result is exact sum of quantised alphas
+/// as in eval_quant_iconv.
+template <BunchFeatureFuncQ features16>
+static int eval_quant_bunch16(PreprocessedImage * PI, const TQuantModel * q, int x, int y, int * response, int * stages)
+{
+    const int mod_pos = get_mod_position(x, y);
+    int r = 0;
+
+    for (unsigned b = 0; b < q->stage_count; b += 16)
+    {
+        const TStageQ * const s = q->stage + b;
+        const int valid_stages = std::min(q->stage_count - b, 16u);
+
+        int128 idx;
+        idx.q = features16(PI, s, valid_stages, x, y, mod_pos);
+
+        union {
+            __m128i q[2];
+            short s16[16];
+        } sum;
+
+        // Alphas of invalid stages are 0 so the last item holds the response of the bunch
+        for (int i = 0; i < valid_stages; ++i)
+            sum.s16[i] = q->alpha[s[i].alpha + idx.u8[i]];
+        for (int i = valid_stages; i < 16; ++i)
+            sum.s16[i] = 0;
+
+        sum.q[0] = prefix_sum_epi16(sum.q[0]);
+        sum.q[1] = _mm_adds_epi16(prefix_sum_epi16(sum.q[1]), broadcast_last_epi16(sum.q[0]));
+
+        // Responses of the preceding bunches are carried in int32, long models do not saturate
+        union {
+            __m128i q[4];
+            int s32[16];
+        } total;
+        __m128i fails[2];
+        const __m128i carry = _mm_set1_epi32(r);
+        for (int k = 0; k < 2; ++k)
+        {
+            const __m128i theta = _mm_loadu_si128((const __m128i*)(q->theta + b + 8 * k));
+            total.q[2*k+0] = _mm_add_epi32(unpacklo_epi16_epi32(sum.q[k]), carry);
+            total.q[2*k+1] = _mm_add_epi32(unpackhi_epi16_epi32(sum.q[k]), carry);
+            fails[k] = _mm_packs_epi32(_mm_cmplt_epi32(total.q[2*k+0], unpacklo_epi16_epi32(theta)),
+                                       _mm_cmplt_epi32(total.q[2*k+1], unpackhi_epi16_epi32(theta)));
+        }
+        const int fail = _mm_movemask_epi8(_mm_packs_epi16(fails[0], fails[1])) & ((1 << valid_stages) - 1);
+
+        if (fail)
+        {
+            const int i = __builtin_ctz(fail);
+            *response = total.s32[i];
+            *stages = b + i + 1;
+            return 0;
+        }
+
+        r = total.s32[15];
+    }
+
+    *response = r;
+    *stages = q->stage_count;
+    return 1;
+}
+
+/// Scan the image with quantised model.
+/// Border is the same as in the float version of the engine so the results can be compared.
+static int scan_image_quant(QuantEvalFunc eval, unsigned border, PreprocessedImage * PI, TClassifier * c, Detection * first, Detection * last, int * hist)
+{
+    const TQuantModel * const q = c->quant;
+
+    Detection * det = first;
+
+    if (det >= last)
+    {
+        return 0;
+    }
+
+    for (unsigned y = border; y < PI->sz.height-c->height-border; ++y)
+    {
+        for (unsigned x = border; x < PI->sz.width-c->width-border; ++x)
+        {
+            int response = 0;
+            int stages = 0;
+            int d = eval(PI, q, x, y, &response, &stages);
+            if (hist) hist[stages-1]++;
+            if (d && (response > q->threshold))
+            {
+                Detection tmp = { x, y, c->width, c->height, q->scale * response, 0.0f };
+                *det = tmp;
+                ++det;
+                if (det == last)
+                {
+                    return det - first;
+                }
+            }
+        } // x
+    } // y
+    return det - first;
+}
+
+QuantEvalFunc get_eval_func_iconv_q(TClassifier * c)
+{
+    if (!c->quant)
+    {
+        return 0;
+    }
+
+    switch (c->tp)
+    {
+    case LRD:
+        return eval_quant_iconv<lrd_feature_iconv<TStageQ, short> >;
+    case LRP:
+        return eval_quant_iconv<lrp_feature_iconv<TStageQ, short> >;
+    case LBP:
+        return eval_quant_iconv<lbp_feature_iconv<TStageQ, short> >;
+    default:
+        return 0;
+    };
+}
+
+int scan_image_iconv_q(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
+        Detection * first, Detection * last, int * hist)
+{
+    QuantEvalFunc eval = get_eval_func_iconv_q(c);
+
+    if (!eval)
+    {
+        return 0;
+    }
+
+    return scan_image_quant(eval, 1, PI, c, first, last, hist);
+}
+
+QuantEvalFunc get_eval_func_conv_bunch16_q(TClassifier * c)
+{
+    if (!c->quant)
+    {
+        return 0;
+    }
+
+    switch (c->tp)
+    {
+    case LRD:
+        return eval_quant_bunch16<lrd_features_16<TStageQ> >;
+    case LRP:
+        return eval_quant_bunch16<lrp_features_16<TStageQ> >;
+    case LBP:
+        return eval_quant_bunch16<lbp_features_16<TStageQ> >;
+    default:
+        return 0;
+    };
+}
+
+int scan_image_conv_bunch16_q(PreprocessedImage * PI, TClassifier * c, ScanParams * sp,
+        Detection * first, Detection * last, int * hist)
+{
+    QuantEvalFunc eval = get_eval_func_conv_bunch16_q(c);
+
+    if (!eval)
+    {
+        return 0;
+    }
+
+    return scan_image_quant(eval, 0, PI, c, first, last, hist);
+}
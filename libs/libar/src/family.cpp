@@ -0,0 +1,153 @@
+/*
+ *  family.cpp
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Families of classifiers with different window sizes.
+ *
+ */
+
+#include "family.h"
+#include "classifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+
+static bool smaller_window(const TClassifier * a, const TClassifier * b)
+{
+    return a->width < b->width;
+}
+
+ClassifierFamily * load_classifier_family(const char * const * files, unsigned count)
+{
+    vector<TClassifier*> members;
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        TClassifier * c = load_classifier_XML(files[i]);
+        if (!c)
+        {
+            for (unsigned k = 0; k < members.size(); ++k)
+                release_classifier(&members[k]);
+            return 0;
+        }
+        init_classifier(c);
+        members.push_back(c);
+    }
+
+    if (members.empty())
+    {
+        return 0;
+    }
+
+    sort(members.begin(), members.end(), smaller_window);
+
+    ClassifierFamily * f = new ClassifierFamily();
+    f->count = members.size();
+    f->members = new TClassifier*[f->count];
+    copy(members.begin(), members.end(), f->members);
+    return f;
+}
+
+void release_classifier_family(ClassifierFamily ** f)
+{
+    if (f && *f)
+    {
+        for (unsigned i = 0; i < (*f)->count; ++i)
+        {
+            release_classifier(&(*f)->members[i]);
+        }
+        delete [] (*f)->members;
+        delete *f;
+        *f = 0;
+    }
+}
+
+int select_family_members(ClassifierFamily * f, int pyramid_levels, int levels_per_octave, unsigned * members)
+{
+    const int steps = max(1, levels_per_octave / max(1, pyramid_levels));
+    const float base = log2f(float(f->members[0]->width));
+
+    int n = 0;
+    for (int k = 0; k < steps; ++k)
+    {
+        // Required window size relative to the smallest member (log2)
+        const float target = float(k) / (steps * max(1, pyramid_levels));
+
+        unsigned best = 0;
+        float best_dist = 1e30f;
+        for (unsigned m = 0; m < f->count; ++m)
+        {
+            const float dist = fabsf(log2f(float(f->members[m]->width)) - base - target);
+            if (dist < best_dist)
+            {
+                best = m;
+                best_dist = dist;
+            }
+        }
+
+        if (find(members, members + n, best) == members + n)
+        {
+            members[n++] = best;
+        }
+    }
+
+    return n;
+}
+
+int detect_objects_family(
+        PreprocessedPyramid * PP,
+        ClassifierFamily * f,
+        ScanParams * sp,
+        ScanImageFunc scan_image,
+        Detection * first, Detection * last,
+        int options,
+        int levels_per_octave,
+        int * hist)
+{
+    vector<unsigned> members(f->count);
+    const int n = select_family_members(f, PP->levels_per_octave, levels_per_octave, &members[0]);
+
+    const CvSize base_sz = PP->PI[0]->sz;
+
+    Detection * det = first;
+
+    for (vector<PreprocessedImage*>::iterator PI = PP->PI.begin(); PI != PP->PI.end(); ++PI)
+    {
+        const float scale_x = float(base_sz.width) / (*PI)->sz.width;
+        const float scale_y = float(base_sz.height) / (*PI)->sz.height;
+
+        for (int m = 0; m < n; ++m)
+        {
+            TClassifier * c = f->members[members[m]];
+
+            if ((*PI)->sz.width <= int(c->width) + 2 || (*PI)->sz.height <= int(c->height) + 2)
+                continue;
+
+            prepare_classifier(c, *PI, options);
+
+            const int count = scan_image(*PI, c, sp, det, last, hist);
+
+            for (Detection * r = det; r < (det + count); ++r)
+            {
+                r->x *= scale_x;
+                r->y *= scale_y;
+                r->width *= scale_x;
+                r->height *= scale_y;
+            }
+
+            det += count;
+        }
+    }
+
+    return det - first;
+}
@@ -0,0 +1,148 @@
+/*
+ *  group.cpp
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Grouping of overlapping detections (see group.h).
+ *
+ */
+
+#include "group.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+
+static bool similar(const Detection & a, const Detection & b, float eps)
+{
+    const float delta = eps * (min(a.width, b.width) + min(a.height, b.height)) * 0.5f;
+    return abs(a.x - b.x) <= delta && abs(a.y - b.y) <= delta &&
+           abs(a.x + a.width - b.x - b.width) <= delta &&
+           abs(a.y + a.height - b.y - b.height) <= delta;
+}
+
+static int find_root(vector<int> & parent, int i)
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+
+int group_detections(Detection * first, Detection * last, int min_neighbors, float eps)
+{
+    const int n = last - first;
+    if (n <= 0 || min_neighbors <= 0)
+        return max(n, 0); // Nothing to group (as cvGroupRectangles)
+
+    // Partition to clusters of similar detections
+    vector<int> parent(n);
+    for (int i = 0; i < n; ++i)
+        parent[i] = i;
+
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = i + 1; j < n; ++j)
+        {
+            if (similar(first[i], first[j], eps))
+            {
+                parent[find_root(parent, j)] = find_root(parent, i);
+            }
+        }
+    }
+
+    vector<int> label(n, -1);
+    vector<int> count;
+    vector<float> sum_x, sum_y, sum_w, sum_h, response;
+    for (int i = 0; i < n; ++i)
+    {
+        const int root = find_root(parent, i);
+        if (label[root] < 0)
+        {
+            label[root] = count.size();
+            count.push_back(0);
+            sum_x.push_back(0.0f); sum_y.push_back(0.0f);
+            sum_w.push_back(0.0f); sum_h.push_back(0.0f);
+            response.push_back(first[i].response);
+        }
+        const int l = label[root];
+        ++count[l];
+        sum_x[l] += first[i].x; sum_y[l] += first[i].y;
+        sum_w[l] += first[i].width; sum_h[l] += first[i].height;
+        response[l] = max(response[l], first[i].response);
+    }
+
+    // Average rectangles of the clusters
+    const int clusters = count.size();
+    vector<Detection> groups(clusters);
+    for (int l = 0; l < clusters; ++l)
+    {
+        const float s = 1.0f / count[l];
+        const Detection d = {
+            int(floor(sum_x[l] * s + 0.5f)), int(floor(sum_y[l] * s + 0.5f)),
+            int(floor(sum_w[l] * s + 0.5f)), int(floor(sum_h[l] * s + 0.5f)),
+            response[l], 0.0f };
+        groups[l] = d;
+    }
+
+    // Keep clusters with enough detections which are not inside a stronger cluster
+    Detection * dst = first;
+    for (int i = 0; i < clusters; ++i)
+    {
+        if (count[i] <= min_neighbors)
+            continue;
+
+        const Detection & r1 = groups[i];
+        bool inside = false;
+        for (int j = 0; j < clusters && !inside; ++j)
+        {
+            if (j == i || count[j] <= min_neighbors || (count[j] <= max(3, count[i]) && count[i] >= 3))
+                continue;
+            const Detection & r2 = groups[j];
+            const int dx = int(r2.width * eps + 0.5f);
+            const int dy = int(r2.height * eps + 0.5f);
+            inside = r1.x >= r2.x - dx && r1.y >= r2.y - dy &&
+                     r1.x + r1.width <= r2.x + r2.width + dx &&
+                     r1.y + r1.height <= r2.y + r2.height + dy;
+        }
+
+        if (!inside)
+        {
+            *dst++ = r1;
+        }
+    }
+
+    return dst - first;
+}
+
+
+static bool same_window(const Detection & a, const Detection & b)
+{
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+static bool window_order(const Detection & a, const Detection & b)
+{
+    if (a.y != b.y) return a.y < b.y;
+    if (a.x != b.x) return a.x < b.x;
+    if (a.height != b.height) return a.height < b.height;
+    return a.width < b.width;
+}
+
+int unique_detections(Detection * first, Detection * last)
+{
+    sort(first, last, window_order);
+    return unique(first, last, same_window) - first;
+}
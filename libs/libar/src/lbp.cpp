@@ -118,6 +118,29 @@ void calc_LBP11_sse(IplImage * src, IplImage * dst)
 }
 
 
+void calc_LBP11_sse_rect(IplImage * src, IplImage * dst, CvRect r)
+{
+    // calc_LBP11_sse fills rows 1 to height-3 from column 1
+    const int y0 = (r.y > 1) ? r.y : 1;
+    const int y1 = (r.y + r.height < src->height - 2) ? r.y + r.height : src->height - 2;
+    if (y1 <= y0)
+        return;
+
+    // Headers of the rows around the rectangle, strips fill rows 1 to height-3 of them
+    IplImage s = *src, d = *dst;
+    s.imageData = src->imageData + (y0 - 1) * src->widthStep;
+    d.imageData = dst->imageData + (y0 - 1) * dst->widthStep;
+    s.height = d.height = y1 - y0 + 3;
+
+    // Strip at x fills columns x+1 to x+14
+    for (int x = ((r.x > 1) ? r.x : 1) - 1; x < r.x + r.width - 1; x += 14)
+    {
+        calc_lbp_16_strip(&s, &d, x);
+    }
+    _mm_empty();
+}
+
+
 void calc_LBP11_simple(IplImage * src, IplImage * dst)
 {
     const unsigned char* src_row = (unsigned char*)src->imageData;
@@ -0,0 +1,272 @@
+/*
+ *  motion.cpp
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Motion masks and detection of changed windows (see motion.h).
+ *
+ */
+
+#include "motion.h"
+#include "group.h"
+
+#include <cv.h>
+#include <emmintrin.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+
+MotionMask * create_motion_mask(const MotionParams * mp)
+{
+    MotionMask * mm = new MotionMask();
+    mm->mp = *mp;
+    mm->mp.block_size = max(16, mp->block_size & ~15);
+    mm->blocks = cvSize(0, 0);
+    mm->background = 0;
+    return mm;
+}
+
+void release_motion_mask(MotionMask ** mm)
+{
+    if (mm && *mm)
+    {
+        cvReleaseImage(&(*mm)->background);
+        delete *mm;
+        *mm = 0;
+    }
+}
+
+void reset_motion_mask(MotionMask * mm)
+{
+    cvReleaseImage(&mm->background);
+    mm->cache.clear();
+}
+
+/// Count pixels differing from the background by more than the threshold in each block.
+/// 16 pixels are compared at once; blocks are multiples of 16 so the pixels lie in one block.
+static void count_changed(IplImage * img, IplImage * bg, int bs, int threshold, CvSize blocks, unsigned * counts)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i thr = _mm_set1_epi8((char)min(max(threshold, 0), 255));
+    const int w16 = img->width & ~15;
+
+    fill(counts, counts + blocks.width * blocks.height, 0);
+
+    for (int y = 0; y < img->height; ++y)
+    {
+        const unsigned char * a = (unsigned char*)img->imageData + y * img->widthStep;
+        const unsigned char * b = (unsigned char*)bg->imageData + y * bg->widthStep;
+        unsigned * row = counts + (y / bs) * blocks.width;
+
+        int x = 0;
+        for (; x < w16; x += 16)
+        {
+            const __m128i va = _mm_loadu_si128((const __m128i*)(a + x));
+            const __m128i vb = _mm_loadu_si128((const __m128i*)(b + x));
+            const __m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+            // 1 for changed pixels
+            const __m128i changed = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_subs_epu8(d, thr), zero), one);
+            const __m128i s = _mm_sad_epu8(changed, zero);
+            row[x / bs] += _mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(_mm_srli_si128(s, 8));
+        }
+        for (; x < img->width; ++x)
+        {
+            row[x / bs] += (abs(a[x] - b[x]) > threshold);
+        }
+    }
+}
+
+/// Join runs of changed blocks in rows to rectangles (frame coordinates).
+static void mask_rects(const MotionMask * mm, CvSize img_sz, vector<CvRect> & rects)
+{
+    const int bs = mm->mp.block_size;
+    rects.clear();
+    vector<int> open; // Rectangles ending at the previous row
+
+    for (int by = 0; by < mm->blocks.height; ++by)
+    {
+        vector<int> next;
+        const unsigned char * row = &mm->mask[by * mm->blocks.width];
+        for (int bx = 0; bx < mm->blocks.width; )
+        {
+            if (!row[bx])
+            {
+                ++bx;
+                continue;
+            }
+            int end = bx;
+            while (end < mm->blocks.width && row[end])
+                ++end;
+
+            const int x0 = bx * bs, x1 = min(img_sz.width, end * bs);
+            const int y0 = by * bs, y1 = min(img_sz.height, (by + 1) * bs);
+
+            // Extend the rectangle with the same columns from the previous row
+            int r = -1;
+            for (unsigned i = 0; i < open.size(); ++i)
+            {
+                if (rects[open[i]].x == x0 && rects[open[i]].width == x1 - x0)
+                    r = open[i];
+            }
+            if (r >= 0)
+            {
+                rects[r].height = y1 - rects[r].y;
+            }
+            else
+            {
+                r = rects.size();
+                rects.push_back(cvRect(x0, y0, x1 - x0, y1 - y0));
+            }
+            next.push_back(r);
+            bx = end;
+        }
+        open.swap(next);
+    }
+}
+
+int update_motion_mask(MotionMask * mm, IplImage * img)
+{
+    const int bs = mm->mp.block_size;
+    const CvSize blocks = cvSize((img->width + bs - 1) / bs, (img->height + bs - 1) / bs);
+    const int count = blocks.width * blocks.height;
+
+    bool all = false;
+    if (!mm->background || mm->background->width != img->width || mm->background->height != img->height)
+    {
+        cvReleaseImage(&mm->background);
+        mm->background = cvCreateImage(cvGetSize(img), IPL_DEPTH_8U, 1);
+        mm->cache.clear();
+        all = true;
+    }
+
+    mm->blocks = blocks;
+    mm->counts.resize(count);
+    mm->mask.assign(count, 0);
+
+    if (!all)
+    {
+        count_changed(img, mm->background, bs, mm->mp.threshold, blocks, &mm->counts[0]);
+    }
+
+    // Dilate the changed blocks
+    const int r = max(mm->mp.dilate, 0);
+    int changed = 0;
+    for (int by = 0; by < blocks.height; ++by)
+    {
+        for (int bx = 0; bx < blocks.width; ++bx)
+        {
+            if (!all && mm->counts[by * blocks.width + bx] < unsigned(max(mm->mp.min_pixels, 1)))
+                continue;
+            for (int y = max(0, by - r); y <= min(blocks.height - 1, by + r); ++y)
+            {
+                for (int x = max(0, bx - r); x <= min(blocks.width - 1, bx + r); ++x)
+                {
+                    changed += !mm->mask[y * blocks.width + x];
+                    mm->mask[y * blocks.width + x] = 1;
+                }
+            }
+        }
+    }
+
+    mask_rects(mm, cvGetSize(img), mm->rects);
+
+    // Windows on the changed blocks are evaluated on this frame
+    for (unsigned i = 0; i < mm->rects.size(); ++i)
+    {
+        const CvRect & rc = mm->rects[i];
+        for (int y = rc.y; y < rc.y + rc.height; ++y)
+        {
+            memcpy(mm->background->imageData + y * mm->background->widthStep + rc.x,
+                   img->imageData + y * img->widthStep + rc.x, rc.width);
+        }
+    }
+
+    return changed;
+}
+
+/// Check whether the detection touches a changed block.
+static bool touches_mask(const MotionMask * mm, const Detection & d)
+{
+    const int bs = mm->mp.block_size;
+    const int bx0 = max(0, d.x / bs), by0 = max(0, d.y / bs);
+    const int bx1 = min(mm->blocks.width - 1, (d.x + d.width) / bs);
+    const int by1 = min(mm->blocks.height - 1, (d.y + d.height) / bs);
+    for (int by = by0; by <= by1; ++by)
+    {
+        for (int bx = bx0; bx <= bx1; ++bx)
+        {
+            if (mm->mask[by * mm->blocks.width + bx])
+                return true;
+        }
+    }
+    return false;
+}
+
+int detect_objects_motion(IplImage * img, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        const TileParams * tp, MotionMask * mm, Detection * first, Detection * last)
+{
+    update_motion_mask(mm, img);
+
+    // Detections of windows which do not touch the changed blocks remain valid
+    vector<Detection> dets;
+    for (unsigned i = 0; i < mm->cache.size(); ++i)
+    {
+        if (!touches_mask(mm, mm->cache[i]))
+            dets.push_back(mm->cache[i]);
+    }
+
+    if (!mm->rects.empty())
+    {
+        // Areas of windows touching the changed blocks at each level, the
+        // margin covers the window and the resampling of the level
+        vector<CvRect> rois;
+        vector<int> levels;
+        const int level_count = tp->octaves * tp->levels_per_octave;
+        for (int l = 0; l < level_count; ++l)
+        {
+            const float scale = pow(2.0f, float(l) / tp->levels_per_octave);
+            const int mx = int(ceil((c->width + 2) * scale));
+            const int my = int(ceil((c->height + 2) * scale));
+            for (unsigned i = 0; i < mm->rects.size(); ++i)
+            {
+                const CvRect & rc = mm->rects[i];
+                const int x0 = max(0, rc.x - mx), y0 = max(0, rc.y - my);
+                const int x1 = min(img->width, rc.x + rc.width + mx);
+                const int y1 = min(img->height, rc.y + rc.height + my);
+                rois.push_back(cvRect(x0, y0, x1 - x0, y1 - y0));
+                levels.push_back(l);
+                levels.push_back(l);
+            }
+        }
+
+        vector<Detection> found(max<int>(last - first, 1) + 4096);
+        vector<int> roi_detections(rois.size());
+        const int n = detect_objects_roi_levels(img, c, sp, scan, tp, &rois[0], &levels[0], rois.size(),
+                &found[0], &found[0] + found.size(), &roi_detections[0]);
+
+        // Windows lying in more ROIs are listed for each of them
+        const int unique_n = unique_detections(&found[0], &found[0] + n);
+        for (int i = 0; i < unique_n; ++i)
+        {
+            if (touches_mask(mm, found[i]))
+                dets.push_back(found[i]);
+        }
+    }
+
+    mm->cache = dets;
+
+    const int n = min<int>(dets.size(), last - first);
+    copy(dets.begin(), dets.begin() + n, first);
+    return n;
+}
@@ -0,0 +1,304 @@
+/*
+ *  optimize.cpp
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Offline optimization of loaded classifiers.
+ *
+ */
+
+#include "optimize.h"
+#include "core_simple.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <vector>
+
+using namespace std;
+
+
+StageStatistics * create_stage_statistics(TClassifier * c)
+{
+    StageStatistics * st = new StageStatistics();
+    st->stage_count = c->stage_count;
+    st->windows = 0;
+    st->reached.assign(c->stage_count + 1, 0);
+    return st;
+}
+
+void release_stage_statistics(StageStatistics ** st)
+{
+    if (st && *st)
+    {
+        delete *st;
+        *st = 0;
+    }
+}
+
+void add_stage_histogram(StageStatistics * st, const int * hist)
+{
+    // hist[i] windows ended after i+1 stages, all of them reached stages 0..i
+    unsigned long count = 0;
+    for (int s = int(st->stage_count) - 1; s >= 0; --s)
+    {
+        count += hist[s];
+        st->reached[s] += count;
+    }
+    st->windows += count;
+}
+
+void collect_stage_statistics(PreprocessedImage * PI, TClassifier * c, StageStatistics * st)
+{
+    ClassifierEvalFunc eval = get_eval_func_intensity(c);
+    if (!eval)
+    {
+        return;
+    }
+
+    prepare_classifier(c, PI, RECALC_OFFSET);
+
+    vector<int> hist(c->stage_count, 0);
+    vector<int> features(c->stage_count);
+    vector<float> hypotheses(c->stage_count);
+
+    for (int y = 1; y < PI->sz.height - int(c->height) - 1; ++y)
+    {
+        for (int x = 1; x < PI->sz.width - int(c->width) - 1; ++x)
+        {
+            float response = 0.0f;
+            int stages = 0;
+            eval(PI, c, x, y, 0, c->stage_count, &features[0], &hypotheses[0], &response, &stages);
+            hist[stages-1]++;
+        }
+    }
+
+    add_stage_histogram(st, &hist[0]);
+}
+
+
+int bunch_plane_count(TClassifier * c, const unsigned * order, unsigned begin)
+{
+    unsigned used = 0;
+    const unsigned end = min(begin + BUNCH_SIZE, c->stage_count);
+    for (unsigned i = begin; i < end; ++i)
+    {
+        const unsigned s = order ? order[i] : i;
+        used |= 1u << c->stage[s].sz_type;
+    }
+    return __builtin_popcount(used);
+}
+
+/// Probability that a window evaluates the stage.
+static inline float reach_probability(StageStatistics * st, unsigned s)
+{
+    if (st->windows == 0)
+        return 1.0f;
+    return float(st->reached[s]) / st->windows;
+}
+
+/// Cost of bunches in the group [begin, end).
+/// Reordered groups are assumed to reject nothing before their last stage.
+static float group_cost(TClassifier * c, StageStatistics * st, ReorderParams * params, const unsigned * order, unsigned begin, unsigned end, bool reordered)
+{
+    float cost = 0.0f;
+    for (unsigned b = begin; b < end; b += BUNCH_SIZE)
+    {
+        const float p = reach_probability(st, reordered ? begin : b);
+        cost += p * (params->bunch_cost + params->plane_cost * bunch_plane_count(c, order, b));
+    }
+    return cost;
+}
+
+float predict_bunch16_cost(TClassifier * c, StageStatistics * st, ReorderParams * params, const unsigned * order)
+{
+    float cost = 0.0f;
+    for (unsigned g = 0; g < c->stage_count; g += params->group_size)
+    {
+        const unsigned end = min(g + params->group_size, c->stage_count);
+        bool reordered = false;
+        for (unsigned i = g; order && i < end; ++i)
+        {
+            reordered |= (order[i] != i);
+        }
+        cost += group_cost(c, st, params, order, g, end, reordered);
+    }
+    return cost;
+}
+
+
+/// Sort key of a stage within a group - plane cluster first, original position second.
+struct StageKey
+{
+    float cluster_pos; ///< Mean original position of stages using the same plane
+    int plane;         ///< Plane (sz_type) used by the stage
+    unsigned index;    ///< Original position
+
+    bool operator<(const StageKey & other) const
+    {
+        if (cluster_pos != other.cluster_pos)
+            return cluster_pos < other.cluster_pos;
+        if (plane != other.plane)
+            return plane < other.plane;
+        return index < other.index;
+    }
+};
+
+int reorder_stages(TClassifier * c, StageStatistics * st, ReorderParams * params, unsigned * order)
+{
+    assert(params->group_size % BUNCH_SIZE == 0);
+
+    for (unsigned i = 0; i < c->stage_count; ++i)
+    {
+        order[i] = i;
+    }
+
+    int reordered_groups = 0;
+
+    for (unsigned g = 0; g < c->stage_count; g += params->group_size)
+    {
+        const unsigned end = min(g + params->group_size, c->stage_count);
+
+        // Mean position of stages using each plane
+        float pos_sum[16] = {0};
+        int pos_count[16] = {0};
+        for (unsigned i = g; i < end; ++i)
+        {
+            pos_sum[int(c->stage[i].sz_type)] += i;
+            pos_count[int(c->stage[i].sz_type)]++;
+        }
+
+        vector<StageKey> keys;
+        for (unsigned i = g; i < end; ++i)
+        {
+            const int t = c->stage[i].sz_type;
+            StageKey k = { pos_sum[t] / pos_count[t], t, i };
+            keys.push_back(k);
+        }
+        sort(keys.begin(), keys.end());
+
+        vector<unsigned> candidate(order, order + c->stage_count);
+        for (unsigned i = g; i < end; ++i)
+        {
+            candidate[i] = keys[i - g].index;
+        }
+
+        // Keep the group only when it is predicted to be cheaper
+        const float cost_orig = group_cost(c, st, params, order, g, end, false);
+        const float cost_new = group_cost(c, st, params, &candidate[0], g, end, true);
+        if (cost_new < cost_orig)
+        {
+            copy(candidate.begin() + g, candidate.begin() + end, order + g);
+            ++reordered_groups;
+        }
+    }
+
+    return reordered_groups;
+}
+
+
+TClassifier * apply_stage_order(TClassifier * c, const unsigned * order, unsigned group_size)
+{
+    const unsigned n = c->stage_count;
+
+    // Validate the permutation - stages must stay in their group
+    vector<bool> used(n, false);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        if (order[i] >= n || used[order[i]] || (order[i] / group_size) != (i / group_size))
+        {
+            return 0;
+        }
+        used[order[i]] = true;
+    }
+
+    // Value range of each weak hypothesis
+    vector<float> alpha_min(n), alpha_max(n);
+    for (unsigned s = 0; s < n; ++s)
+    {
+        const float * alpha = c->alpha + s * c->alpha_count;
+        alpha_min[s] = *min_element(alpha, alpha + c->alpha_count);
+        alpha_max[s] = *max_element(alpha, alpha + c->alpha_count);
+    }
+
+    TClassifier * nc = new TClassifier(*c);
+    nc->model = C_DYNAMIC;
+    nc->alpha_table = 0; // created by init_classifier
+    nc->quant = 0;
+    nc->haar = 0;        // created by init_classifier
+    nc->stage = new TStage[n];
+    nc->alpha = new float[n * c->alpha_count];
+    nc->ranks = new int[8 * n];
+    fill(nc->ranks, nc->ranks + 8 * n, 0);
+
+    for (unsigned i = 0; i < n; ++i)
+    {
+        nc->stage[i] = c->stage[order[i]];
+        copy(c->alpha + order[i] * c->alpha_count, c->alpha + (order[i] + 1) * c->alpha_count, nc->alpha + i * c->alpha_count);
+    }
+
+    // Recalculate thresholds in changed groups.
+    // Any window accepted by the original classifier satisfies at each original
+    // checkpoint j: R(j) >= theta(j). Partial response of the new prefix S then is
+    // R(S) >= theta(j) + sum(min alpha of S\P(j)) - sum(max alpha of P(j)\S)
+    // and the tightest of these bounds is used as the new threshold.
+    for (unsigned g = 0; g < n; g += group_size)
+    {
+        const unsigned end = min(g + group_size, n);
+
+        bool changed = false;
+        for (unsigned i = g; i < end; ++i)
+        {
+            changed |= (order[i] != i);
+        }
+        if (!changed)
+        {
+            continue;
+        }
+
+        // Response before the group is known exactly for the first group
+        const float theta_prev = (g == 0) ? 0.0f : c->stage[g-1].theta_b;
+
+        vector<bool> in_new(n, false);
+        for (unsigned k = g; k < end; ++k)
+        {
+            in_new[order[k]] = true;
+
+            float theta = -FLT_MAX;
+
+            // Checkpoint before the group (empty original prefix)
+            {
+                float bound = theta_prev;
+                for (unsigned i = g; i <= k; ++i)
+                    bound += alpha_min[order[i]];
+                theta = max(theta, bound);
+            }
+
+            // Checkpoints within the group
+            for (unsigned j = g; j < end; ++j)
+            {
+                float bound = c->stage[j].theta_b;
+                for (unsigned i = g; i <= k; ++i) // S \ P(j)
+                {
+                    if (order[i] > j)
+                        bound += alpha_min[order[i]];
+                }
+                for (unsigned i = g; i <= j; ++i) // P(j) \ S
+                {
+                    if (!in_new[i])
+                        bound -= alpha_max[i];
+                }
+                theta = max(theta, bound);
+            }
+
+            nc->stage[k].theta_b = theta;
+        }
+    }
+
+    return nc;
+}
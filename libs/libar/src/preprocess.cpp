@@ -17,8 +17,12 @@
 #include <cv.h>
 #include "preprocess.h"
 #include "lbp.h"
+#include "rank.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <vector>
 
 using namespace std;
 
@@ -27,8 +31,9 @@ static float _kernel1[1] = {1};
 static float _kernel2[2] = {0.5,0.5};
 static float _kernel3[2] = {0.5,0.5};
 static float _kernel4[4] = {0.25,0.25,0.25,0.25};
+static float _kernel_4x4[CONV_PLANES_4x4][16];
 
-static CvMat kernel[4];
+static CvMat kernel[CONV_PLANES_4x4];
 
 void init_preprocess()
 {
@@ -36,6 +41,19 @@ void init_preprocess()
     cvInitMatHeader(&(kernel[1]), 1, 2, CV_32FC1, _kernel2, CV_AUTOSTEP);
     cvInitMatHeader(&(kernel[2]), 2, 1, CV_32FC1, _kernel3, CV_AUTOSTEP);
     cvInitMatHeader(&(kernel[3]), 2, 2, CV_32FC1, _kernel4, CV_AUTOSTEP);
+
+    // Box filters of blocks larger than 2x2
+    for (int h = 1; h <= 4; ++h)
+    {
+        for (int w = 1; w <= 4; ++w)
+        {
+            const int i = conv_plane(w, h);
+            if (i < CONV_PLANES)
+                continue;
+            fill(_kernel_4x4[i], _kernel_4x4[i] + w * h, 1.0f / (w * h));
+            cvInitMatHeader(&(kernel[i]), h, w, CV_32FC1, _kernel_4x4[i], CV_AUTOSTEP);
+        }
+    }
 }
 
 
@@ -77,6 +95,30 @@ void integrate(const IplImage* const src, IplImage * dst)
 	}
 }
 
+/// Integral image of squared intensities.
+/// Sums wrap around 2^32 but differences of four items (sums of areas up to
+/// 66051 pixels) are exact in unsigned arithmetic.
+static void integrate_squares(const IplImage* const src, IplImage * dst)
+{
+    assert(src->width == dst->width);
+    assert(src->height == dst->height);
+
+    const unsigned char* srcbase = (unsigned char*)src->imageData;
+    unsigned* dstbase = (unsigned*)dst->imageData;
+    const unsigned* prev = 0;
+
+    for (int y = 0; y < src->height; ++y, srcbase += src->widthStep, dstbase += dst->widthStep/sizeof(unsigned))
+    {
+        unsigned tmp = 0;
+        for (int x = 0; x < src->width; ++x)
+        {
+            tmp += unsigned(srcbase[x]) * srcbase[x];
+            dstbase[x] = prev ? tmp + prev[x] : tmp;
+        }
+        prev = dstbase;
+    }
+}
+
 static void interleaved_convolution(
         PreprocessedImage * PI,
         const IplImage* const src,
@@ -166,6 +208,39 @@ static int align_2(int x)
     return (x + 1) & ~1;
 }
 
+/// Allocate convolution planes of blocks larger than 2x2.
+/// They are allocated on demand as most classifiers do not need them.
+static void create_conv_4x4(PreprocessedImage * PI)
+{
+    for (int i = CONV_PLANES; i < CONV_PLANES_4x4; ++i)
+    {
+        CvSize conv_sz;
+
+        PI->block_count[i] = kernel[i].width * kernel[i].height;
+
+        conv_sz.width = align2(ceil((float)(PI->sz.width) / kernel[i].width));
+        conv_sz.height = align2(ceil((float)(PI->sz.height) / kernel[i].height));
+
+        cvInitImageHeader(&(PI->conv[i]), cvSize(conv_sz.width, conv_sz.height * PI->block_count[i]), IPL_DEPTH_8U, 1, 0, 4);
+        cvCreateData(&(PI->conv[i]));
+        cvZero(&(PI->conv[i]));
+
+        PI->cblock_size[i] = conv_sz.height * PI->conv[i].widthStep;
+    }
+}
+
+/// Allocate rank planes of i-th convolution image.
+static void create_rank_planes(PreprocessedImage * PI, int i)
+{
+    const IplImage * conv = &(PI->conv[i]);
+
+    cvInitImageHeader(&(PI->rank[i]), cvSize(conv->width, 9 * conv->height), IPL_DEPTH_8U, 1, 0, 4);
+    cvCreateData(&(PI->rank[i]));
+    cvZero(&(PI->rank[i]));
+
+    PI->rplane_size[i] = conv->height * conv->widthStep;
+}
+
 PreprocessedImage * create_preprocessed_image(CvSize src_sz)
 {
     PreprocessedImage* const PI = new PreprocessedImage();
@@ -265,15 +340,46 @@ void release_preprocessed_image(PreprocessedImage ** PI)
             cvReleaseData(&(p->iconv[i]));
             cvReleaseData(&(p->lbp[i]));
         }
+        for (int i = CONV_PLANES; i < CONV_PLANES_4x4; ++i)
+        {
+            if (p->conv[i].imageData)
+                cvReleaseData(&(p->conv[i]));
+        }
+        for (int i = 0; i < CONV_PLANES_4x4; ++i)
+        {
+            if (p->rank[i].imageData)
+                cvReleaseData(&(p->rank[i]));
+        }
+        if (p->integral2.imageData)
+            cvReleaseData(&(p->integral2));
+        if (p->response.imageData)
+            cvReleaseData(&(p->response));
+        if (p->stage_map.imageData)
+            cvReleaseData(&(p->stage_map));
         delete *PI;
         *PI = 0;
     }
 }
 
+/// Point 'intensity' back to its own data when it borrows an external plane
+/// (see preprocess_plane). The own data are outdated so no plane is valid.
+static void own_intensity(PreprocessedImage * PI)
+{
+    IplImage * img = &(PI->intensity);
+    if (img->imageData != img->imageDataOrigin)
+    {
+        img->imageData = img->imageDataOrigin;
+        img->widthStep = (img->width + 3) & ~3;
+        img->imageSize = img->widthStep * img->height;
+        PI->pp_options = 0;
+    }
+}
+
 void preprocess_image(IplImage * img, PreprocessedImage * PI, int options)
 {
     if (options & PP_COPY)
     {
+        own_intensity(PI);
         if (img->width == PI->sz.width && img->height == PI->sz.height)
 	{
 	  cvCopy(img, &(PI->intensity));
@@ -287,7 +393,18 @@ void preprocess_image(IplImage * img, PreprocessedImage * PI, int options)
     if (options & PP_INTEGRAL)
     {
         assert(options && PP_COPY);
-        integrate(img, &(PI->integral));
+        integrate(&(PI->intensity), &(PI->integral));
+    }
+
+    if (options & PP_INTEGRAL2)
+    {
+        assert(options && PP_COPY);
+        if (!PI->integral2.imageData)
+        {
+            cvInitImageHeader(&(PI->integral2), PI->sz, IPL_DEPTH_32S, 1, 0, 4);
+            cvCreateData(&(PI->integral2));
+        }
+        integrate_squares(&(PI->intensity), &(PI->integral2));
     }
 
     if (options & PP_CONV)
@@ -299,6 +416,33 @@ void preprocess_image(IplImage * img, PreprocessedImage * PI, int options)
         }
     }
 
+    if (options & PP_CONV_4x4)
+    {
+        assert(options && PP_CONV);
+        if (!PI->conv[CONV_PLANES].imageData)
+        {
+            create_conv_4x4(PI);
+        }
+        for (int i = CONV_PLANES; i < CONV_PLANES_4x4; ++i)
+        {
+            interleaved_convolution(PI, &(PI->intensity), i);
+        }
+    }
+
+    if (options & PP_RANK)
+    {
+        assert(options && PP_CONV);
+        const int planes = (options & PP_CONV_4x4) ? CONV_PLANES_4x4 : CONV_PLANES;
+        for (int i = 0; i < planes; ++i)
+        {
+            if (!PI->rank[i].imageData)
+            {
+                create_rank_planes(PI, i);
+            }
+            calc_ranks_3x3_sse(&(PI->conv[i]), &(PI->rank[i]));
+        }
+    }
+
     if (options & PP_ICONV)
     {
         assert(options && PP_CONV);
@@ -316,6 +460,252 @@ void preprocess_image(IplImage * img, PreprocessedImage * PI, int options)
             calc_LBP11_sse(&(PI->conv[i]), &(PI->lbp[i]));
         }
     }
+
+    // Planes not calculated now are outdated when the intensity changed
+    PI->pp_options = (options & PP_COPY) ? options : (PI->pp_options | options);
+}
+
+
+/// Integral image (or integral of squares) from the row y0, the rows above must be valid.
+/// Same values as integrate and integrate_squares.
+template <bool squares>
+static void integrate_rows(const IplImage * src, IplImage * dst, int y0)
+{
+    const int step = dst->widthStep / sizeof(unsigned);
+    for (int y = y0; y < src->height; ++y)
+    {
+        const unsigned char * s = (unsigned char*)src->imageData + y * src->widthStep;
+        unsigned * d = (unsigned*)dst->imageData + y * step;
+        unsigned tmp = 0;
+        for (int x = 0; x < src->width; ++x)
+        {
+            tmp += squares ? unsigned(s[x]) * s[x] : unsigned(s[x]);
+            d[x] = (y > 0) ? tmp + d[x - step] : tmp;
+        }
+    }
+}
+
+/// Recalculate convolution plane i at positions using pixels of the rectangle
+/// (the kernel anchor is the top-left corner). Same values as interleaved_convolution.
+/// \returns Changed area of the plane (in the coordinates of one block)
+static CvRect update_convolution(PreprocessedImage * PI, int i, CvRect r)
+{
+    const IplImage * src = &(PI->intensity);
+    IplImage * tmp = &(PI->tmp);
+    IplImage * conv = &(PI->conv[i]);
+    const CvMat * k = &(kernel[i]);
+    const int kw = k->cols, kh = k->rows;
+
+    const int x0 = max(0, r.x - kw + 1), y0 = max(0, r.y - kh + 1);
+    const int x1 = r.x + r.width, y1 = r.y + r.height;
+
+    // Input covers kernels of all the positions so they match the filter of the whole image
+    const CvRect in_rect = cvRect(x0, y0, min(src->width, x1 + kw - 1) - x0, min(src->height, y1 + kh - 1) - y0);
+    CvMat in, out;
+    cvGetSubRect(src, &in, in_rect);
+    cvGetSubRect(tmp, &out, in_rect);
+    cvFilter2D(&in, &out, k, cvPoint(0,0));
+
+    const int block_size = PI->cblock_size[i];
+    for (int y = y0; y < y1 && (y / kh) * kh < tmp->height - kh; ++y)
+    {
+        const unsigned char * t = (unsigned char*)tmp->imageData + y * tmp->widthStep;
+        unsigned char * dst = (unsigned char*)conv->imageData + (y % kh) * kw * block_size + (y / kh) * conv->widthStep;
+        for (int x = x0; x < x1 && x / kw < conv->width; ++x)
+        {
+            dst[(x % kw) * block_size + x / kw] = t[x] ^ 0x80;
+        }
+    }
+
+    return cvRect(x0 / kw, y0 / kh, (x1 - 1) / kw - x0 / kw + 1, (y1 - 1) / kh - y0 / kh + 1);
+}
+
+/// Recalculate 'iconv' of the changed area of 'conv' in all blocks. Same values as rearrange_convolution.
+static void update_iconv(PreprocessedImage * PI, int i, CvRect a)
+{
+    const IplImage * conv = &(PI->conv[i]);
+    IplImage * iconv = &(PI->iconv[i]);
+    const int rows = PI->cblock_size[i] / conv->widthStep;
+
+    for (int b = 0; b < PI->block_count[i]; ++b)
+    {
+        const int r0 = (b * rows + a.y) / 2;
+        const int r1 = (b * rows + a.y + a.height - 1) / 2;
+        for (int r = r0; r <= r1 && 2 * r + 1 < conv->height - 1; ++r)
+        {
+            const char * row1 = conv->imageData + 2 * r * conv->widthStep;
+            const char * row2 = row1 + conv->widthStep;
+            char * dst = iconv->imageData + r * iconv->widthStep;
+            for (int x = a.x & ~1; x < a.x + a.width && x < conv->width - 1; x += 2)
+            {
+                dst[2*x+0] = row1[x+0];
+                dst[2*x+1] = row1[x+1];
+                dst[2*x+2] = row2[x+0];
+                dst[2*x+3] = row2[x+1];
+            }
+        }
+    }
+}
+
+/// Rectangles in 'sz' coordinates scaled from the source and grown by the halo.
+static void map_rects(const CvRect * rects, int count, float sx, float sy, int halo, CvSize sz, vector<CvRect> & res)
+{
+    res.clear();
+    for (int i = 0; i < count; ++i)
+    {
+        const int x0 = max(0, int(floor(rects[i].x * sx)) - halo);
+        const int y0 = max(0, int(floor(rects[i].y * sy)) - halo);
+        const int x1 = min(sz.width, int(ceil((rects[i].x + rects[i].width) * sx)) + halo);
+        const int y1 = min(sz.height, int(ceil((rects[i].y + rects[i].height) * sy)) + halo);
+        if (x1 > x0 && y1 > y0)
+            res.push_back(cvRect(x0, y0, x1 - x0, y1 - y0));
+    }
+}
+
+static bool tile_changed(const IplImage * a, const IplImage * b, CvRect t)
+{
+    for (int y = t.y; y < t.y + t.height; ++y)
+    {
+        if (memcmp(a->imageData + y * a->widthStep + t.x, b->imageData + y * b->widthStep + t.x, t.width))
+            return true;
+    }
+    return false;
+}
+
+int preprocess_image_incremental(IplImage * img, PreprocessedImage * PI, int options, const CvRect * rects, int count)
+{
+    options |= PP_COPY;
+    own_intensity(PI);
+
+    const CvSize tiles = cvSize((PI->sz.width + PP_TILE - 1) / PP_TILE, (PI->sz.height + PP_TILE - 1) / PP_TILE);
+
+    if ((PI->pp_options & options) != options)
+    {
+        preprocess_image(img, PI, options);
+        return tiles.width * tiles.height;
+    }
+
+    // New intensity image
+    const IplImage * fresh = img;
+    if (img->width != PI->sz.width || img->height != PI->sz.height)
+    {
+        cvResize(img, &(PI->tmp), CV_INTER_LINEAR);
+        fresh = &(PI->tmp);
+    }
+
+    // Tiles to compare, the halo covers interpolation of the resize
+    vector<unsigned char> compare(tiles.width * tiles.height, rects ? 0 : 1);
+    if (rects)
+    {
+        vector<CvRect> mapped;
+        map_rects(rects, count, float(PI->sz.width) / img->width, float(PI->sz.height) / img->height, 4, PI->sz, mapped);
+        for (unsigned i = 0; i < mapped.size(); ++i)
+        {
+            const CvRect & r = mapped[i];
+            for (int ty = r.y / PP_TILE; ty <= (r.y + r.height - 1) / PP_TILE; ++ty)
+                for (int tx = r.x / PP_TILE; tx <= (r.x + r.width - 1) / PP_TILE; ++tx)
+                    compare[ty * tiles.width + tx] = 1;
+        }
+    }
+
+    // Runs of changed tiles in rows
+    vector<CvRect> dirty;
+    int changed = 0;
+    for (int ty = 0; ty < tiles.height; ++ty)
+    {
+        int run = -1;
+        for (int tx = 0; tx < tiles.width; ++tx)
+        {
+            const CvRect t = cvRect(tx * PP_TILE, ty * PP_TILE,
+                    min(PP_TILE, PI->sz.width - tx * PP_TILE), min(PP_TILE, PI->sz.height - ty * PP_TILE));
+            if (!compare[ty * tiles.width + tx] || !tile_changed(fresh, &(PI->intensity), t))
+            {
+                run = -1;
+                continue;
+            }
+            ++changed;
+            if (run < 0)
+            {
+                run = dirty.size();
+                dirty.push_back(t);
+            }
+            else
+            {
+                dirty[run].width += t.width;
+            }
+        }
+    }
+
+    if (dirty.empty())
+        return 0;
+
+    // Intensity of all changed tiles first, planes read their surroundings
+    int y_min = PI->sz.height;
+    for (unsigned d = 0; d < dirty.size(); ++d)
+    {
+        const CvRect & r = dirty[d];
+        for (int y = r.y; y < r.y + r.height; ++y)
+        {
+            memcpy(PI->intensity.imageData + y * PI->intensity.widthStep + r.x,
+                   fresh->imageData + y * fresh->widthStep + r.x, r.width);
+        }
+        y_min = min(y_min, r.y);
+    }
+
+    if (options & PP_INTEGRAL)
+    {
+        integrate_rows<false>(&(PI->intensity), &(PI->integral), y_min);
+    }
+
+    if (options & PP_INTEGRAL2)
+    {
+        integrate_rows<true>(&(PI->intensity), &(PI->integral2), y_min);
+    }
+
+    if (!(options & PP_CONV))
+        return changed;
+
+    // Convolution planes, then the planes calculated from them
+    const int planes = (options & PP_CONV_4x4) ? CONV_PLANES_4x4 : CONV_PLANES;
+    vector<CvRect> areas[CONV_PLANES_4x4];
+    for (unsigned d = 0; d < dirty.size(); ++d)
+    {
+        for (int i = 0; i < planes; ++i)
+        {
+            areas[i].push_back(update_convolution(PI, i, dirty[d]));
+        }
+    }
+
+    for (int i = 0; i < planes; ++i)
+    {
+        const int rows = PI->cblock_size[i] / PI->conv[i].widthStep;
+        for (unsigned d = 0; d < areas[i].size(); ++d)
+        {
+            const CvRect & a = areas[i][d];
+
+            if ((options & PP_ICONV) && i < CONV_PLANES)
+            {
+                update_iconv(PI, i, a);
+            }
+
+            for (int b = 0; b < PI->block_count[i]; ++b)
+            {
+                // LBP is centered in 3x3 areas, ranks have the areas at the top-left corner
+                if ((options & PP_LBP) && i < CONV_PLANES)
+                {
+                    calc_LBP11_sse_rect(&(PI->conv[i]), &(PI->lbp[i]),
+                            cvRect(a.x - 1, b * rows + a.y - 1, a.width + 2, a.height + 2));
+                }
+                if (options & PP_RANK)
+                {
+                    calc_ranks_3x3_rect(&(PI->conv[i]), &(PI->rank[i]),
+                            cvRect(a.x - 2, b * rows + a.y - 2, a.width + 2, a.height + 2));
+                }
+            }
+        }
+    }
+
+    return changed;
 }
 
 
@@ -331,8 +721,8 @@ PreprocessedPyramid * create_pyramid(CvSize base_sz, CvSize min_sz, int octaves,
     for (int octave = 0; octave < octaves; ++octave)
     {
         CvSize sz = base_sz;
-        sz.width /= octave + 1;
-        sz.height /= octave + 1;
+        sz.width >>= octave;
+        sz.height >>= octave;
 
         for (int i = 0; i < levels_per_octave; ++i)
         {
@@ -347,6 +737,37 @@ PreprocessedPyramid * create_pyramid(CvSize base_sz, CvSize min_sz, int octaves,
     return PP;
 }
 
+int insert_image_incremental(IplImage * img, PreprocessedPyramid * PP, int options, const CvRect * rects, int count)
+{
+    options |= PP_COPY;
+    int changed = preprocess_image_incremental(img, PP->PI[0], options, rects, count);
+
+    const int max_level = std::min<int>(unsigned(PP->octaves * PP->levels_per_octave), PP->PI.size());
+
+    // Same order as insert_image; rectangles are mapped to the source of each level
+    vector<CvRect> mapped;
+    for (int octave_base = 0; octave_base < max_level; octave_base += PP->levels_per_octave)
+    {
+        IplImage* const src = &(PP->PI[octave_base]->intensity);
+        if (rects)
+        {
+            map_rects(rects, count, float(src->width) / img->width, float(src->height) / img->height, 0, cvGetSize(src), mapped);
+        }
+        const CvRect * src_rects = rects ? (mapped.empty() ? 0 : &mapped[0]) : 0;
+        const int src_count = mapped.size();
+
+        if (rects && mapped.empty())
+            continue; // Nothing changed at this scale
+
+        for (int i = 1; i <= PP->levels_per_octave && i + octave_base < max_level; ++i)
+        {
+            changed += preprocess_image_incremental(src, PP->PI[octave_base+i], options, src_rects, src_count);
+        }
+    }
+
+    return changed;
+}
+
 void release_pyramid(PreprocessedPyramid** PP)
 {
     if (PP && *PP)
@@ -362,11 +783,31 @@ void release_pyramid(PreprocessedPyramid** PP)
     }
 }
 
-void insert_image(IplImage * img, PreprocessedPyramid * PP, int options)
+void preprocess_plane(const unsigned char * data, int step, CvSize sz, PreprocessedImage * PI, int options)
+{
+    IplImage plane;
+    cvInitImageHeader(&plane, sz, IPL_DEPTH_8U, 1, 0, 4);
+    cvSetData(&plane, (void*)data, step);
+
+    if (sz.width == PI->sz.width && sz.height == PI->sz.height)
+    {
+        // The plane becomes the intensity image, the own data are kept in imageDataOrigin
+        IplImage * img = &(PI->intensity);
+        img->imageData = plane.imageData;
+        img->widthStep = step;
+        img->imageSize = step * sz.height;
+        preprocess_image(&plane, PI, options & ~PP_COPY);
+        PI->pp_options = options | PP_COPY;
+    }
+    else
+    {
+        preprocess_image(&plane, PI, options | PP_COPY);
+    }
+}
+
+/// Preprocess levels above the base from the intensity of the base of each octave.
+static void insert_levels(PreprocessedPyramid * PP, int options)
 {
-    options |= PP_COPY;
-    preprocess_image(img, PP->PI[0], options);
-    
     const int max_level = std::min<int>(unsigned(PP->octaves * PP->levels_per_octave), PP->PI.size());
 
     for (int octave_base = 0; octave_base < max_level; octave_base += PP->levels_per_octave)
@@ -377,10 +818,24 @@ void insert_image(IplImage * img, PreprocessedPyramid * PP, int options)
             preprocess_image(src, PP->PI[octave_base+i], options);
         }
         
-        if ((octave_base + PP)->levels_per_octave < max_level)
+        if (octave_base + PP->levels_per_octave < max_level)
 	{
 	  preprocess_image(src, PP->PI[octave_base+PP->levels_per_octave], options);
 	}
     }
 }
 
+void insert_image(IplImage * img, PreprocessedPyramid * PP, int options)
+{
+    options |= PP_COPY;
+    preprocess_image(img, PP->PI[0], options);
+    insert_levels(PP, options);
+}
+
+void insert_plane(const unsigned char * data, int step, CvSize sz, PreprocessedPyramid * PP, int options)
+{
+    options |= PP_COPY;
+    preprocess_plane(data, step, sz, PP->PI[0], options);
+    insert_levels(PP, options);
+}
+
@@ -0,0 +1,150 @@
+/*
+ *  quant.cpp
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Quantised representation of classifiers.
+ *
+ */
+
+#include "quant.h"
+#include "const.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iterator>
+#include <vector>
+
+using namespace std;
+
+
+static inline short quantise(float v, float scale)
+{
+    const float q = floorf(v / scale + 0.5f);
+    return short(max(-32768.0f, min(32767.0f, q)));
+}
+
+int quantise_classifier(TClassifier * c)
+{
+    if (!c->alpha_table || c->fsz != FSZ_2x2 || !(c->tp == LRD || c->tp == LRP || c->tp == LBP))
+    {
+        return 0;
+    }
+
+    // Range of values which must be representable; partial sums of a bunch
+    // of 16 stages fit int16 without saturation, the engines accumulate the
+    // response across bunches in int32
+    float max_alpha = 0.0f;
+    for (unsigned i = 0; i < c->stage_count * c->alpha_stride; ++i)
+    {
+        max_alpha = max(max_alpha, fabsf(c->alpha_table[i]));
+    }
+    float max_abs = max(16.0f * max_alpha, fabsf(c->threshold));
+    for (unsigned s = 0; s < c->stage_count; ++s)
+    {
+        max_abs = max(max_abs, fabsf(c->stage[s].theta_b));
+    }
+    if (max_abs == 0.0f)
+    {
+        return 0;
+    }
+
+    release_quant_model(&c->quant);
+
+    const unsigned n = c->stage_count;
+    const unsigned padded = n + 15;
+
+    TQuantModel * q = new TQuantModel();
+    q->scale = max_abs / 16383.0f;
+    q->stage_count = n;
+    q->alpha_stride = c->alpha_stride;
+    q->threshold = quantise(c->threshold, q->scale);
+    q->stage = new TStageQ[padded];
+    q->theta = new short[padded];
+    q->alpha = new short[padded * q->alpha_stride];
+    q->ranks = new short[8 * padded];
+
+    fill((char*)q->stage, (char*)(q->stage + padded), 0);
+    fill(q->theta, q->theta + padded, 0);
+    fill(q->alpha, q->alpha + padded * q->alpha_stride, 0);
+    fill(q->ranks, q->ranks + 8 * padded, 0);
+
+    for (unsigned s = 0; s < n; ++s)
+    {
+        const TStage & stage = c->stage[s];
+        TStageQ & rec = q->stage[s];
+        rec.x = stage.x;
+        rec.y = stage.y;
+        rec.w = stage.w;
+        rec.h = stage.h;
+        rec.A = stage.A;
+        rec.B = stage.B;
+        rec.sz_type = stage.sz_type;
+        rec.pos_type = stage.pos_type;
+        rec.alpha = s * q->alpha_stride;
+
+        q->theta[s] = quantise(stage.theta_b, q->scale);
+
+        for (unsigned a = 0; a < q->alpha_stride; ++a)
+        {
+            q->alpha[rec.alpha + a] = quantise(stage.alpha[a], q->scale);
+        }
+
+        if (c->tp == LRD || c->tp == LRP)
+        {
+            for (int t = 0; t < 4; ++t)
+            {
+                q->ranks[8 * s + 2 * t + 0] = rank_table[t][int(stage.A)];
+                q->ranks[8 * s + 2 * t + 1] = rank_table[t][int(stage.B)];
+            }
+        }
+    }
+
+    c->quant = q;
+    return 1;
+}
+
+void release_quant_model(TQuantModel ** q)
+{
+    if (q && *q)
+    {
+        delete [] (*q)->stage;
+        delete [] (*q)->theta;
+        delete [] (*q)->alpha;
+        delete [] (*q)->ranks;
+        delete *q;
+        *q = 0;
+    }
+}
+
+
+static bool operator<(const Detection & a, const Detection & b)
+{
+    if (a.y != b.y) return a.y < b.y;
+    return a.x < b.x;
+}
+
+void validate_quant_scan(PreprocessedImage * PI, TClassifier * c, ScanParams * sp, ScanImageFunc float_scan, ScanImageFunc quant_scan, QuantValidation * v)
+{
+    const int N = 10000;
+    vector<Detection> a(N), b(N), diff;
+
+    a.resize(float_scan(PI, c, sp, &a[0], &a[0] + N, 0));
+    b.resize(quant_scan(PI, c, sp, &b[0], &b[0] + N, 0));
+    sort(a.begin(), a.end());
+    sort(b.begin(), b.end());
+
+    v->float_detections += a.size();
+    v->quant_detections += b.size();
+    set_difference(a.begin(), a.end(), b.begin(), b.end(), back_inserter(diff));
+    v->lost += diff.size();
+    diff.clear();
+    set_difference(b.begin(), b.end(), a.begin(), a.end(), back_inserter(diff));
+    v->added += diff.size();
+}
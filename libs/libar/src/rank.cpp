@@ -0,0 +1,113 @@
+
+#include "rank.h"
+
+#include <cv.h>
+#include <cxcore.h>
+#include <emmintrin.h>
+#include <cassert>
+
+
+/// Ranks of 16 neighbouring areas.
+static inline void calc_ranks_16(const signed char * src, int step, unsigned char * dst, int plane_size)
+{
+    __m128i v[9];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+        {
+            v[3 * i + j] = _mm_loadu_si128((const __m128i*)(src + i * step + j));
+        }
+
+    for (int k = 0; k < 9; ++k, dst += plane_size)
+    {
+        __m128i rank = _mm_setzero_si128();
+        for (int j = 0; j < 9; ++j) // cmpgt is -1 for true
+        {
+            rank = _mm_sub_epi8(rank, _mm_cmpgt_epi8(v[k], v[j]));
+        }
+        _mm_storeu_si128((__m128i*)dst, rank);
+    }
+}
+
+/// Ranks of single area.
+static inline void calc_ranks_1(const signed char * src, int step, unsigned char * dst, int plane_size)
+{
+    signed char v[9];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+        {
+            v[3 * i + j] = *(src + i * step + j);
+        }
+
+    for (int k = 0; k < 9; ++k, dst += plane_size)
+    {
+        int rank = 0;
+        for (int j = 0; j < 9; ++j)
+        {
+            rank += v[k] > v[j];
+        }
+        *dst = rank;
+    }
+}
+
+
+void calc_ranks_3x3_sse(IplImage * src, IplImage * dst)
+{
+    assert(src->widthStep == dst->widthStep);
+    assert(dst->height >= 9 * src->height);
+
+    const int plane_size = src->height * src->widthStep;
+
+    for (int y = 0; y < src->height - 2; ++y)
+    {
+        const signed char * src_row = (signed char*)(src->imageData + y * src->widthStep);
+        unsigned char * dst_row = (unsigned char*)(dst->imageData + y * dst->widthStep);
+
+        int x = 0;
+        // Vector loads read up to x+17 which must stay in the row (the last row of the image)
+        for (; x + 18 <= src->widthStep; x += 16)
+        {
+            calc_ranks_16(src_row + x, src->widthStep, dst_row + x, plane_size);
+        }
+        for (; x < src->width - 2; ++x)
+        {
+            calc_ranks_1(src_row + x, src->widthStep, dst_row + x, plane_size);
+        }
+    }
+}
+
+
+
+void calc_ranks_3x3_rect(IplImage * src, IplImage * dst, CvRect r)
+{
+    assert(src->widthStep == dst->widthStep);
+    assert(dst->height >= 9 * src->height);
+
+    const int plane_size = src->height * src->widthStep;
+    const int y0 = (r.y > 0) ? r.y : 0;
+    const int y1 = (r.y + r.height < src->height - 2) ? r.y + r.height : src->height - 2;
+    const int x0 = (r.x > 0) ? r.x : 0;
+    const int x1 = r.x + r.width;
+
+    for (int y = y0; y < y1; ++y)
+    {
+        const signed char * src_row = (signed char*)(src->imageData + y * src->widthStep);
+        unsigned char * dst_row = (unsigned char*)(dst->imageData + y * dst->widthStep);
+
+        // Same values as calc_ranks_3x3_sse, vector loads stay in the row
+        int x = x0;
+        while (x < x1)
+        {
+            if (x + 18 <= src->widthStep)
+            {
+                calc_ranks_16(src_row + x, src->widthStep, dst_row + x, plane_size);
+                x += 16;
+            }
+            else
+            {
+                if (x < src->width - 2)
+                    calc_ranks_1(src_row + x, src->widthStep, dst_row + x, plane_size);
+                ++x;
+            }
+        }
+    }
+}
@@ -0,0 +1,149 @@
+/*
+ *  response.cpp
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Dense response maps (see response.h).
+ *
+ */
+
+#include "response.h"
+
+#include <cv.h>
+#include <cfloat>
+#include <climits>
+#include <vector>
+#include <emmintrin.h>
+
+using namespace std;
+
+
+/// Make sure the response planes of the image exist and have the given depth.
+static void create_response_planes(PreprocessedImage * PI, int depth)
+{
+    if (PI->response.imageData && PI->response.depth != depth)
+    {
+        cvReleaseData(&(PI->response));
+    }
+    if (!PI->response.imageData)
+    {
+        cvInitImageHeader(&(PI->response), PI->sz, depth, 1, 0, 16);
+        cvCreateData(&(PI->response));
+    }
+    if (!PI->stage_map.imageData)
+    {
+        cvInitImageHeader(&(PI->stage_map), PI->sz, IPL_DEPTH_16U, 1, 0, 16);
+        cvCreateData(&(PI->stage_map));
+    }
+}
+
+/// Convert row of integers to 16 bit with saturation.
+/// \param sign_flip 0x8000 when the result is unsigned (values are offset by SHRT_MIN)
+static void pack_row_16(const int * src, short * dst, int n, short sign_flip)
+{
+    const __m128i flip = _mm_set1_epi16(sign_flip);
+    const __m128i offset = _mm_set1_epi32((sign_flip) ? SHRT_MIN : 0);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m128i lo = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(src + i)), offset);
+        const __m128i hi = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(src + i + 4)), offset);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_packs_epi32(lo, hi), flip));
+    }
+    for (; i < n; ++i)
+    {
+        const int v = min(max(src[i] + ((sign_flip) ? SHRT_MIN : 0), SHRT_MIN), SHRT_MAX);
+        dst[i] = short(v) ^ sign_flip;
+    }
+}
+
+
+int response_map(PreprocessedImage * PI, TClassifier * c, ClassifierEvalFunc eval, unsigned border)
+{
+    create_response_planes(PI, IPL_DEPTH_32F);
+    cvSet(&(PI->response), cvScalar(-FLT_MAX));
+    cvZero(&(PI->stage_map));
+
+    if (PI->sz.width < int(c->width + 2 * border) || PI->sz.height < int(c->height + 2 * border))
+    {
+        return 0;
+    }
+
+    const unsigned x_end = PI->sz.width - c->width - border;
+    const unsigned y_end = PI->sz.height - c->height - border;
+
+    vector<int> features(c->stage_count);
+    vector<float> hypotheses(c->stage_count);
+    vector<int> stages(x_end);
+
+    for (unsigned y = border; y < y_end; ++y)
+    {
+        float * response = (float*)(PI->response.imageData + y * PI->response.widthStep);
+
+        for (unsigned x = border; x < x_end; ++x)
+        {
+            response[x] = 0.0f;
+            stages[x] = 0;
+            eval(PI, c, x, y, 0, c->stage_count, &features[0], &hypotheses[0], response + x, &stages[x]);
+        }
+
+        short * stage_row = (short*)(PI->stage_map.imageData + y * PI->stage_map.widthStep);
+        pack_row_16(&stages[border], stage_row + border, x_end - border, SHRT_MIN);
+    }
+
+    return (x_end - border) * (y_end - border);
+}
+
+
+int response_map_q(PreprocessedImage * PI, TClassifier * c, QuantEvalFunc eval, unsigned border)
+{
+    create_response_planes(PI, IPL_DEPTH_16S);
+    cvSet(&(PI->response), cvScalar(SHRT_MIN));
+    cvZero(&(PI->stage_map));
+
+    if (!c->quant || PI->sz.width < int(c->width + 2 * border) || PI->sz.height < int(c->height + 2 * border))
+    {
+        return 0;
+    }
+
+    const unsigned x_end = PI->sz.width - c->width - border;
+    const unsigned y_end = PI->sz.height - c->height - border;
+
+    vector<int> responses(x_end);
+    vector<int> stages(x_end);
+
+    for (unsigned y = border; y < y_end; ++y)
+    {
+        for (unsigned x = border; x < x_end; ++x)
+        {
+            responses[x] = 0;
+            stages[x] = 0;
+            eval(PI, c->quant, x, y, &responses[x], &stages[x]);
+        }
+
+        short * response_row = (short*)(PI->response.imageData + y * PI->response.widthStep);
+        short * stage_row = (short*)(PI->stage_map.imageData + y * PI->stage_map.widthStep);
+        pack_row_16(&responses[border], response_row + border, x_end - border, 0);
+        pack_row_16(&stages[border], stage_row + border, x_end - border, SHRT_MIN);
+    }
+
+    return (x_end - border) * (y_end - border);
+}
+
+
+int response_map_pyramid(PreprocessedPyramid * PP, TClassifier * c, ClassifierEvalFunc eval, unsigned border, int options)
+{
+    int windows = 0;
+    for (unsigned i = 0; i < PP->PI.size(); ++i)
+    {
+        prepare_classifier(c, PP->PI[i], options);
+        windows += response_map(PP->PI[i], c, eval, border);
+    }
+    return windows;
+}
+
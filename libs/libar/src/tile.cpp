@@ -0,0 +1,384 @@
+/*
+ *  tile.cpp
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Tiled multi-scale detection (see tile.h).
+ *
+ */
+
+#include "tile.h"
+
+#include <cv.h>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+
+/// Margin around windows in a tile (covers the border of all engines)
+#define TILE_MARGIN (2)
+
+/// Initial size of the detections buffer of a tile scan (grows when full)
+#define TILE_DETECTIONS (4096)
+
+/// One tile of a pyramid level.
+struct Tile
+{
+    float scale;   ///< Scale of the level relative to the source
+    CvRect region; ///< Tile in the level coordinates
+    CvRect core;   ///< Window positions owned by the tile (level coordinates)
+};
+
+
+/// Split window positions [0, n) of a level of the given size to tiles.
+/// \param positions Number of window positions in the direction
+/// \param level_sz Size of the level in the direction
+/// \param tile_sz Size of the tile in the direction
+/// \param core_sz Size of the core of tiles
+/// \param starts Tile starts (level coordinates)
+/// \param cores Core starts, the core i ends at cores[i+1]
+static void split_level(int positions, int level_sz, int tile_sz, int core_sz, vector<int> & starts, vector<int> & cores)
+{
+    for (int p = 0; p < positions; p += core_sz)
+    {
+        starts.push_back(max(0, min(p - TILE_MARGIN, level_sz - tile_sz)));
+        cores.push_back(p);
+    }
+    cores.push_back(positions);
+}
+
+/// Detection in source coordinates.
+static Detection to_source(const Detection & d, float scale)
+{
+    Detection r = d;
+    r.x = d.x * scale;
+    r.y = d.y * scale;
+    r.width = d.width * scale;
+    r.height = d.height * scale;
+    return r;
+}
+
+/// Resample the tile from the source, preprocess it and scan it.
+/// Detections in the core of the tile are appended to 'dets' in level coordinates.
+/// When the scan fills the buffer, it grows to the number of windows of the tile
+/// and the tile is scanned again so no detection is lost.
+static void scan_tile(IplImage * img, PreprocessedImage * PI, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        const TileParams * tp, const Tile & t, vector<Detection> & buffer, vector<Detection> & dets)
+{
+    // Source area of the tile
+    CvRect src_rect = cvRect(
+        int(t.region.x * t.scale), int(t.region.y * t.scale),
+        int(ceil(t.region.width * t.scale)), int(ceil(t.region.height * t.scale)));
+    src_rect.width = min(src_rect.width, img->width - src_rect.x);
+    src_rect.height = min(src_rect.height, img->height - src_rect.y);
+
+    // Header of the area (the source itself is shared by the threads)
+    CvMat sub;
+    IplImage sub_img;
+    cvGetSubRect(img, &sub, src_rect);
+    cvGetImage(&sub, &sub_img);
+
+    preprocess_image(&sub_img, PI, tp->pp_options | PP_COPY);
+
+    int n = scan(PI, c, sp, &buffer[0], &buffer[0] + buffer.size(), 0);
+    if (n == int(buffer.size()))
+    {
+        buffer.resize(max<size_t>(buffer.size() + 1, size_t(PI->sz.width) * PI->sz.height));
+        n = scan(PI, c, sp, &buffer[0], &buffer[0] + buffer.size(), 0);
+    }
+
+    for (Detection * d = &buffer[0]; d != &buffer[0] + n; ++d)
+    {
+        const int x = d->x + t.region.x;
+        const int y = d->y + t.region.y;
+        if (x < t.core.x || x >= t.core.x + t.core.width || y < t.core.y || y >= t.core.y + t.core.height)
+        {
+            continue; // Owned by a neighbouring tile
+        }
+        Detection r = *d;
+        r.x = x;
+        r.y = y;
+        dets.push_back(r);
+    }
+}
+
+
+int detect_objects_tiled(IplImage * img, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        const TileParams * tp, Detection * first, Detection * last)
+{
+    const int core = max(tp->tile_size, 16);
+    // Preprocessed images are aligned to 2 pixels, odd tiles would be resized to them
+    const CvSize tile_sz = cvSize((core + c->width + 2 * TILE_MARGIN + 1) & ~1, (core + c->height + 2 * TILE_MARGIN + 1) & ~1);
+
+    // Tiles of the constant size are scanned in parallel with one prepared
+    // classifier, levels smaller than the tile are scanned one by one.
+    vector<Tile> tiles;
+    vector<Tile> small;
+
+    const int levels = tp->octaves * tp->levels_per_octave;
+    for (int l = 0; l < levels; ++l)
+    {
+        const float scale = pow(2.0f, float(l) / tp->levels_per_octave);
+        const CvSize level_sz = cvSize(int(img->width / scale) & ~1, int(img->height / scale) & ~1);
+
+        if (level_sz.width <= int(c->width) + 2 || level_sz.height <= int(c->height) + 2)
+            break;
+
+        if (level_sz.width < tile_sz.width || level_sz.height < tile_sz.height)
+        {
+            const int w = level_sz.width, h = level_sz.height;
+            Tile t = { scale, cvRect(0, 0, w, h), cvRect(0, 0, w, h) };
+            small.push_back(t);
+            continue;
+        }
+
+        vector<int> xs, ys, x_cores, y_cores;
+        split_level(level_sz.width - c->width, level_sz.width, tile_sz.width, core, xs, x_cores);
+        split_level(level_sz.height - c->height, level_sz.height, tile_sz.height, core, ys, y_cores);
+
+        for (unsigned j = 0; j < ys.size(); ++j)
+        {
+            for (unsigned i = 0; i < xs.size(); ++i)
+            {
+                Tile t = {
+                    scale,
+                    cvRect(xs[i], ys[j], tile_sz.width, tile_sz.height),
+                    cvRect(x_cores[i], y_cores[j], x_cores[i+1] - x_cores[i], y_cores[j+1] - y_cores[j])
+                };
+                tiles.push_back(t);
+            }
+        }
+    }
+
+    vector<Detection> dets;
+
+    if (!tiles.empty())
+    {
+        // All tiles have the same size, the classifier is prepared once
+        PreprocessedImage * PI = create_preprocessed_image(tile_sz);
+        prepare_classifier(c, PI, tp->pc_options);
+        release_preprocessed_image(&PI);
+    }
+
+    #pragma omp parallel
+    {
+        PreprocessedImage * PI = create_preprocessed_image(tile_sz);
+        vector<Detection> buffer(TILE_DETECTIONS);
+        vector<Detection> local, tile_dets;
+
+        #pragma omp for schedule(dynamic)
+        for (int i = 0; i < int(tiles.size()); ++i)
+        {
+            tile_dets.clear();
+            scan_tile(img, PI, c, sp, scan, tp, tiles[i], buffer, tile_dets);
+            for (unsigned k = 0; k < tile_dets.size(); ++k)
+            {
+                local.push_back(to_source(tile_dets[k], tiles[i].scale));
+            }
+        }
+
+        #pragma omp critical
+        dets.insert(dets.end(), local.begin(), local.end());
+
+        release_preprocessed_image(&PI);
+    }
+
+    {
+        vector<Detection> buffer(TILE_DETECTIONS);
+        vector<Detection> tile_dets;
+        for (unsigned i = 0; i < small.size(); ++i)
+        {
+            PreprocessedImage * PI = create_preprocessed_image(cvSize(small[i].region.width, small[i].region.height));
+            prepare_classifier(c, PI, tp->pc_options);
+            tile_dets.clear();
+            scan_tile(img, PI, c, sp, scan, tp, small[i], buffer, tile_dets);
+            for (unsigned k = 0; k < tile_dets.size(); ++k)
+            {
+                dets.push_back(to_source(tile_dets[k], small[i].scale));
+            }
+            release_preprocessed_image(&PI);
+        }
+    }
+
+    const int n = min<int>(dets.size(), last - first);
+    copy(dets.begin(), dets.begin() + n, first);
+    return n;
+}
+
+
+/// Window origins lying within the ROI at a level (empty when the ROI is smaller than the window).
+static CvRect roi_origins(const CvRect & roi, float scale, CvSize level_sz, const TClassifier * c)
+{
+    const int x0 = max(0, int(ceil(roi.x / scale)));
+    const int y0 = max(0, int(ceil(roi.y / scale)));
+    const int x1 = min(level_sz.width, int(floor((roi.x + roi.width) / scale)));
+    const int y1 = min(level_sz.height, int(floor((roi.y + roi.height) / scale)));
+    return cvRect(x0, y0, max(0, x1 - int(c->width) - x0 + 1), max(0, y1 - int(c->height) - y0 + 1));
+}
+
+/// Region of a level needed to scan the window origins (aligned to 2 pixels).
+static CvRect scan_region(const CvRect & o, CvSize level_sz, const TClassifier * c)
+{
+    int x0 = max(0, o.x - TILE_MARGIN);
+    int y0 = max(0, o.y - TILE_MARGIN);
+    int x1 = min(level_sz.width, o.x + o.width + int(c->width) + TILE_MARGIN);
+    int y1 = min(level_sz.height, o.y + o.height + int(c->height) + TILE_MARGIN);
+    // Level sizes are even, so the region can always grow to one side
+    if ((x1 - x0) & 1) { if (x1 < level_sz.width) ++x1; else --x0; }
+    if ((y1 - y0) & 1) { if (y1 < level_sz.height) ++y1; else --y0; }
+    return cvRect(x0, y0, x1 - x0, y1 - y0);
+}
+
+static bool intersect(const CvRect & a, const CvRect & b)
+{
+    return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+static bool contains(const CvRect & r, int x, int y)
+{
+    return x >= r.x && x < r.x + r.width && y >= r.y && y < r.y + r.height;
+}
+
+
+int detect_objects_roi(IplImage * img, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        const TileParams * tp, const CvRect * rois, int roi_count,
+        Detection * first, Detection * last, int * roi_detections)
+{
+    return detect_objects_roi_levels(img, c, sp, scan, tp, rois, 0, roi_count, first, last, roi_detections);
+}
+
+
+int detect_objects_roi_levels(IplImage * img, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        const TileParams * tp, const CvRect * rois, const int * levels, int roi_count,
+        Detection * first, Detection * last, int * roi_detections)
+{
+    vector<vector<Detection> > dets(roi_count);
+    vector<Detection> buffer(TILE_DETECTIONS);
+    vector<Detection> tile_dets;
+
+    const int level_count = tp->octaves * tp->levels_per_octave;
+    for (int l = 0; l < level_count; ++l)
+    {
+        const float scale = pow(2.0f, float(l) / tp->levels_per_octave);
+        const CvSize level_sz = cvSize(int(img->width / scale) & ~1, int(img->height / scale) & ~1);
+
+        if (level_sz.width <= int(c->width) + 2 || level_sz.height <= int(c->height) + 2)
+            break;
+
+        // Window origins of each ROI at the level
+        vector<CvRect> origins(roi_count, cvRect(0, 0, 0, 0));
+        vector<CvRect> merged;
+        for (int i = 0; i < roi_count; ++i)
+        {
+            if (levels && (l < levels[2*i] || l > levels[2*i+1]))
+                continue; // Empty origins, not scanned at this level
+            origins[i] = roi_origins(rois[i], scale, level_sz, c);
+            if (origins[i].width > 0 && origins[i].height > 0)
+                merged.push_back(origins[i]);
+        }
+
+        // Merge ROIs whose scan regions overlap until there is nothing to merge
+        for (bool changed = true; changed; )
+        {
+            changed = false;
+            for (unsigned i = 0; i < merged.size() && !changed; ++i)
+            {
+                for (unsigned j = i + 1; j < merged.size() && !changed; ++j)
+                {
+                    if (!intersect(scan_region(merged[i], level_sz, c), scan_region(merged[j], level_sz, c)))
+                        continue;
+                    const int x0 = min(merged[i].x, merged[j].x);
+                    const int y0 = min(merged[i].y, merged[j].y);
+                    const int x1 = max(merged[i].x + merged[i].width, merged[j].x + merged[j].width);
+                    const int y1 = max(merged[i].y + merged[i].height, merged[j].y + merged[j].height);
+                    merged[i] = cvRect(x0, y0, x1 - x0, y1 - y0);
+                    merged.erase(merged.begin() + j);
+                    changed = true;
+                }
+            }
+        }
+
+        // Regions have different sizes, each one gets its own preprocessed
+        // image and the classifier is prepared for it
+        for (unsigned r = 0; r < merged.size(); ++r)
+        {
+            Tile t = { scale, scan_region(merged[r], level_sz, c), merged[r] };
+
+            PreprocessedImage * PI = create_preprocessed_image(cvSize(t.region.width, t.region.height));
+            prepare_classifier(c, PI, tp->pc_options);
+            tile_dets.clear();
+            scan_tile(img, PI, c, sp, scan, tp, t, buffer, tile_dets);
+            release_preprocessed_image(&PI);
+
+            for (unsigned k = 0; k < tile_dets.size(); ++k)
+            {
+                for (int i = 0; i < roi_count; ++i)
+                {
+                    if (contains(origins[i], tile_dets[k].x, tile_dets[k].y))
+                        dets[i].push_back(to_source(tile_dets[k], scale));
+                }
+            }
+        }
+    }
+
+    Detection * d = first;
+    for (int i = 0; i < roi_count; ++i)
+    {
+        const int n = min<int>(dets[i].size(), last - d);
+        d = copy(dets[i].begin(), dets[i].begin() + n, d);
+        roi_detections[i] = n;
+    }
+
+    return d - first;
+}
+
+int split_bands(CvSize img_sz, const TClassifier * c, const TileParams * tp, int bands, CvRect * rois, int * levels)
+{
+    vector<CvSize> positions;
+    double total = 0;
+
+    const int level_count = tp->octaves * tp->levels_per_octave;
+    for (int l = 0; l < level_count; ++l)
+    {
+        const float scale = pow(2.0f, float(l) / tp->levels_per_octave);
+        const CvSize level_sz = cvSize(int(img_sz.width / scale) & ~1, int(img_sz.height / scale) & ~1);
+        if (level_sz.width <= int(c->width) + 2 || level_sz.height <= int(c->height) + 2)
+            break;
+        positions.push_back(cvSize(level_sz.width - c->width, level_sz.height - c->height));
+        total += double(positions.back().width) * positions.back().height;
+    }
+
+    int n = 0;
+    const double target = total / max(bands, 1);
+    for (unsigned l = 0; l < positions.size(); ++l)
+    {
+        const float scale = pow(2.0f, float(l) / tp->levels_per_octave);
+        const int rows = positions[l].height;
+        const int level_bands = max(1, int(floor(double(positions[l].width) * rows / target + 0.5)));
+        const int band_rows = (rows + level_bands - 1) / level_bands;
+
+        for (int y0 = 0; y0 < rows; y0 += band_rows, ++n)
+        {
+            if (!rois)
+                continue;
+            const int y1 = min(rows, y0 + band_rows);
+            const int top = max(0, int((y0 - 1) * scale));
+            const int bottom = min(img_sz.height, int(ceil((y1 + 1 + c->height) * scale)));
+            rois[n] = cvRect(0, top, img_sz.width, bottom - top);
+            if (levels)
+            {
+                levels[2*n] = l;
+                levels[2*n+1] = l;
+            }
+        }
+    }
+
+    return n;
+}
@@ -0,0 +1,171 @@
+/*
+ *  video.cpp
+ *  $Id$
+ *
+ *  Graph@FIT
+ *  Department of Computer Graphics and Multimedia
+ *  Faculty of Information Technology
+ *  Brno University of Technology
+ *
+ *  Description
+ *  Tracking-assisted detection in video streams (see video.h).
+ *
+ */
+
+#include "video.h"
+#include "group.h"
+
+#include <cv.h>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+
+/// Detections buffer of one frame
+#define VIDEO_DETECTIONS (8192)
+
+/// Size of thumbnails compared for scene changes
+#define THUMBNAIL_WIDTH (32)
+#define THUMBNAIL_HEIGHT (24)
+
+
+VideoState * create_video_state(const VideoParams * vp, const TileParams * tp)
+{
+    VideoState * vs = new VideoState();
+    vs->vp = *vp;
+    vs->tp = *tp;
+    vs->thumbnail = 0;
+    vs->PP = 0;
+    reset_video_state(vs);
+    return vs;
+}
+
+void release_video_state(VideoState ** vs)
+{
+    if (vs && *vs)
+    {
+        cvReleaseImage(&(*vs)->thumbnail);
+        release_pyramid(&(*vs)->PP);
+        delete *vs;
+        *vs = 0;
+    }
+}
+
+void reset_video_state(VideoState * vs)
+{
+    vs->frame = 0;
+    vs->slice = 0;
+    vs->full_scan = 0;
+    vs->tracks.clear();
+    cvReleaseImage(&vs->thumbnail);
+}
+
+/// Update the thumbnail and check whether the scene changed.
+static bool scene_changed(IplImage * img, VideoState * vs)
+{
+    IplImage * thumbnail = cvCreateImage(cvSize(THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT), IPL_DEPTH_8U, 1);
+    cvResize(img, thumbnail, CV_INTER_AREA);
+
+    bool changed = true;
+    if (vs->thumbnail)
+    {
+        IplImage * diff = cvCreateImage(cvGetSize(thumbnail), IPL_DEPTH_8U, 1);
+        cvAbsDiff(thumbnail, vs->thumbnail, diff);
+        changed = vs->vp.scene_change > 0 && cvAvg(diff).val[0] > vs->vp.scene_change;
+        cvReleaseImage(&diff);
+    }
+
+    cvReleaseImage(&vs->thumbnail);
+    vs->thumbnail = thumbnail;
+    return changed;
+}
+
+/// Scan of the whole frame on the pyramid.
+static int scan_full(IplImage * img, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        VideoState * vs, Detection * first, Detection * last)
+{
+    const CvSize base_sz = cvSize((img->width + 1) & ~1, (img->height + 1) & ~1);
+    if (!vs->PP || vs->PP->PI[0]->sz.width != base_sz.width || vs->PP->PI[0]->sz.height != base_sz.height)
+    {
+        release_pyramid(&vs->PP);
+        vs->PP = create_pyramid(base_sz, cvSize(c->width + 2, c->height + 2), vs->tp.octaves, vs->tp.levels_per_octave);
+    }
+
+    insert_image(img, vs->PP, vs->tp.pp_options);
+    const float scale = float(img->width) / base_sz.width;
+    return detect_objects(vs->PP, c, sp, scan, first, last, vs->tp.pc_options, scale, 0);
+}
+
+int detect_objects_video(IplImage * img, TClassifier * c, ScanParams * sp, ScanImageFunc scan,
+        VideoState * vs, Detection * first, Detection * last)
+{
+    const VideoParams & vp = vs->vp;
+    const TileParams & tp = vs->tp;
+
+    vector<Detection> dets(VIDEO_DETECTIONS);
+    int n = 0;
+
+    const bool changed = scene_changed(img, vs);
+    vs->full_scan = vs->frame == 0 || changed || (vp.full_interval > 0 && vs->frame % vp.full_interval == 0);
+
+    if (vs->full_scan)
+    {
+        n = scan_full(img, c, sp, scan, vs, &dets[0], &dets[0] + dets.size());
+    }
+    else
+    {
+        vector<CvRect> rois;
+        vector<int> levels;
+
+        // Neighbourhoods of the tracked objects
+        for (unsigned i = 0; i < vs->tracks.size(); ++i)
+        {
+            const Detection & d = vs->tracks[i];
+            const int dx = int(ceil(d.width * vp.dilate));
+            const int dy = int(ceil(d.height * vp.dilate));
+            const int x0 = max(0, d.x - dx), y0 = max(0, d.y - dy);
+            const int x1 = min(img->width, d.x + d.width + dx), y1 = min(img->height, d.y + d.height + dy);
+            if (x1 <= x0 || y1 <= y0)
+                continue;
+            const int level = int(floor(tp.levels_per_octave * log(float(d.width) / c->width) / log(2.0f) + 0.5f));
+            rois.push_back(cvRect(x0, y0, x1 - x0, y1 - y0));
+            levels.push_back(max(0, level - vp.scale_range));
+            levels.push_back(level + vp.scale_range);
+        }
+
+        // The rotating slice
+        const int slice_count = (vp.slices > 0) ? split_bands(cvGetSize(img), c, &tp, vp.slices, 0, 0) : 0;
+        if (slice_count > 0)
+        {
+            vector<CvRect> slice_rois(slice_count);
+            vector<int> slice_levels(2 * slice_count);
+            split_bands(cvGetSize(img), c, &tp, vp.slices, &slice_rois[0], &slice_levels[0]);
+
+            const int s = vs->slice % slice_count;
+            rois.push_back(slice_rois[s]);
+            levels.push_back(slice_levels[2*s]);
+            levels.push_back(slice_levels[2*s+1]);
+            vs->slice = s + 1;
+        }
+
+        if (!rois.empty())
+        {
+            vector<int> roi_detections(rois.size());
+            n = detect_objects_roi_levels(img, c, sp, scan, &tp, &rois[0], &levels[0], rois.size(),
+                    &dets[0], &dets[0] + dets.size(), &roi_detections[0]);
+            // Overlapping ROIs list their common windows more times, duplicates would count as neighbours
+            n = unique_detections(&dets[0], &dets[0] + n);
+        }
+    }
+
+    n = group_detections(&dets[0], &dets[0] + n, vp.min_neighbors, vp.eps);
+
+    vs->tracks.assign(dets.begin(), dets.begin() + n);
+    ++vs->frame;
+
+    n = min<int>(n, last - first);
+    copy(dets.begin(), dets.begin() + n, first);
+    return n;
+}
@@ -0,0 +1,88 @@
+#ifndef LIBFR_ASYNC_IO_H
+#define LIBFR_ASYNC_IO_H
+
+#include <pthread.h>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace fr {
+    // Reader of whole files in batches.
+    //
+    // With io_uring (libfr built with HAVE_LIBURING, kernel 5.1+) the reads
+    // of a batch are submitted together and their completions reaped with
+    // one io_uring_enter, so a batch of files costs a few syscalls besides
+    // open and fstat and the device sees all reads at once. Otherwise (or
+    // when the ring cannot be set up) the files are read one by one by
+    // pread; the loader threads calling Read are the thread pool then.
+    //
+    // A reader is used by one thread at a time.
+    class FileReader
+    {
+    public:
+        // depth - reads in flight at most
+        FileReader(unsigned depth);
+        ~FileReader();
+
+        // Read the files to the buffers (resized to the files, capacity is kept);
+        // ok[i] is false if files[i] cannot be read. Returns the number of files read.
+        unsigned Read(const std::vector<std::string>& files, std::vector< std::vector<unsigned char> >& buffers, std::vector<bool>& ok);
+
+        // io_uring is used
+        bool Async() const { return Uring != NULL; }
+
+    protected:
+        struct Ring;
+
+        void ReadSync(const std::vector<int>& fds, std::vector< std::vector<unsigned char> >& buffers, std::vector<bool>& ok);
+        void ReadAsync(const std::vector<int>& fds, std::vector< std::vector<unsigned char> >& buffers, std::vector<bool>& ok);
+
+        unsigned Depth;
+        Ring* Uring;                // NULL - synchronous reads
+    }; // class FileReader
+
+    // Appends records (e.g. result lines) to a file with few syscalls.
+    //
+    // Append only copies the record to the current block; full blocks are
+    // written by a background thread, all blocks waiting are written by one
+    // writev. The callers never wait for the device unless Pending blocks
+    // are waiting already. Records are written in the order of Append.
+    class ResultWriter
+    {
+    public:
+        // fd - open file descriptor (e.g. 1 for stdout), it is not closed
+        ResultWriter(int fd, size_t blockSize = 1 << 20, unsigned pending = 4);
+        ~ResultWriter();
+
+        // Append the record; may be called from more threads
+        void Append(const std::string& record);
+
+        // Write everything appended so far, false if a write failed
+        bool Flush();
+
+    protected:
+        static void* WriterThread(void* arg);
+        void Run();
+
+        int Fd;
+        size_t BlockSize;
+        unsigned Pending;
+
+        std::string Current;            // Block being filled
+        std::deque<std::string> Full;   // Blocks waiting for the writer
+        bool Writing;                   // The writer has taken blocks
+        bool Stopping;
+        bool Failed;
+
+        pthread_t Writer;
+        bool WriterRunning;
+
+        // Guards the blocks
+        pthread_mutex_t Lock;
+        pthread_cond_t Ready;           // A block is full or Stop
+        pthread_cond_t Written;         // The writer finished blocks
+    }; // class ResultWriter
+}; // namespace fr
+
+#endif // LIBFR_ASYNC_IO_H
@@ -1,6 +1,7 @@
 #ifndef LIBFR_PROGRAM_H
 #define LIBFR_PROGRAM_H
 
+#include <iostream>
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
 
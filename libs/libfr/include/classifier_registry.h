@@ -0,0 +1,113 @@
+#ifndef LIBFR_CLASSIFIER_REGISTRY_H
+#define LIBFR_CLASSIFIER_REGISTRY_H
+
+#include <libabr.h>
+
+#include <pthread.h>
+#include <list>
+#include <string>
+#include <vector>
+
+namespace fr {
+    // One published version of a classifier
+    struct ClassifierVersion
+    {
+        TClassifier* Classifier;    // Initialized classifier (read only for scanners)
+        std::string Source;         // File the classifier was loaded from
+        unsigned long Number;       // Sequence number of the version (1, 2, ...)
+    };
+
+    // Registry of the current classifier with RCU-style replacement.
+    //
+    // Scanning threads pin the current version by Acquire/Release on their own
+    // reader slot; no locks are taken on this path. A new version is loaded and
+    // prepared by Load (or in background by LoadAsync) and published by a single
+    // pointer swap. Replaced versions are retired and released once no reader
+    // slot is pinned to an epoch older than the retirement.
+    //
+    // Note that prepare_classifier modifies the classifier, so readers sharing
+    // a version must not prepare it for different image sizes concurrently.
+    class ClassifierRegistry
+    {
+    public:
+        // Prepare hook called on a loaded classifier before it is published
+        typedef bool (*PrepareFunc)(TClassifier* c);
+
+        ClassifierRegistry(unsigned maxReaders = 64);
+        virtual ~ClassifierRegistry();
+
+        // Reader side
+
+        // Get a free reader slot (call once per scanning thread), -1 if there is none
+        int RegisterReader();
+
+        // Return the slot to the registry
+        void UnregisterReader(int slot);
+
+        // Pin the current version for the slot and return it (NULL if none was published)
+        const ClassifierVersion* Acquire(int slot);
+
+        // Unpin the version acquired by the slot
+        void Release(int slot);
+
+        // Writer side
+
+        // Load, initialize and publish the classifier; blocks the caller
+        bool Load(const std::string& file);
+
+        // Load, initialize and publish the classifier in a background thread
+        bool LoadAsync(const std::string& file);
+
+        // Wait for the background load to finish; returns its result
+        bool Wait();
+
+        // Release retired versions which are no longer used; returns number of released versions
+        unsigned Reclaim();
+
+        // Number of retired versions waiting for release
+        unsigned Retired();
+
+        // Set hook called on new classifiers after init_classifier (e.g. quantise_classifier)
+        void SetPrepare(PrepareFunc prepare) { Prepare = prepare; }
+
+    protected:
+        struct RetiredVersion
+        {
+            ClassifierVersion* Version;
+            unsigned long Epoch;    // Global epoch after the version was replaced
+        };
+
+        // Reader slot, one cache line each to avoid false sharing
+        struct ReaderSlot
+        {
+            volatile unsigned long Epoch;   // Pinned epoch or IDLE
+            volatile int Used;
+            char Padding[64 - sizeof(unsigned long) - sizeof(int)];
+        };
+
+        static const unsigned long IDLE = 0;
+
+        void Publish(ClassifierVersion* version);
+        void ReleaseVersion(ClassifierVersion* version);
+        static void* LoadThread(void* arg);
+
+        ClassifierVersion* volatile Current;
+        volatile unsigned long Epoch;
+        unsigned long Versions;
+
+        std::vector<ReaderSlot> Readers;
+        std::list<RetiredVersion> RetiredList;
+
+        // Serializes writers (never taken by readers)
+        pthread_mutex_t WriterLock;
+
+        pthread_t Loader;
+        bool LoaderRunning;
+        bool LoaderResult;
+        std::string LoaderFile;
+
+        PrepareFunc Prepare;
+    }; // class ClassifierRegistry
+}; // namespace fr
+
+#endif // LIBFR_CLASSIFIER_REGISTRY_H
@@ -0,0 +1,110 @@
+#ifndef LIBFR_IMAGE_LOADER_H
+#define LIBFR_IMAGE_LOADER_H
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+
+#include "async_io.h"
+
+#include <pthread.h>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fr {
+    // Image decoded by the loader
+    struct LoadedImage
+    {
+        std::string File;
+        unsigned long Index;        // Position of the file in the list
+        IplImage* Image;            // Decoded image (owned by the consumer), NULL if the file cannot be read
+        CvSize Size;                // Size of the image in the file (Image may be reduced, see SetMaxScale)
+    };
+
+    // Loader decoding images of a file list ahead of the consumer.
+    //
+    // A pool of threads reads and decodes the files in the order of the list;
+    // at most Window files are being decoded or wait for the consumer, so
+    // memory stays bounded for lists of any length. Next returns the images in
+    // the order of the list and may be called from more threads. Each thread
+    // takes Batch consecutive files at once and reads them together by its
+    // FileReader (io_uring when available) into buffers reused for all files.
+    //
+    // The list is given by Add (and Finish) or read from a stream (e.g. stdin)
+    // in a background thread, so decoding starts before the list is complete.
+    // The decoding threads start on the first call of Next, so derived
+    // classes may override Read and Decode; they must call Stop in their
+    // destructor.
+    //
+    // When the consumer never needs the full resolution (e.g. the base of
+    // the pyramid is smaller than the image), grayscale JPEG files are
+    // decoded reduced in the DCT domain by libjpeg (built with HAVE_LIBJPEG),
+    // which saves most of the decoding time and memory bandwidth.
+    class ImageLoader
+    {
+    public:
+        // flags are passed to cvDecodeImage (CV_LOAD_IMAGE_GRAYSCALE, ...)
+        ImageLoader(unsigned threads, unsigned window, int flags = CV_LOAD_IMAGE_GRAYSCALE);
+        virtual ~ImageLoader();
+
+        // Append a file to the list
+        void Add(const std::string& file);
+
+        // The list is complete
+        void Finish();
+
+        // Read file names (one per line) from the stream in a background thread, Finish at its end
+        bool ReadList(std::istream& in);
+
+        // Next image in the order of the list, waits for its decoding; false at the end of the list
+        bool Next(LoadedImage& image);
+
+        // Stop the threads, images not taken are released
+        void Stop();
+
+        // Images may be decoded reduced by up to the factor (1 - full size, the default);
+        // the largest power of two reduction not exceeding it is used. Call before Next.
+        void SetMaxScale(float scale) { MaxScale = scale; }
+
+        // Files read together by a thread (1 - the default); the window limits it. Call before Next.
+        void SetBatch(unsigned files) { Batch = files > 0 ? files : 1; }
+
+    protected:
+        // Read the whole files to the buffers by the reader of the thread; ok[i] is false if files[i] cannot be read
+        virtual void Read(FileReader& reader, const std::vector<std::string>& files,
+                std::vector< std::vector<unsigned char> >& buffers, std::vector<bool>& ok);
+
+        // Decode the file contents and get the size of the image in the file; NULL if it cannot be decoded
+        virtual IplImage* Decode(const std::string& file, const std::vector<unsigned char>& buffer, CvSize* size);
+
+        static void* WorkerThread(void* arg);
+        static void* ListThread(void* arg);
+        void Run();
+
+        int Flags;
+        unsigned Window;
+        unsigned ThreadCount;
+        float MaxScale;
+        unsigned Batch;
+
+        std::vector<std::string> Files;
+        std::map<unsigned long, LoadedImage> Decoded;
+        unsigned long NextDecode;   // Next file to decode
+        unsigned long NextTake;     // Next file returned by Next
+        bool Finished;
+        bool Stopping;
+
+        std::vector<pthread_t> Threads;
+        pthread_t Lister;
+        bool ListerRunning;
+        std::istream* List;
+
+        // Guards the list and the decoded images
+        pthread_mutex_t Lock;
+        pthread_cond_t Available;   // An image was decoded or the list changed
+        pthread_cond_t Space;       // A file was taken by Next or the list changed
+    }; // class ImageLoader
+}; // namespace fr
+
+#endif // LIBFR_IMAGE_LOADER_H
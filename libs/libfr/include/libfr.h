@@ -1,7 +1,12 @@
 #ifndef LIBFR_LIBFR_H
 #define LIBFR_LIBFR_H
 
+#include "async_io.h"
 #include "base_app.h"
+#include "classifier_registry.h"
+#include "image_loader.h"
+#include "spsc_queue.h"
+#include "stream_server.h"
 
 namespace fr {
 };
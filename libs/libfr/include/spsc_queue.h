@@ -0,0 +1,74 @@
+#ifndef LIBFR_SPSC_QUEUE_H
+#define LIBFR_SPSC_QUEUE_H
+
+#include <vector>
+
+namespace fr {
+    // Bounded lock-free queue connecting exactly one producer thread with one
+    // consumer thread. Push and Pop never block; they fail when the queue is
+    // full or empty and the caller decides whether to wait or drop the item.
+    //
+    // Capacity is rounded up to a power of two.
+    template <typename T>
+    class SpscQueue
+    {
+    public:
+        SpscQueue(unsigned capacity)
+            : Head(0), Tail(0)
+        {
+            unsigned size = 1;
+            while (size < capacity)
+            {
+                size <<= 1;
+            }
+            Items.resize(size);
+            Mask = size - 1;
+        }
+
+        // Producer side; false if the queue is full
+        bool Push(const T& item)
+        {
+            const unsigned long tail = Tail;
+            if (tail - Head > Mask)
+            {
+                return false;
+            }
+            Items[tail & Mask] = item;
+            __sync_synchronize(); // item is written before it is visible
+            Tail = tail + 1;
+            return true;
+        }
+
+        // Consumer side; false if the queue is empty
+        bool Pop(T& item)
+        {
+            const unsigned long head = Head;
+            if (head == Tail)
+            {
+                return false;
+            }
+            __sync_synchronize(); // item is read after the tail
+            item = Items[head & Mask];
+            __sync_synchronize(); // item is read before the slot is reused
+            Head = head + 1;
+            return true;
+        }
+
+        // Number of queued items (approximate when called by a third thread)
+        unsigned Size() const { return Tail - Head; }
+
+        unsigned Capacity() const { return Mask + 1; }
+
+    protected:
+        std::vector<T> Items;
+        unsigned long Mask;
+
+        // Consumer and producer indices, one cache line each to avoid false sharing
+        volatile unsigned long Head;
+        char HeadPadding[64 - sizeof(unsigned long)];
+        volatile unsigned long Tail;
+        char TailPadding[64 - sizeof(unsigned long)];
+    }; // class SpscQueue
+}; // namespace fr
+
+#endif // LIBFR_SPSC_QUEUE_H
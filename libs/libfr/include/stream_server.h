@@ -0,0 +1,121 @@
+#ifndef LIBFR_STREAM_SERVER_H
+#define LIBFR_STREAM_SERVER_H
+
+#include <libabr.h>
+
+#include <pthread.h>
+#include <vector>
+
+namespace fr {
+    // Parameters of one stream
+    struct StreamParams
+    {
+        double TargetLatency;       // Wanted time from Submit to the result in ms
+        int TrackInterval;          // Full scan every N frames and tracking in between (0 - scan every frame)
+    };
+
+    // Counters of one stream
+    struct StreamStats
+    {
+        unsigned long Submitted;    // Frames passed to Submit
+        unsigned long Processed;    // Frames with results
+        unsigned long Dropped;      // Frames replaced by a newer one before processing
+        unsigned long Late;         // Results delivered after the target latency
+        double Latency;             // Mean latency of the processed frames in ms
+        double MaxLatency;          // Maximal latency in ms
+    };
+
+    // Called by a worker with the grouped detections of a frame (in frame coordinates)
+    typedef void (*ResultFunc)(int stream, unsigned long frame, const Detection* dets, int count, void* user);
+
+    // Detection runtime for many streams in one process.
+    //
+    // All streams share one initialized classifier; each worker scans through
+    // its own view of it (create_classifier_view), so only the data changed by
+    // prepare_classifier is duplicated. Every stream keeps its own pyramid and
+    // tracking state and its frames are processed in order, one at a time.
+    //
+    // A fixed pool of workers takes frames from all streams. The next frame
+    // is the one with the earliest deadline (submit time + target latency) of
+    // the streams not being processed, so streams with equal targets are
+    // served in the order of arrival and tighter targets go first. Each
+    // stream holds at most one waiting frame; a newer frame replaces it, so
+    // overloaded streams skip frames instead of accumulating latency.
+    class StreamServer
+    {
+    public:
+        // The classifier must be initialized and must outlive the server
+        StreamServer(const TClassifier* c, ScanImageFunc scan, int ppOptions, int pcOptions, ScanParams sp,
+                unsigned workers, ResultFunc result, void* user);
+        virtual ~StreamServer();
+
+        // Add a stream; returns its identifier or -1
+        int AddStream(const StreamParams& params);
+
+        // Copy the frame (one channel, 8 bit) to the stream queue; false if it replaced a waiting frame
+        bool Submit(int stream, const IplImage* frame);
+
+        // Wait until all submitted frames are processed
+        void Flush();
+
+        // Stop the workers; waiting frames are discarded
+        void Stop();
+
+        // Counters of the stream
+        StreamStats GetStats(int stream);
+
+        // Number of workers running
+        unsigned Workers() const { return Threads.size(); }
+
+    protected:
+        struct Stream
+        {
+            StreamParams Params;
+            StreamStats Stats;
+            IplImage* Waiting;          // Frame waiting for a worker (owned)
+            IplImage* Current;          // Frame being processed (owned)
+            bool HasFrame;              // Waiting holds a frame
+            bool Busy;                  // A worker processes the stream
+            int64 Submitted;            // Tick count of Submit of the waiting frame
+            double Deadline;            // Tick count the waiting frame should be done by
+            unsigned long Frame;        // Number of the waiting frame
+            PreprocessedPyramid* Pyramid;
+            VideoState* Video;
+        };
+
+        struct Worker
+        {
+            StreamServer* Server;
+            TClassifier* View;
+        };
+
+        static void* WorkerThread(void* arg);
+        void Run(Worker* w);
+
+        // Stream with the earliest deadline which is not busy, -1 if there is none; called with the lock
+        int Next();
+
+        void Detect(Worker* w, Stream* s, std::vector<Detection>& dets, int* count);
+
+        const TClassifier* Classifier;
+        ScanImageFunc Scan;
+        int PPOptions;
+        int PCOptions;
+        ScanParams SP;
+        ResultFunc Result;
+        void* User;
+
+        std::vector<Stream*> Streams;
+        std::vector<Worker> Pool;
+        std::vector<pthread_t> Threads;
+
+        // Guards the streams and the scheduling state
+        pthread_mutex_t Lock;
+        pthread_cond_t Ready;           // A frame was submitted or Stop was called
+        pthread_cond_t Idle;            // A worker finished a frame
+        unsigned Active;                // Frames being processed
+        bool Stopping;
+    }; // class StreamServer
+}; // namespace fr
+
+#endif // LIBFR_STREAM_SERVER_H
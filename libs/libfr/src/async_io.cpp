@@ -0,0 +1,381 @@
+#include <async_io.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX (1024)
+#endif
+
+namespace fr {
+#ifdef HAVE_LIBURING
+    struct FileReader::Ring
+    {
+        io_uring Queue;
+    };
+#endif
+
+    FileReader::FileReader(unsigned depth)
+        : Depth(depth > 0 ? depth : 1), Uring(NULL)
+    {
+#ifdef HAVE_LIBURING
+        // Kernels without io_uring (or with it disabled) fail here, the reads are synchronous then
+        Ring* ring = new Ring();
+        if (io_uring_queue_init(Depth, &ring->Queue, 0) == 0)
+        {
+            Uring = ring;
+        }
+        else
+        {
+            delete ring;
+        }
+#endif
+    }
+
+    FileReader::~FileReader()
+    {
+#ifdef HAVE_LIBURING
+        if (Uring)
+        {
+            io_uring_queue_exit(&Uring->Queue);
+            delete Uring;
+        }
+#endif
+    }
+
+    unsigned FileReader::Read(const std::vector<std::string>& files, std::vector< std::vector<unsigned char> >& buffers, std::vector<bool>& ok)
+    {
+        const unsigned n = files.size();
+        buffers.resize(n);
+        ok.assign(n, false);
+
+        // Sizes are known before any read is queued, buffers are not resized while reads are in flight
+        std::vector<int> fds(n, -1);
+        for (unsigned i = 0; i < n; ++i)
+        {
+            const int fd = open(files[i].c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                continue;
+            }
+            struct stat st;
+            if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+            {
+                buffers[i].resize(st.st_size);
+                fds[i] = fd;
+            }
+            else
+            {
+                close(fd);
+            }
+        }
+
+#ifdef HAVE_LIBURING
+        if (Uring)
+        {
+            ReadAsync(fds, buffers, ok);
+        }
+#endif
+        ReadSync(fds, buffers, ok);
+
+        unsigned count = 0;
+        for (unsigned i = 0; i < n; ++i)
+        {
+            if (fds[i] >= 0)
+            {
+                close(fds[i]);
+            }
+            count += ok[i];
+        }
+        return count;
+    }
+
+    void FileReader::ReadSync(const std::vector<int>& fds, std::vector< std::vector<unsigned char> >& buffers, std::vector<bool>& ok)
+    {
+        // Files already read asynchronously are skipped
+        for (unsigned i = 0; i < fds.size(); ++i)
+        {
+            if (fds[i] < 0 || ok[i])
+            {
+                continue;
+            }
+            std::vector<unsigned char>& buffer = buffers[i];
+            size_t done = 0;
+            while (done < buffer.size())
+            {
+                const ssize_t r = pread(fds[i], &buffer[done], buffer.size() - done, done);
+                if (r < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (r <= 0)
+                {
+                    break;
+                }
+                done += r;
+            }
+            ok[i] = (done == buffer.size());
+        }
+    }
+
+#ifdef HAVE_LIBURING
+    void FileReader::ReadAsync(const std::vector<int>& fds, std::vector< std::vector<unsigned char> >& buffers, std::vector<bool>& ok)
+    {
+        io_uring* ring = &Uring->Queue;
+        const unsigned n = fds.size();
+
+        std::vector<size_t> done(n, 0);
+        std::deque<unsigned> queue;
+        for (unsigned i = 0; i < n; ++i)
+        {
+            if (fds[i] >= 0)
+            {
+                queue.push_back(i);
+            }
+        }
+
+        unsigned inflight = 0;
+        while (!queue.empty() || inflight > 0)
+        {
+            // Queue reads while the ring has space
+            while (!queue.empty() && inflight < Depth)
+            {
+                io_uring_sqe* sqe = io_uring_get_sqe(ring);
+                if (!sqe)
+                {
+                    break;
+                }
+                const unsigned i = queue.front();
+                queue.pop_front();
+                io_uring_prep_read(sqe, fds[i], &buffers[i][done[i]], buffers[i].size() - done[i], done[i]);
+                io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(uintptr_t(i)));
+                ++inflight;
+            }
+
+            // One syscall submits the queued reads and waits for the first completion
+            const int ret = io_uring_submit_and_wait(ring, 1);
+            if (ret < 0 && ret != -EINTR)
+            {
+                // The ring is not used anymore, ReadSync reads the files not completed;
+                // closing the ring cancels the reads in flight
+                io_uring_queue_exit(ring);
+                delete Uring;
+                Uring = NULL;
+                return;
+            }
+
+            io_uring_cqe* cqe;
+            unsigned head;
+            unsigned seen = 0;
+            io_uring_for_each_cqe(ring, head, cqe)
+            {
+                const unsigned i = unsigned(uintptr_t(io_uring_cqe_get_data(cqe)));
+                ++seen;
+                --inflight;
+                if (cqe->res == -EAGAIN || cqe->res == -EINTR)
+                {
+                    queue.push_back(i);
+                }
+                else if (cqe->res > 0)
+                {
+                    // Short reads continue where they stopped
+                    done[i] += cqe->res;
+                    if (done[i] < buffers[i].size())
+                    {
+                        queue.push_back(i);
+                    }
+                    else
+                    {
+                        ok[i] = true;
+                    }
+                }
+                else
+                {
+                    // Error or the file was truncated, ReadSync tries again
+                }
+            }
+            io_uring_cq_advance(ring, seen);
+        }
+    }
+#endif
+
+    // Write the blocks by writev, IOV_MAX blocks at a time; false on an error
+    static bool WriteBlocks(int fd, const std::deque<std::string>& blocks)
+    {
+        std::vector<iovec> iov;
+        for (std::deque<std::string>::const_iterator it = blocks.begin(); it != blocks.end(); ++it)
+        {
+            if (!it->empty())
+            {
+                iovec v = { const_cast<char*>(it->data()), it->size() };
+                iov.push_back(v);
+            }
+        }
+
+        size_t first = 0;
+        while (first < iov.size())
+        {
+            const int count = std::min<size_t>(iov.size() - first, IOV_MAX);
+            ssize_t r = writev(fd, &iov[first], count);
+            if (r < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+
+            // A partial write continues in the middle of a block
+            while (r > 0)
+            {
+                if (size_t(r) >= iov[first].iov_len)
+                {
+                    r -= iov[first].iov_len;
+                    ++first;
+                }
+                else
+                {
+                    iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + r;
+                    iov[first].iov_len -= r;
+                    r = 0;
+                }
+            }
+        }
+        return true;
+    }
+
+    ResultWriter::ResultWriter(int fd, size_t blockSize, unsigned pending)
+        : Fd(fd), BlockSize(blockSize > 0 ? blockSize : 1), Pending(pending > 0 ? pending : 1),
+          Writing(false), Stopping(false), Failed(false), WriterRunning(false)
+    {
+        pthread_mutex_init(&Lock, NULL);
+        pthread_cond_init(&Ready, NULL);
+        pthread_cond_init(&Written, NULL);
+
+        Current.reserve(BlockSize);
+        WriterRunning = (pthread_create(&Writer, NULL, WriterThread, this) == 0);
+    }
+
+    ResultWriter::~ResultWriter()
+    {
+        Flush();
+
+        pthread_mutex_lock(&Lock);
+        Stopping = true;
+        pthread_cond_broadcast(&Ready);
+        pthread_mutex_unlock(&Lock);
+
+        if (WriterRunning)
+        {
+            pthread_join(Writer, NULL);
+        }
+
+        pthread_cond_destroy(&Written);
+        pthread_cond_destroy(&Ready);
+        pthread_mutex_destroy(&Lock);
+    }
+
+    void ResultWriter::Append(const std::string& record)
+    {
+        pthread_mutex_lock(&Lock);
+        Current += record;
+        if (Current.size() >= BlockSize)
+        {
+            // Callers wait only when the writer is behind by Pending blocks
+            while (WriterRunning && Full.size() >= Pending)
+            {
+                pthread_cond_wait(&Written, &Lock);
+            }
+            Full.push_back(std::string());
+            Full.back().swap(Current);
+            Current.reserve(BlockSize);
+
+            if (WriterRunning)
+            {
+                pthread_cond_signal(&Ready);
+            }
+            else
+            {
+                Failed = Failed || !WriteBlocks(Fd, Full);
+                Full.clear();
+            }
+        }
+        pthread_mutex_unlock(&Lock);
+    }
+
+    bool ResultWriter::Flush()
+    {
+        pthread_mutex_lock(&Lock);
+        if (!Current.empty())
+        {
+            Full.push_back(std::string());
+            Full.back().swap(Current);
+        }
+
+        if (WriterRunning)
+        {
+            pthread_cond_signal(&Ready);
+            while (!Full.empty() || Writing)
+            {
+                pthread_cond_wait(&Written, &Lock);
+            }
+        }
+        else
+        {
+            Failed = Failed || !WriteBlocks(Fd, Full);
+            Full.clear();
+        }
+
+        const bool ok = !Failed;
+        pthread_mutex_unlock(&Lock);
+        return ok;
+    }
+
+    void* ResultWriter::WriterThread(void* arg)
+    {
+        static_cast<ResultWriter*>(arg)->Run();
+        return NULL;
+    }
+
+    void ResultWriter::Run()
+    {
+        pthread_mutex_lock(&Lock);
+        while (true)
+        {
+            while (!Stopping && Full.empty())
+            {
+                pthread_cond_wait(&Ready, &Lock);
+            }
+            if (Full.empty())
+            {
+                break;
+            }
+
+            // All waiting blocks go to one writev, Append may fill new blocks meanwhile
+            std::deque<std::string> blocks;
+            blocks.swap(Full);
+            Writing = true;
+            pthread_cond_broadcast(&Written);
+            pthread_mutex_unlock(&Lock);
+
+            const bool ok = WriteBlocks(Fd, blocks);
+
+            pthread_mutex_lock(&Lock);
+            Failed = Failed || !ok;
+            Writing = false;
+            pthread_cond_broadcast(&Written);
+        }
+        pthread_mutex_unlock(&Lock);
+    }
+} // namespace fr
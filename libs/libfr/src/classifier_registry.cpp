@@ -0,0 +1,186 @@
+#include <classifier_registry.h>
+
+namespace fr {
+	ClassifierRegistry::ClassifierRegistry(unsigned maxReaders)
+        : Current(NULL), Epoch(1), Versions(0), Readers(maxReaders),
+          LoaderRunning(false), LoaderResult(false), Prepare(NULL)
+    {
+        for (unsigned i = 0; i < Readers.size(); ++i)
+        {
+            Readers[i].Epoch = IDLE;
+            Readers[i].Used = 0;
+        }
+        pthread_mutex_init(&WriterLock, NULL);
+	}
+
+	ClassifierRegistry::~ClassifierRegistry() {
+        Wait();
+
+        // No readers may be active at this point
+        for (std::list<RetiredVersion>::iterator it = RetiredList.begin(); it != RetiredList.end(); ++it)
+        {
+            ReleaseVersion(it->Version);
+        }
+        ReleaseVersion(Current);
+
+        pthread_mutex_destroy(&WriterLock);
+	}
+
+    int ClassifierRegistry::RegisterReader()
+    {
+        for (unsigned i = 0; i < Readers.size(); ++i)
+        {
+            if (__sync_bool_compare_and_swap(&Readers[i].Used, 0, 1))
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void ClassifierRegistry::UnregisterReader(int slot)
+    {
+        Release(slot);
+        __sync_lock_release(&Readers[slot].Used);
+    }
+
+    const ClassifierVersion* ClassifierRegistry::Acquire(int slot)
+    {
+        // Announce the epoch first, then read the pointer. Any version retired
+        // after this point is kept until the slot is released.
+        Readers[slot].Epoch = Epoch;
+        __sync_synchronize();
+        return Current;
+    }
+
+    void ClassifierRegistry::Release(int slot)
+    {
+        __sync_synchronize();
+        Readers[slot].Epoch = IDLE;
+    }
+
+    bool ClassifierRegistry::Load(const std::string& file)
+    {
+        TClassifier* c = load_classifier_XML(file.c_str());
+        if (!c)
+        {
+            return false;
+        }
+
+        // Everything the engines need is created before publishing
+        init_classifier(c);
+        if (Prepare && !Prepare(c))
+        {
+            release_classifier(&c);
+            return false;
+        }
+
+        ClassifierVersion* version = new ClassifierVersion();
+        version->Classifier = c;
+        version->Source = file;
+
+        Publish(version);
+        Reclaim();
+        return true;
+    }
+
+    void* ClassifierRegistry::LoadThread(void* arg)
+    {
+        ClassifierRegistry* registry = static_cast<ClassifierRegistry*>(arg);
+        registry->LoaderResult = registry->Load(registry->LoaderFile);
+        return NULL;
+    }
+
+    bool ClassifierRegistry::LoadAsync(const std::string& file)
+    {
+        Wait();
+        LoaderFile = file;
+        LoaderRunning = (pthread_create(&Loader, NULL, LoadThread, this) == 0);
+        return LoaderRunning;
+    }
+
+    bool ClassifierRegistry::Wait()
+    {
+        if (LoaderRunning)
+        {
+            pthread_join(Loader, NULL);
+            LoaderRunning = false;
+            return LoaderResult;
+        }
+        return LoaderResult;
+    }
+
+    void ClassifierRegistry::Publish(ClassifierVersion* version)
+    {
+        pthread_mutex_lock(&WriterLock);
+
+        version->Number = ++Versions;
+
+        ClassifierVersion* old = Current;
+        __sync_synchronize(); // version is complete before it is visible
+        Current = version;
+        __sync_synchronize();
+
+        if (old)
+        {
+            // Readers pinned to an epoch >= this one see the new version
+            RetiredVersion r = { old, __sync_add_and_fetch(&Epoch, 1) };
+            RetiredList.push_back(r);
+        }
+
+        pthread_mutex_unlock(&WriterLock);
+    }
+
+    unsigned ClassifierRegistry::Reclaim()
+    {
+        pthread_mutex_lock(&WriterLock);
+
+        // The oldest epoch any reader may still use
+        unsigned long oldest = Epoch;
+        __sync_synchronize();
+        for (unsigned i = 0; i < Readers.size(); ++i)
+        {
+            const unsigned long e = Readers[i].Epoch;
+            if (e != IDLE && e < oldest)
+            {
+                oldest = e;
+            }
+        }
+
+        unsigned released = 0;
+        std::list<RetiredVersion>::iterator it = RetiredList.begin();
+        while (it != RetiredList.end())
+        {
+            if (it->Epoch <= oldest)
+            {
+                ReleaseVersion(it->Version);
+                it = RetiredList.erase(it);
+                ++released;
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        pthread_mutex_unlock(&WriterLock);
+        return released;
+    }
+
+    unsigned ClassifierRegistry::Retired()
+    {
+        pthread_mutex_lock(&WriterLock);
+        unsigned n = RetiredList.size();
+        pthread_mutex_unlock(&WriterLock);
+        return n;
+    }
+
+    void ClassifierRegistry::ReleaseVersion(ClassifierVersion* version)
+    {
+        if (version)
+        {
+            release_classifier(&version->Classifier);
+            delete version;
+        }
+    }
+} // namespace fr
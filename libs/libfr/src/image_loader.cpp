@@ -0,0 +1,295 @@
+#include <image_loader.h>
+
+#include <algorithm>
+
+#ifdef HAVE_LIBJPEG
+#include <csetjmp>
+#include <jpeglib.h>
+#endif
+
+namespace fr {
+    ImageLoader::ImageLoader(unsigned threads, unsigned window, int flags)
+        : Flags(flags), Window(window > 0 ? window : 1), ThreadCount(threads > 0 ? threads : 1), MaxScale(1.0f), Batch(1),
+          NextDecode(0), NextTake(0), Finished(false), Stopping(false), ListerRunning(false), List(NULL)
+    {
+        pthread_mutex_init(&Lock, NULL);
+        pthread_cond_init(&Available, NULL);
+        pthread_cond_init(&Space, NULL);
+    }
+
+    ImageLoader::~ImageLoader()
+    {
+        Stop();
+
+        pthread_cond_destroy(&Space);
+        pthread_cond_destroy(&Available);
+        pthread_mutex_destroy(&Lock);
+    }
+
+    void ImageLoader::Add(const std::string& file)
+    {
+        pthread_mutex_lock(&Lock);
+        Files.push_back(file);
+        pthread_cond_broadcast(&Space);
+        pthread_mutex_unlock(&Lock);
+    }
+
+    void ImageLoader::Finish()
+    {
+        pthread_mutex_lock(&Lock);
+        Finished = true;
+        pthread_cond_broadcast(&Space);
+        pthread_cond_broadcast(&Available);
+        pthread_mutex_unlock(&Lock);
+    }
+
+    bool ImageLoader::ReadList(std::istream& in)
+    {
+        if (ListerRunning)
+        {
+            return false;
+        }
+        List = &in;
+        ListerRunning = (pthread_create(&Lister, NULL, ListThread, this) == 0);
+        return ListerRunning;
+    }
+
+    void* ImageLoader::ListThread(void* arg)
+    {
+        ImageLoader* loader = static_cast<ImageLoader*>(arg);
+        std::string line;
+        while (!loader->Stopping && std::getline(*loader->List, line))
+        {
+            if (!line.empty() && line[line.size() - 1] == '\r')
+            {
+                line.erase(line.size() - 1);
+            }
+            if (!line.empty())
+            {
+                loader->Add(line);
+            }
+        }
+        loader->Finish();
+        return NULL;
+    }
+
+    bool ImageLoader::Next(LoadedImage& image)
+    {
+        pthread_mutex_lock(&Lock);
+
+        // Threads start here so the overrides of derived classes are used
+        if (Threads.empty() && !Stopping)
+        {
+            for (unsigned i = 0; i < ThreadCount; ++i)
+            {
+                pthread_t thread;
+                if (pthread_create(&thread, NULL, WorkerThread, this) == 0)
+                {
+                    Threads.push_back(thread);
+                }
+            }
+        }
+
+        std::map<unsigned long, LoadedImage>::iterator it;
+        while (!Stopping && (it = Decoded.find(NextTake)) == Decoded.end())
+        {
+            if (Finished && NextTake >= Files.size())
+            {
+                pthread_mutex_unlock(&Lock);
+                return false;
+            }
+            pthread_cond_wait(&Available, &Lock);
+        }
+        if (Stopping)
+        {
+            pthread_mutex_unlock(&Lock);
+            return false;
+        }
+
+        image = it->second;
+        image.File = Files[NextTake];
+        image.Index = NextTake;
+        Decoded.erase(it);
+        ++NextTake;
+
+        pthread_cond_broadcast(&Space);
+        pthread_mutex_unlock(&Lock);
+        return true;
+    }
+
+    void ImageLoader::Stop()
+    {
+        pthread_mutex_lock(&Lock);
+        Stopping = true;
+        pthread_cond_broadcast(&Space);
+        pthread_cond_broadcast(&Available);
+        pthread_mutex_unlock(&Lock);
+
+        for (unsigned i = 0; i < Threads.size(); ++i)
+        {
+            pthread_join(Threads[i], NULL);
+        }
+        Threads.clear();
+
+        // The list thread stops after the line being read
+        if (ListerRunning)
+        {
+            pthread_join(Lister, NULL);
+            ListerRunning = false;
+        }
+
+        for (std::map<unsigned long, LoadedImage>::iterator it = Decoded.begin(); it != Decoded.end(); ++it)
+        {
+            cvReleaseImage(&it->second.Image);
+        }
+        Decoded.clear();
+    }
+
+    void* ImageLoader::WorkerThread(void* arg)
+    {
+        static_cast<ImageLoader*>(arg)->Run();
+        return NULL;
+    }
+
+    void ImageLoader::Run()
+    {
+        // Reused for all files read by the thread
+        FileReader reader(Batch);
+        std::vector<std::string> files;
+        std::vector< std::vector<unsigned char> > buffers;
+        std::vector<bool> ok;
+
+        pthread_mutex_lock(&Lock);
+        while (true)
+        {
+            // The window bounds the decoded images waiting for the consumer
+            while (!Stopping && (NextDecode >= Files.size() || NextDecode >= NextTake + Window))
+            {
+                if (Finished && NextDecode >= Files.size())
+                {
+                    break;
+                }
+                pthread_cond_wait(&Space, &Lock);
+            }
+            if (Stopping || NextDecode >= Files.size())
+            {
+                break;
+            }
+
+            // Consecutive files, so the first of them is not delayed much by the others
+            const unsigned long index = NextDecode;
+            const unsigned long count = std::min<unsigned long>(Batch, std::min<unsigned long>(Files.size(), NextTake + Window) - index);
+            NextDecode += count;
+            files.assign(Files.begin() + index, Files.begin() + index + count);
+            pthread_mutex_unlock(&Lock);
+
+            Read(reader, files, buffers, ok);
+
+            for (unsigned long i = 0; i < count; ++i)
+            {
+                LoadedImage image;
+                image.Size = cvSize(0, 0);
+                image.Image = (ok[i] && !Stopping) ? Decode(files[i], buffers[i], &image.Size) : NULL;
+
+                pthread_mutex_lock(&Lock);
+                Decoded[index + i] = image;
+                pthread_cond_broadcast(&Available);
+                pthread_mutex_unlock(&Lock);
+            }
+
+            pthread_mutex_lock(&Lock);
+        }
+        pthread_mutex_unlock(&Lock);
+    }
+
+    void ImageLoader::Read(FileReader& reader, const std::vector<std::string>& files,
+            std::vector< std::vector<unsigned char> >& buffers, std::vector<bool>& ok)
+    {
+        reader.Read(files, buffers, ok);
+    }
+
+#ifdef HAVE_LIBJPEG
+    struct JpegError
+    {
+        jpeg_error_mgr Manager;
+        jmp_buf Jump;
+    };
+
+    static void JpegErrorExit(j_common_ptr cinfo)
+    {
+        longjmp(reinterpret_cast<JpegError*>(cinfo->err)->Jump, 1);
+    }
+
+    // Grayscale JPEG decoded with the largest DCT scaling (1/8 .. 1/1) which keeps
+    // the image at least 1/maxScale of its size
+    static IplImage* DecodeJpeg(const std::vector<unsigned char>& buffer, float maxScale, CvSize* size)
+    {
+        jpeg_decompress_struct cinfo;
+        JpegError error;
+        cinfo.err = jpeg_std_error(&error.Manager);
+        error.Manager.error_exit = JpegErrorExit;
+
+        IplImage* volatile result = NULL;
+        if (setjmp(error.Jump))
+        {
+            IplImage* img = result;
+            cvReleaseImage(&img);
+            jpeg_destroy_decompress(&cinfo);
+            return NULL;
+        }
+
+        jpeg_create_decompress(&cinfo);
+        jpeg_mem_src(&cinfo, const_cast<unsigned char*>(&buffer[0]), buffer.size());
+        jpeg_read_header(&cinfo, TRUE);
+        *size = cvSize(cinfo.image_width, cinfo.image_height);
+
+        cinfo.out_color_space = JCS_GRAYSCALE;
+        cinfo.scale_num = 1;
+        for (unsigned denom = 8; denom >= 1; denom /= 2)
+        {
+            cinfo.scale_denom = denom;
+            jpeg_calc_output_dimensions(&cinfo);
+            if (denom == 1 || (cinfo.output_width * maxScale >= cinfo.image_width &&
+                               cinfo.output_height * maxScale >= cinfo.image_height))
+            {
+                break;
+            }
+        }
+
+        jpeg_start_decompress(&cinfo);
+        result = cvCreateImage(cvSize(cinfo.output_width, cinfo.output_height), IPL_DEPTH_8U, 1);
+        while (cinfo.output_scanline < cinfo.output_height)
+        {
+            JSAMPROW row = reinterpret_cast<JSAMPROW>(result->imageData + cinfo.output_scanline * result->widthStep);
+            jpeg_read_scanlines(&cinfo, &row, 1);
+        }
+        jpeg_finish_decompress(&cinfo);
+        jpeg_destroy_decompress(&cinfo);
+
+        return result;
+    }
+#endif
+
+    IplImage* ImageLoader::Decode(const std::string& file, const std::vector<unsigned char>& buffer, CvSize* size)
+    {
+#ifdef HAVE_LIBJPEG
+        // JPEG files start with the SOI marker; files libjpeg cannot convert to
+        // grayscale (CMYK, YCCK) or fails on are left to cvDecodeImage
+        if (Flags == CV_LOAD_IMAGE_GRAYSCALE && MaxScale >= 2.0f && buffer.size() > 2 && buffer[0] == 0xFF && buffer[1] == 0xD8)
+        {
+            IplImage* img = DecodeJpeg(buffer, MaxScale, size);
+            if (img)
+            {
+                return img;
+            }
+        }
+#endif
+        CvMat data = cvMat(1, buffer.size(), CV_8UC1, (void*)&buffer[0]);
+        IplImage* img = cvDecodeImage(&data, Flags);
+        if (img)
+        {
+            *size = cvGetSize(img);
+        }
+        return img;
+    }
+} // namespace fr
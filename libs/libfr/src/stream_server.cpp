@@ -0,0 +1,261 @@
+#include <stream_server.h>
+
+#include <algorithm>
+
+// Detections buffer of one frame
+#define STREAM_DETECTIONS (8192)
+
+namespace fr {
+    StreamServer::StreamServer(const TClassifier* c, ScanImageFunc scan, int ppOptions, int pcOptions, ScanParams sp,
+            unsigned workers, ResultFunc result, void* user)
+        : Classifier(c), Scan(scan), PPOptions(ppOptions), PCOptions(pcOptions), SP(sp),
+          Result(result), User(user), Active(0), Stopping(false)
+    {
+        pthread_mutex_init(&Lock, NULL);
+        pthread_cond_init(&Ready, NULL);
+        pthread_cond_init(&Idle, NULL);
+
+        // Views are created before any thread starts, Pool is not resized later
+        Pool.resize(std::max(workers, 1u));
+        for (unsigned i = 0; i < Pool.size(); ++i)
+        {
+            Pool[i].Server = this;
+            Pool[i].View = create_classifier_view(c);
+        }
+
+        for (unsigned i = 0; i < Pool.size(); ++i)
+        {
+            pthread_t thread;
+            if (Pool[i].View && pthread_create(&thread, NULL, WorkerThread, &Pool[i]) == 0)
+            {
+                Threads.push_back(thread);
+            }
+        }
+    }
+
+    StreamServer::~StreamServer()
+    {
+        Stop();
+
+        for (unsigned i = 0; i < Pool.size(); ++i)
+        {
+            release_classifier_view(&Pool[i].View);
+        }
+
+        for (unsigned i = 0; i < Streams.size(); ++i)
+        {
+            Stream* s = Streams[i];
+            cvReleaseImage(&s->Waiting);
+            cvReleaseImage(&s->Current);
+            release_pyramid(&s->Pyramid);
+            release_video_state(&s->Video);
+            delete s;
+        }
+
+        pthread_cond_destroy(&Idle);
+        pthread_cond_destroy(&Ready);
+        pthread_mutex_destroy(&Lock);
+    }
+
+    int StreamServer::AddStream(const StreamParams& params)
+    {
+        Stream* s = new Stream();
+        s->Params = params;
+        s->Stats = StreamStats();
+        s->Waiting = NULL;
+        s->Current = NULL;
+        s->HasFrame = false;
+        s->Busy = false;
+        s->Submitted = 0;
+        s->Deadline = 0;
+        s->Frame = 0;
+        s->Pyramid = NULL;
+        s->Video = NULL;
+
+        if (params.TrackInterval > 0)
+        {
+            VideoParams vp = { params.TrackInterval, 20.0f, 0.25f, 1, 16, 3, 0.2f };
+            TileParams tp = { 0, 8, 4, PPOptions, PCOptions };
+            s->Video = create_video_state(&vp, &tp);
+        }
+
+        pthread_mutex_lock(&Lock);
+        const int id = Streams.size();
+        Streams.push_back(s);
+        pthread_mutex_unlock(&Lock);
+        return id;
+    }
+
+    bool StreamServer::Submit(int stream, const IplImage* frame)
+    {
+        const int64 now = cvGetTickCount();
+
+        pthread_mutex_lock(&Lock);
+
+        Stream* s = Streams[stream];
+        const bool replaced = s->HasFrame;
+
+        if (!s->Waiting || s->Waiting->width != frame->width || s->Waiting->height != frame->height)
+        {
+            cvReleaseImage(&s->Waiting);
+            s->Waiting = cvCreateImage(cvGetSize(frame), IPL_DEPTH_8U, 1);
+        }
+        cvCopy(frame, s->Waiting);
+
+        s->HasFrame = true;
+        s->Submitted = now;
+        s->Deadline = now + s->Params.TargetLatency * cvGetTickFrequency() * 1e3;
+        s->Frame = s->Stats.Submitted++;
+        if (replaced)
+        {
+            ++s->Stats.Dropped;
+        }
+
+        pthread_cond_signal(&Ready);
+        pthread_mutex_unlock(&Lock);
+        return !replaced;
+    }
+
+    void StreamServer::Flush()
+    {
+        pthread_mutex_lock(&Lock);
+        while (!Stopping && !Threads.empty())
+        {
+            bool waiting = false;
+            for (unsigned i = 0; i < Streams.size(); ++i)
+            {
+                waiting = waiting || Streams[i]->HasFrame;
+            }
+            if (!waiting && Active == 0)
+            {
+                break;
+            }
+            pthread_cond_wait(&Idle, &Lock);
+        }
+        pthread_mutex_unlock(&Lock);
+    }
+
+    void StreamServer::Stop()
+    {
+        pthread_mutex_lock(&Lock);
+        Stopping = true;
+        pthread_cond_broadcast(&Ready);
+        pthread_cond_broadcast(&Idle);
+        pthread_mutex_unlock(&Lock);
+
+        for (unsigned i = 0; i < Threads.size(); ++i)
+        {
+            pthread_join(Threads[i], NULL);
+        }
+        Threads.clear();
+    }
+
+    StreamStats StreamServer::GetStats(int stream)
+    {
+        pthread_mutex_lock(&Lock);
+        StreamStats stats = Streams[stream]->Stats;
+        pthread_mutex_unlock(&Lock);
+        return stats;
+    }
+
+    void* StreamServer::WorkerThread(void* arg)
+    {
+        Worker* w = static_cast<Worker*>(arg);
+        w->Server->Run(w);
+        return NULL;
+    }
+
+    int StreamServer::Next()
+    {
+        int next = -1;
+        for (unsigned i = 0; i < Streams.size(); ++i)
+        {
+            const Stream* s = Streams[i];
+            if (s->HasFrame && !s->Busy && (next < 0 || s->Deadline < Streams[next]->Deadline))
+            {
+                next = i;
+            }
+        }
+        return next;
+    }
+
+    void StreamServer::Run(Worker* w)
+    {
+        std::vector<Detection> dets(STREAM_DETECTIONS);
+
+        pthread_mutex_lock(&Lock);
+        while (true)
+        {
+            int id;
+            while (!Stopping && (id = Next()) < 0)
+            {
+                pthread_cond_wait(&Ready, &Lock);
+            }
+            if (Stopping)
+            {
+                break;
+            }
+
+            // Take the waiting frame, the stream is owned by this worker until it is done
+            Stream* s = Streams[id];
+            std::swap(s->Waiting, s->Current);
+            s->HasFrame = false;
+            s->Busy = true;
+            const int64 submitted = s->Submitted;
+            const double deadline = s->Deadline;
+            const unsigned long frame = s->Frame;
+            ++Active;
+            pthread_mutex_unlock(&Lock);
+
+            int count = 0;
+            Detect(w, s, dets, &count);
+            if (Result)
+            {
+                Result(id, frame, &dets[0], count, User);
+            }
+
+            const int64 now = cvGetTickCount();
+            const double latency = (now - submitted) / (cvGetTickFrequency() * 1e3);
+
+            pthread_mutex_lock(&Lock);
+            StreamStats& stats = s->Stats;
+            ++stats.Processed;
+            stats.Latency += (latency - stats.Latency) / stats.Processed;
+            stats.MaxLatency = std::max(stats.MaxLatency, latency);
+            if (now > deadline)
+            {
+                ++stats.Late;
+            }
+            s->Busy = false;
+            --Active;
+            pthread_cond_broadcast(&Idle);
+        }
+        pthread_mutex_unlock(&Lock);
+    }
+
+    void StreamServer::Detect(Worker* w, Stream* s, std::vector<Detection>& dets, int* count)
+    {
+        IplImage* img = s->Current;
+        ScanParams sp = SP;
+        Detection* first = &dets[0];
+        Detection* last = first + dets.size();
+
+        if (s->Video)
+        {
+            *count = detect_objects_video(img, w->View, &sp, Scan, s->Video, first, last);
+            return;
+        }
+
+        const CvSize sz = cvSize((img->width + 1) & ~1, (img->height + 1) & ~1);
+        if (!s->Pyramid || s->Pyramid->PI[0]->sz.width != sz.width || s->Pyramid->PI[0]->sz.height != sz.height)
+        {
+            release_pyramid(&s->Pyramid);
+            s->Pyramid = create_pyramid(sz, cvSize(w->View->width + 2, w->View->height + 2), 8, 4);
+        }
+
+        insert_image(img, s->Pyramid, PPOptions);
+        const float scale = float(img->width) / sz.width;
+        const int n = detect_objects(s->Pyramid, w->View, &sp, Scan, first, last, PCOptions, scale, 0);
+        *count = group_detections(first, first + n, 3, 0.2f);
+    }
+} // namespace fr